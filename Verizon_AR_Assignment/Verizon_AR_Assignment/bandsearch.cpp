@@ -0,0 +1,181 @@
+#include "bandsearch.h"
+#include <algorithm>
+#include <limits.h>
+#include <stdlib.h>
+
+void StereoBandSearch(const cv::Mat& _left, const cv::Mat& _right, const cv::Mat& _prediction, cv::Mat& _disparity, cv::Mat* _unsure,
+	int _yBegin, int _yEnd, int _blockSize, int _minDisparity, int _maxDisparity, int _uniquenessRatio, cv::Mat* _cost)
+{
+	int width = _left.cols;
+	int height = _left.rows;
+	int radius = std::min(_blockSize, STEREO_BAND_MAX_BLOCK_SIZE) / 2;
+	short invalid = StereoInvalidDisparity(_minDisparity);
+
+	// valid region, same as the one cv::StereoBM leaves filled
+	int xBegin = std::min(std::max(_maxDisparity + radius, radius), width - radius);
+	int xEnd = std::max(std::min(width + _minDisparity - radius, width - radius), xBegin);
+
+	cv::AutoBuffer<unsigned short> columnBuffer(width * STEREO_BAND_SIZE);
+	unsigned short* columnCost = columnBuffer;
+	unsigned int windowCost[STEREO_BAND_SIZE];
+	unsigned short cost[STEREO_BAND_SIZE];
+	std::fill(columnCost, columnCost + width * STEREO_BAND_SIZE, 0);
+
+	// adds (_sign 1) or removes (_sign -1) the band differences of one image row to the column sums
+	auto updateColumns = [&](int _row, int _sign)
+	{
+		const uchar* leftRow = _left.ptr<uchar>(_row);
+		const uchar* rightRow = _right.ptr<uchar>(_row);
+		const short* prediction = _prediction.ptr<short>(_row);
+		for (int x = 0; x < width; ++x)
+		{
+			int base = x - prediction[x] + STEREO_BAND_RADIUS;
+			unsigned short* column = columnCost + x * STEREO_BAND_SIZE;
+			if (base - STEREO_BAND_SIZE + 1 >= 0 && base < width)
+			{
+				for (int k = 0; k < STEREO_BAND_SIZE; ++k)
+				{
+					column[k] += (unsigned short)(_sign * abs(leftRow[x] - rightRow[base - k]));
+				}
+				continue;
+			}
+			for (int k = 0; k < STEREO_BAND_SIZE; ++k)
+			{
+				int xr = std::min(std::max(base - k, 0), width - 1);
+				column[k] += (unsigned short)(_sign * abs(leftRow[x] - rightRow[xr]));
+			}
+		}
+	};
+
+	int yFirst = std::max(_yBegin, radius);
+	int yLast = std::min(_yEnd, height - radius);
+	for (int y = yFirst - radius; y < yFirst + radius && yFirst < yLast; ++y)
+	{
+		updateColumns(y, 1);
+	}
+
+	for (int y = _yBegin; y < _yEnd; ++y)
+	{
+		short* dispRow = _disparity.ptr<short>(y);
+		uchar* unsureRow = _unsure ? _unsure->ptr<uchar>(y) : NULL;
+		unsigned short* costRow = _cost ? _cost->ptr<unsigned short>(y) : NULL;
+		if (unsureRow)
+		{
+			std::fill(unsureRow, unsureRow + width, 0);
+		}
+		if (costRow)
+		{
+			std::fill(costRow, costRow + width, (unsigned short)0xFFFF);
+		}
+		if (y < yFirst || y >= yLast)
+		{
+			std::fill(dispRow, dispRow + width, invalid);
+			continue;
+		}
+
+		updateColumns(y + radius, 1);
+		if (y > yFirst)
+		{
+			updateColumns(y - radius - 1, -1);
+		}
+
+		const short* prediction = _prediction.ptr<short>(y);
+		std::fill(dispRow, dispRow + xBegin, invalid);
+		std::fill(dispRow + xEnd, dispRow + width, invalid);
+		if (xBegin >= xEnd)
+		{
+			continue;
+		}
+
+		// running box sum of the column sums along the row
+		for (int k = 0; k < STEREO_BAND_SIZE; ++k)
+		{
+			windowCost[k] = 0;
+			for (int dx = -radius; dx < radius; ++dx)
+			{
+				windowCost[k] += columnCost[(xBegin + dx) * STEREO_BAND_SIZE + k];
+			}
+		}
+		for (int x = xBegin; x < xEnd; ++x)
+		{
+			unsigned int best = 0xFFFFFFFF;
+			int bestK = 0;
+			for (int k = 0; k < STEREO_BAND_SIZE; ++k)
+			{
+				windowCost[k] += columnCost[(x + radius) * STEREO_BAND_SIZE + k];
+				if (x > xBegin)
+				{
+					windowCost[k] -= columnCost[(x - radius - 1) * STEREO_BAND_SIZE + k];
+				}
+				cost[k] = (unsigned short)std::min(windowCost[k], 0xFFFFu);
+				if (cost[k] < best)
+				{
+					best = cost[k];
+					bestK = k;
+				}
+			}
+
+			int first = prediction[x] - STEREO_BAND_RADIUS;
+			if (unsureRow)
+			{
+				bool lowEdge = bestK == 0 && first > _minDisparity;
+				bool highEdge = bestK == STEREO_BAND_SIZE - 1 && first + bestK < _maxDisparity;
+				unsureRow[x] = lowEdge || highEdge ? 255 : 0;
+			}
+
+			if (_uniquenessRatio > 0)
+			{
+				unsigned int threshold = StereoUniquenessThreshold(best, _uniquenessRatio);
+				int lowerCount = 0;
+				for (int k = 0; k < STEREO_BAND_SIZE; ++k)
+				{
+					lowerCount += cost[k] <= threshold ? 1 : 0;
+				}
+				if (StereoIsAmbiguous(cost, bestK, STEREO_BAND_SIZE, lowerCount, threshold))
+				{
+					dispRow[x] = invalid;
+					if (unsureRow)
+					{
+						unsureRow[x] = 255;
+					}
+					continue;
+				}
+			}
+			dispRow[x] = StereoSubpixelDisparity(cost, bestK, STEREO_BAND_SIZE, first);
+			if (costRow)
+			{
+				costRow[x] = (unsigned short)best;
+			}
+		}
+	}
+}
+
+void StereoFillPredictionHoles(short* _prediction, int _width, short _fill)
+{
+	int lastValid = -1;
+	for (int x = 0; x <= _width; ++x)
+	{
+		if (x < _width && _prediction[x] == SHRT_MIN)
+		{
+			continue;
+		}
+		if (x - lastValid > 1)
+		{
+			short fill = _fill;
+			if (lastValid >= 0 && x < _width)
+			{
+				fill = std::min(_prediction[lastValid], _prediction[x]);
+			}
+			else if (lastValid >= 0)
+			{
+				fill = _prediction[lastValid];
+			}
+			else if (x < _width)
+			{
+				fill = _prediction[x];
+			}
+			std::fill(_prediction + lastValid + 1, _prediction + x, fill);
+		}
+		lastValid = x;
+	}
+}
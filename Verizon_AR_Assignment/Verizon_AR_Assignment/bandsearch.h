@@ -0,0 +1,29 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include "stereokernels.h"
+
+// Narrow disparity search around a per-pixel prediction, shared by the matchers that already
+// know roughly where the match is (the finer pyramid levels, the previous frame of a video).
+// The band costs are block sums of |left(x) - right(x - prediction(x) - k)|, offsets relative to each
+// pixel's own prediction. That is the block SAD wherever the prediction is flat inside the block.
+
+// number of disparities searched around every prediction on each side
+const int STEREO_BAND_RADIUS = 2;
+// candidates per pixel
+const int STEREO_BAND_SIZE = 2 * STEREO_BAND_RADIUS + 1;
+// band windows are block SADs of 16 bit costs, larger blocks are capped
+const int STEREO_BAND_MAX_BLOCK_SIZE = 15;
+
+// writes rows [_yBegin, _yEnd) of _disparity (16S, 4 fractional bits) from the whole disparity
+// predictions in _prediction (16S), which must lie in [_minDisparity + STEREO_BAND_RADIUS, _maxDisparity - STEREO_BAND_RADIUS].
+// the valid region is the one cv::StereoBM leaves filled. _unsure (8U) may be NULL, otherwise its rows
+// are set to 255 where the pixel was ambiguous or its best cost sits on an edge of the band that is
+// not an edge of the range, so the true match may lie outside the band, and to 0 everywhere else.
+// _cost (16U) may be NULL, otherwise its rows get the window cost of the chosen disparity, 0xFFFF where
+// the disparity is invalid, so searches around different predictions can be compared
+void StereoBandSearch(const cv::Mat& _left, const cv::Mat& _right, const cv::Mat& _prediction, cv::Mat& _disparity, cv::Mat* _unsure,
+	int _yBegin, int _yEnd, int _blockSize, int _minDisparity, int _maxDisparity, int _uniquenessRatio, cv::Mat* _cost = NULL);
+
+// replaces the SHRT_MIN holes of a prediction row. holes are mostly occlusions, so they take the
+// background side, the smaller of the nearest valid neighbours. a row without any valid value gets _fill
+void StereoFillPredictionHoles(short* _prediction, int _width, short _fill);
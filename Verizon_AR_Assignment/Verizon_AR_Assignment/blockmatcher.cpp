@@ -0,0 +1,188 @@
+#include "blockmatcher.h"
+#include <algorithm>
+
+cv::Ptr<BlockMatcher> BlockMatcher::create(int _numDisparities, int _blockSize, int _mode)
+{
+	return cv::makePtr<BlockMatcher>(_numDisparities, _blockSize, _mode);
+}
+
+BlockMatcher::BlockMatcher(int _numDisparities, int _blockSize, int _mode)
+	: m_NumDisparities(_numDisparities), m_BlockSize(_blockSize), m_Mode(_mode)
+{
+	m_MinDisparity = 0;
+	m_SpeckleWindowSize = 0;
+	m_SpeckleRange = 0;
+	m_Disp12MaxDiff = -1;
+	m_UniquenessRatio = 0;
+	m_ColumnBegin = 0;
+}
+
+void BlockMatcher::compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity)
+{
+	cv::Mat left = _left.getMat();
+	cv::Mat right = _right.getMat();
+
+	if (left.type() != CV_8UC1 || right.type() != CV_8UC1 || left.size() != right.size())
+	{
+		throw "Block matcher needs two greyscale images of the same size";
+	}
+	if (m_NumDisparities <= 0 || m_NumDisparities % 16 != 0)
+	{
+		throw "Number of disparities must be a positive multiple of 16";
+	}
+	if (m_Mode == MODE_SAD && (m_BlockSize < 3 || m_BlockSize > 15 || m_BlockSize % 2 == 0))
+	{
+		throw "Block size must be odd and between 3 and 15";
+	}
+	if (m_Mode == MODE_CENSUS && (m_BlockSize < 1 || m_BlockSize > 51 || m_BlockSize % 2 == 0))
+	{
+		throw "Census block size must be odd and between 1 and 51";
+	}
+
+	const StereoKernels& kernels = GetStereoKernels();
+
+	int width = left.cols;
+	int height = left.rows;
+	int numDisp = m_NumDisparities;
+	int radius = m_BlockSize / 2;
+	int paddedWidth = width + numDisp;
+
+	// valid range, same as the region of interest cv::StereoBM leaves filled
+	int maxDisparity = m_MinDisparity + numDisp - 1;
+	int xBegin = std::min(std::max(maxDisparity + radius, radius), width - radius);
+	int xEnd = std::max(std::min(width + m_MinDisparity - radius, width - radius), xBegin);
+
+	_disparity.create(left.size(), CV_16S);
+	cv::Mat disparity = _disparity.getMat();
+	short invalid = StereoInvalidDisparity(m_MinDisparity);
+
+	// only the columns under the windows of the valid range are costed, the ones left of it would only
+	// feed pixels that are left invalid anyway
+	m_ColumnBegin = xBegin - radius;
+	int columns = xEnd > xBegin ? xEnd + radius - m_ColumnBegin : 0;
+	m_ColumnCost.assign(columns * numDisp, 0);
+	m_Cost.resize(columns * numDisp);
+
+	if (m_Mode == MODE_CENSUS)
+	{
+		// signatures of both images up front, 4 bytes per pixel instead of a whole grey patch
+		m_LeftCensus.resize(width * height);
+		m_RightCensus.resize(paddedWidth * height);
+		m_CensusRow.resize(width);
+		for (int y = 0; y < height; ++y)
+		{
+			_censusTransformRow(left, y, &m_LeftCensus[y * width]);
+			_censusTransformRow(right, y, &m_CensusRow[0]);
+			StereoPadRightRow(&m_CensusRow[0], width, m_MinDisparity, numDisp, &m_RightCensus[y * paddedWidth + numDisp]);
+		}
+	}
+	else
+	{
+		// a ring of the padded right rows inside the window, a row is padded once when it enters and
+		// read back from the ring when it leaves
+		m_PaddedRows.resize(paddedWidth * (m_BlockSize + 1));
+	}
+
+	// fill the columns with the first rows of the window
+	for (int y = 0; y < std::min(2 * radius, height); ++y)
+	{
+		_updateColumnCost(kernels, left, right, y, -1, false);
+	}
+
+	for (int y = 0; y < height; ++y)
+	{
+		short* dispRow = disparity.ptr<short>(y);
+		std::fill(dispRow, dispRow + width, invalid);
+		if (y < radius || y >= height - radius || columns <= 2 * radius)
+		{
+			continue;
+		}
+
+		// slide the window one row down, the sums of column radius on are the ones of pixel
+		// m_ColumnBegin + radius = xBegin on
+		_updateColumnCost(kernels, left, right, y + radius, y - radius - 1, true);
+		kernels.SelectDisparityRow(&m_Cost[0], dispRow + m_ColumnBegin, radius, columns - radius, numDisp, m_MinDisparity, m_UniquenessRatio);
+	}
+
+	if (m_SpeckleWindowSize > 0)
+	{
+		cv::filterSpeckles(disparity, invalid, m_SpeckleWindowSize, m_SpeckleRange * STEREO_DISP_SCALE, m_SpeckleBuffer);
+	}
+}
+
+void BlockMatcher::_updateColumnCost(const StereoKernels& _kernels, const cv::Mat& _left, const cv::Mat& _right, int _enter, int _leave, bool _boxSum)
+{
+	int width = _left.cols;
+	int numDisp = m_NumDisparities;
+	int paddedWidth = width + numDisp;
+	int columns = (int)m_ColumnCost.size() / numDisp;
+	if (columns <= 0)
+	{
+		return;
+	}
+
+	if (m_Mode == MODE_CENSUS)
+	{
+		const unsigned int* addLeft = &m_LeftCensus[_enter * width + m_ColumnBegin];
+		const unsigned int* addRight = &m_RightCensus[_enter * paddedWidth + numDisp + m_ColumnBegin];
+		const unsigned int* subLeft = _leave >= 0 ? &m_LeftCensus[_leave * width + m_ColumnBegin] : NULL;
+		const unsigned int* subRight = _leave >= 0 ? &m_RightCensus[_leave * paddedWidth + numDisp + m_ColumnBegin] : NULL;
+		_kernels.UpdateColumnCostCensus(addLeft, addRight, subLeft, subRight, &m_ColumnCost[0], columns, numDisp);
+		if (_boxSum)
+		{
+			_kernels.BoxSumRow(&m_ColumnCost[0], &m_Cost[0], columns, numDisp, m_BlockSize / 2);
+		}
+		return;
+	}
+
+	// the entering row takes the slot of the one that left the ring a row earlier
+	int ringSize = m_BlockSize + 1;
+	uchar* addRight = &m_PaddedRows[(_enter % ringSize) * paddedWidth + numDisp];
+	StereoPadRightRow(_right.ptr<uchar>(_enter), width, m_MinDisparity, numDisp, addRight);
+	const uchar* addLeft = _left.ptr<uchar>(_enter) + m_ColumnBegin;
+	if (_leave >= 0)
+	{
+		const uchar* subLeft = _left.ptr<uchar>(_leave) + m_ColumnBegin;
+		const uchar* subRight = &m_PaddedRows[(_leave % ringSize) * paddedWidth + numDisp];
+		if (_boxSum)
+		{
+			// one pass over the columns instead of two
+			_kernels.UpdateBoxSumRowSAD(addLeft, addRight + m_ColumnBegin, subLeft, subRight + m_ColumnBegin,
+				&m_ColumnCost[0], &m_Cost[0], columns, numDisp, m_BlockSize / 2);
+			return;
+		}
+		_kernels.UpdateColumnCostSAD(addLeft, addRight + m_ColumnBegin, subLeft, subRight + m_ColumnBegin, &m_ColumnCost[0], columns, numDisp);
+	}
+	else
+	{
+		_kernels.UpdateColumnCostSAD(addLeft, addRight + m_ColumnBegin, NULL, NULL, &m_ColumnCost[0], columns, numDisp);
+	}
+	if (_boxSum)
+	{
+		_kernels.BoxSumRow(&m_ColumnCost[0], &m_Cost[0], columns, numDisp, m_BlockSize / 2);
+	}
+}
+
+void BlockMatcher::_censusTransformRow(const cv::Mat& _image, int _y, unsigned int* _census)
+{
+	// one bit per neighbour in the 5x5 window that is darker than the centre. rows are clamped at the
+	// top and bottom, the two columns on each side have no full window and are left empty
+	int width = _image.cols;
+	const uchar* centre = _image.ptr<uchar>(_y);
+	std::fill(_census, _census + width, 0u);
+	for (int dy = -2; dy <= 2; ++dy)
+	{
+		const uchar* row = _image.ptr<uchar>(std::min(std::max(_y + dy, 0), _image.rows - 1));
+		for (int dx = -2; dx <= 2; ++dx)
+		{
+			if (dx == 0 && dy == 0)
+			{
+				continue;
+			}
+			for (int x = 2; x < width - 2; ++x)
+			{
+				_census[x] = (_census[x] << 1) | (row[x + dx] < centre[x] ? 1u : 0u);
+			}
+		}
+	}
+}
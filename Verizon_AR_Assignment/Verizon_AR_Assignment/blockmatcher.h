@@ -0,0 +1,69 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <vector>
+#include "stereokernels.h"
+
+// In-tree block matcher.
+// Costs for 8 (SSE4.2) or 16 (AVX2) disparities are computed per instruction and aggregated with
+// running column and row sums, so the work per pixel does not depend on the block size.
+// Produces the same 16 bit fixed point left disparity as cv::StereoBM, without the prefilter and
+// texture threshold.
+// MODE_SAD matches grey values, the block size is limited to 15 so window costs fit in 16 bits.
+// MODE_CENSUS matches 5x5 census signatures packed in 32 bit words by hamming distance, which is
+// insensitive to exposure differences between the cameras. Block size is limited to 51.
+class BlockMatcher : public cv::StereoMatcher
+{
+public:
+	enum { MODE_SAD = 0, MODE_CENSUS = 1 };
+
+	static cv::Ptr<BlockMatcher> create(int _numDisparities = 64, int _blockSize = 9, int _mode = MODE_SAD);
+
+	BlockMatcher(int _numDisparities, int _blockSize, int _mode);
+	BlockMatcher(const BlockMatcher& _other) = default;
+	~BlockMatcher() = default;
+
+	void compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity);
+
+	inline int getMinDisparity() const						{ return m_MinDisparity; }
+	inline void setMinDisparity(int _value)					{ m_MinDisparity = _value; }
+	inline int getNumDisparities() const					{ return m_NumDisparities; }
+	inline void setNumDisparities(int _value)				{ m_NumDisparities = _value; }
+	inline int getBlockSize() const							{ return m_BlockSize; }
+	inline void setBlockSize(int _value)					{ m_BlockSize = _value; }
+	inline int getSpeckleWindowSize() const					{ return m_SpeckleWindowSize; }
+	inline void setSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
+	inline int getSpeckleRange() const						{ return m_SpeckleRange; }
+	inline void setSpeckleRange(int _value)					{ m_SpeckleRange = _value; }
+	inline int getDisp12MaxDiff() const						{ return m_Disp12MaxDiff; }
+	inline void setDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; }
+	inline int getUniquenessRatio() const					{ return m_UniquenessRatio; }
+	inline void setUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; }
+	inline int getMode() const								{ return m_Mode; }
+	inline void setMode(int _value)							{ m_Mode = _value; }
+
+private:
+	// with _boxSum the window sums of the row are written to m_Cost as well
+	void _updateColumnCost(const StereoKernels& _kernels, const cv::Mat& _left, const cv::Mat& _right, int _enter, int _leave, bool _boxSum);
+	void _censusTransformRow(const cv::Mat& _image, int _y, unsigned int* _census);
+
+private:
+	int m_MinDisparity;
+	int m_NumDisparities;
+	int m_BlockSize;
+	int m_SpeckleWindowSize;
+	int m_SpeckleRange;
+	int m_Disp12MaxDiff;	// not used, a single left pass has no right disparity to check against
+	int m_UniquenessRatio;
+	int m_Mode;
+
+	// kept between calls so a stream of same sized frames does not allocate
+	int m_ColumnBegin;	// first column whose cost is kept, the valid range less the window radius
+	std::vector<ushort> m_ColumnCost;
+	std::vector<ushort> m_Cost;
+	std::vector<uchar> m_PaddedRows;	// ring of the m_BlockSize + 1 right rows last entered, pre-shifted and padded
+	std::vector<unsigned int> m_LeftCensus;
+	std::vector<unsigned int> m_RightCensus;	// whole image, every row pre-shifted and padded like m_PaddedRows
+	std::vector<unsigned int> m_CensusRow;
+	cv::Mat m_SpeckleBuffer;
+};
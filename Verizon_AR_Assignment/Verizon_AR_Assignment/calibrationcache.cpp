@@ -0,0 +1,279 @@
+#include "calibrationcache.h"
+#include <fstream>
+#include <vector>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char CALIBRATION_CACHE_MAGIC[4] = { 'S', 'C', 'A', 'L' };
+static const size_t CALIBRATION_CACHE_ALIGNMENT = 16;
+
+struct CalibrationCacheHeader
+{
+	char m_Magic[4];
+	unsigned int m_Version;
+	unsigned long long m_Key;
+	unsigned int m_NumMatrices;
+	unsigned int m_Reserved;
+};
+
+struct CalibrationCacheMatrix
+{
+	int m_Rows;
+	int m_Cols;
+	int m_Type;
+	int m_Reserved;
+};
+
+// the element types Save writes, an empty matrix keeps cv::Mat's default type. anything else is a corrupt file
+static bool _isCachedType(int _type, int _rows, int _cols)
+{
+	return _type == CV_64FC1 || _type == CV_16SC2 || _type == CV_16UC1 || _type == CV_32FC1
+		|| (_type == CV_8UC1 && (_rows == 0 || _cols == 0));
+}
+
+static size_t _align(size_t _offset)
+{
+	return (_offset + CALIBRATION_CACHE_ALIGNMENT - 1) / CALIBRATION_CACHE_ALIGNMENT * CALIBRATION_CACHE_ALIGNMENT;
+}
+
+// the matrices in file order
+static std::vector<cv::Mat*> _matrices(StereoCalibration& _calibration)
+{
+	std::vector<cv::Mat*> matrices;
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		matrices.push_back(&_calibration.m_CameraMatrix[eye]);
+		matrices.push_back(&_calibration.m_DistortionCoef[eye]);
+	}
+	matrices.push_back(&_calibration.m_StereoRotation);
+	matrices.push_back(&_calibration.m_StereoTranslation);
+	matrices.push_back(&_calibration.m_Q);
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		matrices.push_back(&_calibration.m_RectifyMap[eye][0]);
+		matrices.push_back(&_calibration.m_RectifyMap[eye][1]);
+	}
+	return matrices;
+}
+
+CalibrationCache::CalibrationCache()
+{
+#ifdef _WIN32
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = NULL;
+#else
+	m_File = -1;
+#endif
+	m_View = NULL;
+	m_Size = 0;
+}
+
+CalibrationCache::~CalibrationCache()
+{
+	_unmap();
+}
+
+bool CalibrationCache::Load(const std::string& _filename, unsigned long long _key, StereoCalibration& _calibration)
+{
+	_unmap();
+
+#ifdef _WIN32
+	m_File = CreateFileA(_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+	{
+		_unmap();
+		return false;
+	}
+	m_Size = (size_t)size.QuadPart;
+	m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+	m_View = m_Mapping ? MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+	m_File = open(_filename.c_str(), O_RDONLY);
+	if (m_File < 0)
+	{
+		return false;
+	}
+	struct stat status;
+	if (fstat(m_File, &status) != 0 || status.st_size == 0)
+	{
+		_unmap();
+		return false;
+	}
+	m_Size = (size_t)status.st_size;
+	m_View = mmap(NULL, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (m_View == MAP_FAILED)
+	{
+		m_View = NULL;
+	}
+#endif
+	if (!m_View || m_Size < sizeof(CalibrationCacheHeader))
+	{
+		_unmap();
+		return false;
+	}
+
+	const unsigned char* data = (const unsigned char*)m_View;
+	const CalibrationCacheHeader* header = (const CalibrationCacheHeader*)data;
+	std::vector<cv::Mat*> matrices = _matrices(_calibration);
+	if (memcmp(header->m_Magic, CALIBRATION_CACHE_MAGIC, sizeof(header->m_Magic)) != 0 || header->m_Version != CALIBRATION_CACHE_VERSION
+		|| header->m_Key != _key || header->m_NumMatrices != matrices.size())
+	{
+		_unmap();
+		return false;
+	}
+
+	// nothing is handed out before the whole file checked out
+	std::vector<cv::Mat> views;
+	size_t offset = sizeof(CalibrationCacheHeader);
+	for (size_t i = 0; i < matrices.size(); ++i)
+	{
+		if (offset + sizeof(CalibrationCacheMatrix) > m_Size)
+		{
+			_unmap();
+			return false;
+		}
+		const CalibrationCacheMatrix* info = (const CalibrationCacheMatrix*)(data + offset);
+		offset = _align(offset + sizeof(CalibrationCacheMatrix));
+		if (info->m_Rows < 0 || info->m_Cols < 0 || !_isCachedType(info->m_Type, info->m_Rows, info->m_Cols))
+		{
+			_unmap();
+			return false;
+		}
+
+		// sized in 64 bit before anything points at the data, a corrupt count must not wrap around
+		unsigned long long bytes = (unsigned long long)info->m_Rows * (unsigned long long)info->m_Cols * CV_ELEM_SIZE(info->m_Type);
+		if (offset > m_Size || bytes > (unsigned long long)(m_Size - offset))
+		{
+			_unmap();
+			return false;
+		}
+		views.push_back(cv::Mat(info->m_Rows, info->m_Cols, info->m_Type, (void*)(data + offset)));
+		offset = _align(offset + (size_t)bytes);
+	}
+
+	for (size_t i = 0; i < matrices.size(); ++i)
+	{
+		*matrices[i] = views[i];
+	}
+	return true;
+}
+
+bool CalibrationCache::Save(const std::string& _filename, unsigned long long _key, const StereoCalibration& _calibration)
+{
+	StereoCalibration calibration = _calibration;
+	std::vector<cv::Mat*> matrices = _matrices(calibration);
+
+	std::ofstream fout(_filename.c_str(), std::ios::binary | std::ios::trunc);
+	if (fout.fail())
+	{
+		return false;
+	}
+
+	CalibrationCacheHeader header;
+	memcpy(header.m_Magic, CALIBRATION_CACHE_MAGIC, sizeof(header.m_Magic));
+	header.m_Version = CALIBRATION_CACHE_VERSION;
+	header.m_Key = _key;
+	header.m_NumMatrices = (unsigned int)matrices.size();
+	header.m_Reserved = 0;
+	fout.write((const char*)&header, sizeof(header));
+
+	const char padding[CALIBRATION_CACHE_ALIGNMENT] = {};
+	size_t offset = sizeof(header);
+	for (cv::Mat* matrix : matrices)
+	{
+		cv::Mat continuous = matrix->isContinuous() ? *matrix : matrix->clone();
+		CalibrationCacheMatrix info;
+		info.m_Rows = continuous.rows;
+		info.m_Cols = continuous.cols;
+		info.m_Type = continuous.type();
+		info.m_Reserved = 0;
+		fout.write((const char*)&info, sizeof(info));
+		fout.write(padding, _align(offset + sizeof(info)) - offset - sizeof(info));
+		offset = _align(offset + sizeof(info));
+
+		size_t bytes = continuous.total() * continuous.elemSize();
+		fout.write((const char*)continuous.data, bytes);
+		fout.write(padding, _align(offset + bytes) - offset - bytes);
+		offset = _align(offset + bytes);
+	}
+	return !fout.fail();
+}
+
+unsigned long long CalibrationCache::Hash(const void* _data, size_t _size, unsigned long long _hash)
+{
+	const unsigned char* data = (const unsigned char*)_data;
+	for (size_t i = 0; i < _size; ++i)
+	{
+		_hash ^= data[i];
+		_hash *= 1099511628211ULL;
+	}
+	return _hash;
+}
+
+bool CalibrationCache::HashFileStatus(const std::string& _filename, unsigned long long& _hash)
+{
+	long long status[2];
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(_filename.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(_filename.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#endif
+	status[0] = (long long)info.st_size;
+	status[1] = (long long)info.st_mtime;
+	_hash = Hash(status, sizeof(status), _hash);
+	return true;
+}
+
+void CalibrationCache::_unmap()
+{
+#ifdef _WIN32
+	if (m_View)
+	{
+		UnmapViewOfFile(m_View);
+	}
+	if (m_Mapping)
+	{
+		CloseHandle(m_Mapping);
+	}
+	if (m_File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_File);
+	}
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = NULL;
+#else
+	if (m_View)
+	{
+		munmap(m_View, m_Size);
+	}
+	if (m_File >= 0)
+	{
+		close(m_File);
+	}
+	m_File = -1;
+#endif
+	m_View = NULL;
+	m_Size = 0;
+}
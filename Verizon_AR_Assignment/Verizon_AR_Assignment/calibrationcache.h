@@ -0,0 +1,52 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <string>
+
+// everything rectification needs, the result of stereo calibration plus the remap tables built from it
+struct StereoCalibration
+{
+	cv::Mat m_CameraMatrix[2];
+	cv::Mat m_DistortionCoef[2];
+	cv::Mat m_StereoRotation;
+	cv::Mat m_StereoTranslation;
+	cv::Mat m_Q;
+	cv::Mat m_RectifyMap[2][2];	// per eye the CV_16SC2 and CV_16UC1 tables of cv::initUndistortRectifyMap
+};
+
+// Versioned binary file holding a StereoCalibration.
+// The file starts with a header (magic, version, key, number of matrices) followed by every matrix
+// as rows, columns and type and its data aligned to 16 bytes. Load maps the file into memory and
+// points the matrices straight at it, so they stay valid as long as the cache object lives and
+// must not be written to. The key is a hash of whatever the calibration was computed from, a file
+// with a different key or version is ignored and the caller recalibrates.
+class CalibrationCache
+{
+public:
+	CalibrationCache();
+	CalibrationCache(const CalibrationCache& _other) = delete;
+	~CalibrationCache();
+
+	bool Load(const std::string& _filename, unsigned long long _key, StereoCalibration& _calibration);
+	static bool Save(const std::string& _filename, unsigned long long _key, const StereoCalibration& _calibration);
+
+	// 64 bit FNV-1a, pass the previous result as _hash to chain several buffers
+	static unsigned long long Hash(const void* _data, size_t _size, unsigned long long _hash = CALIBRATION_HASH_SEED);
+	// chains the file's size and modification time, not its bytes
+	static bool HashFileStatus(const std::string& _filename, unsigned long long& _hash);
+
+	static const unsigned int CALIBRATION_CACHE_VERSION = 1;
+	static const unsigned long long CALIBRATION_HASH_SEED = 14695981039346656037ULL;
+
+private:
+	void _unmap();
+
+private:
+#ifdef _WIN32
+	void* m_File;		// HANDLE
+	void* m_Mapping;	// HANDLE
+#else
+	int m_File;
+#endif
+	void* m_View;
+	size_t m_Size;
+};
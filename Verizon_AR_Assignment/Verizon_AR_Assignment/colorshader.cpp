@@ -1,4 +1,6 @@
 #include <fstream>
+#include <algorithm>
+#include <float.h>
 #include "colorshader.h"
 
 bool ColorShader::Initialize(OpenGLRenderer* _renderer, HWND _hwnd)
@@ -306,4 +308,71 @@ bool ColorShader::SetShaderParameters(float* _worldMatrix, float* _viewMatrix, f
 	m_Renderer->glUniformMatrix4fv(location, 1, false, _projectionMatrix);
 
 	return true;
-}
\ No newline at end of file
+}
+
+bool ColorShader::SetPositionDecode(float* _offset, float* _scale)
+{
+	unsigned int location;
+
+	// Set the position offset in the vertex shader.
+	location = m_Renderer->glGetUniformLocation(m_shaderProgram, "positionOffset");
+	if (location == -1)
+	{
+		return false;
+	}
+	m_Renderer->glUniform3fv(location, 1, _offset);
+
+	// Set the position scale in the vertex shader.
+	location = m_Renderer->glGetUniformLocation(m_shaderProgram, "positionScale");
+	if (location == -1)
+	{
+		return false;
+	}
+	m_Renderer->glUniform3fv(location, 1, _scale);
+
+	return true;
+}
+
+void ColorShader::PackVertices(const VertexType* _vertices, int _numVertices, PackedVertexType* _packed, float* _boundsMin, float* _boundsMax)
+{
+	// bounding box of the positions
+	for (int i = 0; i < 3; ++i)
+	{
+		_boundsMin[i] = _numVertices > 0 ? FLT_MAX : 0.0f;
+		_boundsMax[i] = _numVertices > 0 ? -FLT_MAX : 0.0f;
+	}
+	for (int v = 0; v < _numVertices; ++v)
+	{
+		const float* position = &_vertices[v].x;
+		for (int i = 0; i < 3; ++i)
+		{
+			_boundsMin[i] = std::min(_boundsMin[i], position[i]);
+			_boundsMax[i] = std::max(_boundsMax[i], position[i]);
+		}
+	}
+	PackVertices(_vertices, _numVertices, _boundsMin, _boundsMax, _packed);
+}
+
+void ColorShader::PackVertices(const VertexType* _vertices, int _numVertices, const float* _boundsMin, const float* _boundsMax, PackedVertexType* _packed)
+{
+	// positions rounded to the nearest of 65536 steps over the box, colours to 8 bits
+	float scale[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		float extent = _boundsMax[i] - _boundsMin[i];
+		scale[i] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+	}
+	for (int v = 0; v < _numVertices; ++v)
+	{
+		const VertexType& vertex = _vertices[v];
+		PackedVertexType& packed = _packed[v];
+		packed.x = (unsigned short)((vertex.x - _boundsMin[0]) * scale[0] + 0.5f);
+		packed.y = (unsigned short)((vertex.y - _boundsMin[1]) * scale[1] + 0.5f);
+		packed.z = (unsigned short)((vertex.z - _boundsMin[2]) * scale[2] + 0.5f);
+		packed.padding = 0;
+		packed.r = (unsigned char)(vertex.r * 255.0f + 0.5f);
+		packed.g = (unsigned char)(vertex.g * 255.0f + 0.5f);
+		packed.b = (unsigned char)(vertex.b * 255.0f + 0.5f);
+		packed.a = 255;
+	}
+}
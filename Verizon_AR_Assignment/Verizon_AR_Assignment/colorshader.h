@@ -13,6 +13,13 @@ public:
 		float r, g, b;
 	};
 
+	// 12 instead of 24 bytes, positions normalized to 0-65535 over the bounding box of the cloud and 8 bit colours
+	struct PackedVertexType
+	{
+		unsigned short x, y, z, padding;
+		unsigned char r, g, b, a;
+	};
+
 public:
 	ColorShader() = default;
 	ColorShader(const ColorShader& _other) = default;
@@ -23,6 +30,13 @@ public:
 	void SetShader();
 
 	bool SetShaderParameters(float* _worldMatrix, float* _viewMatrix, float* _projectionMatrix);
+	// positions are decoded as _offset + position * _scale, 0 and 1 for VertexType, the bounding box for PackedVertexType
+	bool SetPositionDecode(float* _offset, float* _scale);
+
+	// packs vertices and returns the bounding box the positions are normalized to, or packs them into a box
+	// known to hold them
+	static void PackVertices(const VertexType* _vertices, int _numVertices, PackedVertexType* _packed, float* _boundsMin, float* _boundsMax);
+	static void PackVertices(const VertexType* _vertices, int _numVertices, const float* _boundsMin, const float* _boundsMax, PackedVertexType* _packed);
 
 private:
 	bool _initializeShader(char* _vsFilename, char* _psFilename, HWND _hwnd);
@@ -0,0 +1,48 @@
+#include "depthtable.h"
+#include "stereokernels.h"
+#include <string.h>
+
+DepthTable::DepthTable()
+{
+	memset(m_Q, 0, sizeof(m_Q));
+	m_MinDisparity = 0;
+	m_NumDisparities = 0;
+	m_Built = false;
+}
+
+bool DepthTable::Update(const double _q[4][4], int _minDisparity, int _numDisparities)
+{
+	if (m_Built && _minDisparity == m_MinDisparity && _numDisparities == m_NumDisparities && memcmp(_q, m_Q, sizeof(m_Q)) == 0)
+	{
+		return !m_InverseW.empty();
+	}
+	memcpy(m_Q, _q, sizeof(m_Q));
+	m_MinDisparity = _minDisparity;
+	m_NumDisparities = _numDisparities;
+	m_Built = true;
+
+	// X only depends on x, Y on y and Z, W on the disparity alone
+	bool rectified = _q[0][1] == 0.0 && _q[0][2] == 0.0 && _q[1][0] == 0.0 && _q[1][2] == 0.0
+		&& _q[2][0] == 0.0 && _q[2][1] == 0.0 && _q[2][2] == 0.0 && _q[3][0] == 0.0 && _q[3][1] == 0.0;
+	if (!rectified || _numDisparities <= 0)
+	{
+		m_InverseW.clear();
+		m_Depth.clear();
+		return false;
+	}
+
+	// W in float on the raw disparity the way ReprojectRowToVertices works it out, a looked up entry is
+	// the same number the kernels would divide to
+	float wScale = (float)(_q[3][2] / STEREO_DISP_SCALE);
+	float wOffset = (float)_q[3][3];
+	int size = (_numDisparities + 1) * STEREO_DISP_SCALE;
+	m_InverseW.resize(size);
+	m_Depth.resize(size);
+	for (int i = 0; i < size; ++i)
+	{
+		float iW = 1.0f / (wScale * (float)(_minDisparity * STEREO_DISP_SCALE + i) + wOffset);
+		m_InverseW[i] = iW;
+		m_Depth[i] = (float)(_q[2][3] * iW);
+	}
+	return true;
+}
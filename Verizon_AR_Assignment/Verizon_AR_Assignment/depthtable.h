@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+
+// 1 / W and depth of every fixed point disparity of a range, for a Q matrix in the form stereoRectify
+// produces where W and Z only depend on the disparity. Entry i belongs to the raw disparity
+// _minDisparity * STEREO_DISP_SCALE + i and the entries run one whole disparity past the range. The
+// entries are only rebuilt when Q or the range changed since the last Update. 1 / W is the float quotient
+// the reprojection kernels divide to, so looking it up or dividing gives the same vertex, and a W of 0 gives
+// an infinite scale like the division would.
+class DepthTable
+{
+public:
+	DepthTable();
+	DepthTable(const DepthTable& _other) = default;
+	~DepthTable() = default;
+
+	// false and no entries when Q is not in rectified form
+	bool Update(const double _q[4][4], int _minDisparity, int _numDisparities);
+
+	inline const float* GetInverseW() const		{ return m_InverseW.data(); }
+	inline const float* GetDepth() const		{ return m_Depth.data(); }
+	inline int GetSize() const					{ return (int)m_InverseW.size(); }
+
+private:
+	double m_Q[4][4];
+	int m_MinDisparity;
+	int m_NumDisparities;
+	bool m_Built;
+
+	std::vector<float> m_InverseW;
+	std::vector<float> m_Depth;
+};
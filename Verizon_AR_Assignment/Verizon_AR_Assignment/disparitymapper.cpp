@@ -1,6 +1,9 @@
 #include "disparitymapper.h"
 #include <fstream>
+#include <algorithm>
+#include <thread>
 #include <iostream>
+#include <limits>
 
 DisparityMapper::DisparityMapper(cv::Mat _left, cv::Mat _right, int _numDisparities, int _wsize, bool _rectify, DISPARITY_MAPPER_QUALITY _quality)
 	: m_LeftOriginal(_left), m_RightOriginal(_right), m_NumDisparities(_numDisparities), m_SADWindowSize(_wsize), m_RectifyImages(_rectify), m_Quality(_quality)
@@ -11,16 +14,26 @@ DisparityMapper::DisparityMapper(cv::Mat _left, cv::Mat _right, int _numDisparit
 	m_P2 = 0;
 	m_Disp12MaxDiff = 1000000;
 	m_SpeckleWindowSize = 0;
+	m_NumPaths = 8;
+	m_NumThreads = 0;
 	m_Mode = cv::StereoSGBM::MODE_HH;
 	m_LambdaValue = 8000.0;
 	m_SigmaColor = 1.5;
 	m_UseConfidence = false;
-	m_Downscale = false;
+	m_PyramidLevels = 0;
+	m_TemporalPrior = false;
+	m_Downscale = 1;
+	m_MatchMinDisparity = 0;
+	m_MatchNumDisparities = 0;
 	m_QMatSet = false;
+	m_ConfigurationChanged = true;
+	m_DisparityViewValid = false;
+	m_ConfidenceValid = false;
+	m_PointCloudValid = false;
+	m_ConfidenceThreshold = 0;
 	m_CalibrationImagesFilename = NULL;
+	m_CalibrationCacheFilename = NULL;
 
-	m_CalibrationBoardSize = cv::Size(4, 11);
-	m_CalibrationSquareSize = 12;
 	m_FocalLength = 0.0;
 	m_Baseline = 0.0;
 }
@@ -34,12 +47,22 @@ void DisparityMapper::Compute()
 
 	if (m_RectifyImages)
 	{
-		_calibrateCamera();
+		// calibration and remap tables only change with the frame size, they come from the cache when it matches
+		if (m_RectifiedSize != m_LeftOriginal.size())
+		{
+			_prepareRectification();
+		}
 		_rectifyImages();
 	}
 
-	// Use Semi-Global Block Matching Stereo Correspondence algorithm, slower than BM but better quality
-	if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_QUALITY)
+	// (re)build the matchers and filter only when the configuration or the frame size changed
+	if (m_ConfigurationChanged || m_ConfiguredSize != m_LeftOriginal.size())
+	{
+		_configureMatchers();
+	}
+
+	// Use Semi-Global Block Matching Stereo Correspondence algorithm (SGBM or the in-tree SGM), slower than BM but better quality
+	if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_QUALITY || m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SGM)
 	{
 		_computeQuality();
 	}
@@ -50,134 +73,485 @@ void DisparityMapper::Compute()
 		_computeFast();
 	}
 
-	// do not filter disparity map, take only left disparity
+	// do not filter disparity map, take only left disparity (BM, the in-tree block matcher, the support point matcher or PatchMatch)
 	else
 	{
 		_computeVeryFast();
 	}
 
-	_createPointCloud();
+	// the 8 bit view, the confidence and the point cloud are only computed when asked for
+	m_DisparityViewValid = false;
+	m_ConfidenceValid = false;
+	m_PointCloudValid = false;
 }
-void DisparityMapper::_computeQuality()
+void DisparityMapper::ComputeNext(cv::Mat _left, cv::Mat _right)
 {
-	cv::Mat left_grey, right_grey;
-	cv::Mat left_disp, right_disp, filtered_disp; // 16S
+	// streaming entry point, matchers, filter and every intermediate image are reused from
+	// the previous frame so a steady stream of same sized frames pays no setup cost.
+	// the matrices returned by the getters are overwritten by the next frame, clone them to keep them
+	m_LeftOriginal = _left;
+	m_RightOriginal = _right;
 
-	// get greyscale images
-	cv::cvtColor(m_LeftOriginal, left_grey, CV_BGR2GRAY);
-	cv::cvtColor(m_RightOriginal, right_grey, CV_BGR2GRAY);
+	Compute();
+}
+void DisparityMapper::_configureMatchers()
+{
+	// downscaled, the matchers search the range divided by the factor, widened to whole pixels and multiples of 16.
+	// only whole blocks are matched, the upsampler extends the last ones over the columns and rows past them
+	m_MatchSize = cv::Size(m_LeftOriginal.cols / m_Downscale, m_LeftOriginal.rows / m_Downscale);
+	m_MatchMinDisparity = cvFloor((double)m_MinDisparity / m_Downscale);
+	int matchMaxDisparity = cvCeil((double)(m_MinDisparity + m_NumDisparities) / m_Downscale);
+	m_MatchNumDisparities = ((matchMaxDisparity - m_MatchMinDisparity + 15) / 16) * 16;
+
+	// the finer pyramid levels search their band with plain grey SAD, only the in-tree SAD block matcher's cost.
+	// the other tiers would lose their own cost at full resolution and match without the pyramid
+	bool pyramid = m_PyramidLevels > 0 && m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_ULTRA_FAST;
+	if (pyramid)
+	{
+		// coarse-to-fine, the tier's own matcher covers the whole range on the coarsest level only
+		int coarseMin, coarseNum;
+		PyramidMatcher::CoarseRange(m_MatchMinDisparity, m_MatchNumDisparities, m_PyramidLevels, coarseMin, coarseNum);
+		cv::Ptr<PyramidMatcher> left_sbm = PyramidMatcher::create(_createLeftMatcher(coarseMin, coarseNum), m_MatchMinDisparity, m_MatchNumDisparities, m_SADWindowSize, m_PyramidLevels);
+		left_sbm->setUniquenessRatio(m_UniquenessRatio);
+		left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		m_LeftMatcher = left_sbm;
+	}
+	else
+	{
+		m_LeftMatcher = _createLeftMatcher(m_MatchMinDisparity, m_MatchNumDisparities);
+	}
 
-	// scale down the image
-	if (m_Downscale)
+	// back at full resolution the region covers the blocks of the pixels inside it
+	cv::Rect matchRegion = _computeRegionOfInterest(m_MatchSize, m_LeftMatcher);
+	m_LeftRegionOfInterest = cv::Rect(matchRegion.x * m_Downscale, matchRegion.y * m_Downscale, matchRegion.width * m_Downscale, matchRegion.height * m_Downscale)
+		& cv::Rect(cv::Point(), m_LeftOriginal.size());
+
+	// only the filtered tiers need a filter, the others take only the left disparity. of those only the ones
+	// with confidence need a right matcher, the filter takes nothing else from the right disparity
+	bool filtered = m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_FAST || m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_QUALITY
+		|| m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SGM;
+	bool matchRight = filtered && m_UseConfidence;
+	if (!filtered)
 	{
-		cv::resize(left_grey, left_grey, cv::Size(), 0.5, 0.5);
-		cv::resize(right_grey, right_grey, cv::Size(), 0.5, 0.5);
+		m_Smoother.release();
 	}
+	else
+	{
+		// in-tree edge-aware smoother, the Fast Global Smoother the Weighted Least Squares or WLS filter runs
+		m_Smoother = cv::makePtr<DisparitySmoother>(m_LambdaValue, m_SigmaColor, m_UseConfidence);
 
-	// compute left disparity map using stereo correspondence algorithm (Semi-Global Block Matching or SGBM algorithm)
-	cv::Ptr<cv::StereoSGBM> left_sbm = cv::StereoSGBM::create(m_MinDisparity, m_NumDisparities, m_SADWindowSize);
-	left_sbm->setUniquenessRatio(m_UniquenessRatio);
-	left_sbm->setDisp12MaxDiff(m_Disp12MaxDiff);
-	left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
-	left_sbm->setP1(m_P1);
-	left_sbm->setP2(m_P2);
-	left_sbm->setMode(m_Mode);
-	m_LeftRegionOfInterest = _computeRegionOfInterest(m_LeftOriginal.size(), left_sbm);
-	left_sbm->compute(left_grey, right_grey, left_disp);
+		// the default 1.5 pixels plus the pixel the half resolution right disparity can be off by
+		m_Smoother->SetLRCThreshold(24 + STEREO_DISP_SCALE);
+		// half a block, the block matches near a depth edge can take the disparity from its other side
+		m_Smoother->SetDepthDiscontinuityRadius(cvCeil(0.5 * m_SADWindowSize));
+	}
+	if (!matchRight)
+	{
+		m_RightMatcher.release();
+	}
+	else
+	{
+		m_RightMatcher = _createSubsampledRightMatcher();
+		m_RightRegionOfInterest = _computeRegionOfInterest(cv::Size((m_MatchSize.width + 1) / 2, (m_MatchSize.height + 1) / 2), m_RightMatcher);
+	}
 
-	// compute right disparity map
-	cv::Ptr<cv::StereoMatcher> right_sbm = cv::ximgproc::createRightMatcher(left_sbm);
-	m_RightRegionOfInterest = _computeRegionOfInterest(m_RightOriginal.size(), right_sbm);
-	right_sbm->compute(right_grey, left_grey, right_disp);
+	// video streams, search around the previous frame's disparity and fall back to the whole range
+	// where that loses confidence. the history starts over whenever the matchers are rebuilt. only the
+	// in-tree SAD block matcher's cost is the band search's, the other tiers would gain nothing from the
+	// wrap and keep their stripes instead. the right matchers are never SAD block matchers
+	m_LeftTemporal.release();
+	if (m_TemporalPrior)
+	{
+		m_LeftTemporal = TemporalMatcher::create(m_LeftMatcher, _stripeOverlap(m_LeftMatcher));
+		if (m_LeftTemporal->hasBandSearch())
+		{
+			m_LeftTemporal->setUniquenessRatio(m_UniquenessRatio);
+			m_LeftMatcher = m_LeftTemporal;
+		}
+		else
+		{
+			m_LeftTemporal.release();
+		}
+	}
 
-	// create disparity map filter based one Weighted Least Squares or WLS filter (in form of Fast Global Smoother)
-	cv::Ptr<cv::ximgproc::DisparityWLSFilter> filter = cv::ximgproc::createDisparityWLSFilterGeneric(m_UseConfidence);
-	filter->setDepthDiscontinuityRadius((int)ceil(0.5*m_SADWindowSize));
-	filter->setLambda(m_LambdaValue);
-	filter->setSigmaColor(m_SigmaColor);
+	// block matchers only look at a window around each pixel, so overlapping row stripes can be matched
+	// on their own. semi-global paths, the support point triangulation and PatchMatch's propagation cross the
+	// whole image and use the matchers' own parallelism
+	int numThreads = _numThreads();
+	bool striped = numThreads > 1 && !pyramid && !m_LeftTemporal && m_Quality != DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_QUALITY
+		&& m_Quality != DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SGM && m_Quality != DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SUPPORT
+		&& m_Quality != DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_PATCHMATCH;
+	m_LeftStripeMatchers.clear();
+	m_RightStripeMatchers.clear();
+	if (striped)
+	{
+		if (!m_ThreadPool || m_ThreadPool->GetNumThreads() != numThreads)
+		{
+			m_ThreadPool = cv::makePtr<ThreadPool>(numThreads);
+		}
 
-	// compute filtered disparity map
-	filter->filter(left_disp, left_grey, filtered_disp, right_disp);
+		// one matcher per worker, speckles are removed after stitching since they are not local
+		for (int i = 0; i < numThreads; ++i)
+		{
+			cv::Ptr<cv::StereoMatcher> left_sbm = _createLeftMatcher(m_MatchMinDisparity, m_MatchNumDisparities);
+			left_sbm->setSpeckleWindowSize(0);
+			m_LeftStripeMatchers.push_back(left_sbm);
+			if (matchRight)
+			{
+				cv::Ptr<cv::StereoMatcher> right_sbm = _createSubsampledRightMatcher();
+				right_sbm->setSpeckleWindowSize(0);
+				m_RightStripeMatchers.push_back(right_sbm);
+			}
+		}
+	}
+	else
+	{
+		m_ThreadPool.release();
+	}
 
-	// convert filtered disparity map from 16 bit short to 8 bit unsigned char and normalize values
-	double minVal, maxVal;
-	cv::minMaxLoc(filtered_disp, &minVal, &maxVal);
-	filtered_disp.convertTo(m_Disparity, CV_8UC1, 255 / (maxVal - minVal));
+	m_ConfiguredSize = m_LeftOriginal.size();
+	m_ConfigurationChanged = false;
 }
-void DisparityMapper::_computeFast()
+cv::Ptr<cv::StereoMatcher> DisparityMapper::_createLeftMatcher(int _minDisparity, int _numDisparities)
 {
-	cv::Mat left_grey, right_grey;
-	cv::Mat left_disp, right_disp, filtered_disp; // 16S
-
-	// get greyscale images
-	cv::cvtColor(m_LeftOriginal, left_grey, CV_BGR2GRAY);
-	cv::cvtColor(m_RightOriginal, right_grey, CV_BGR2GRAY);
+	if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_QUALITY)
+	{
+		// Semi-Global Block Matching or SGBM algorithm
+		cv::Ptr<cv::StereoSGBM> left_sbm = cv::StereoSGBM::create(_minDisparity, _numDisparities, m_SADWindowSize);
+		left_sbm->setUniquenessRatio(m_UniquenessRatio);
+		left_sbm->setDisp12MaxDiff(m_Disp12MaxDiff);
+		left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		left_sbm->setP1(m_P1);
+		left_sbm->setP2(m_P2);
+		left_sbm->setMode(m_Mode);
+		return left_sbm;
+	}
+	else if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SGM)
+	{
+		// in-tree multi-threaded Semi-Global Matching with 4, 8 or 16 aggregation paths. like cv::StereoSGBM,
+		// MODE_HH keeps the full cost volume, the other modes stream through rolling rows in O(W x D) memory
+		cv::Ptr<SGMMatcher> left_sbm = SGMMatcher::create(_minDisparity, _numDisparities, m_SADWindowSize, m_P1, m_P2, m_NumPaths, _sgmMode());
+		left_sbm->setUniquenessRatio(m_UniquenessRatio);
+		left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		return left_sbm;
+	}
+	else if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SUPPORT)
+	{
+		// in-tree ELAS style matcher, whole range on a sparse grid of support points and a narrow band
+		// around the plane of their triangulation everywhere else
+		cv::Ptr<SupportMatcher> left_sbm = SupportMatcher::create(_minDisparity, _numDisparities, m_SADWindowSize);
+		left_sbm->setUniquenessRatio(m_UniquenessRatio);
+		left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		return left_sbm;
+	}
+	else if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_PATCHMATCH)
+	{
+		// in-tree PatchMatch with slanted windows, its cost per iteration does not grow with the range
+		cv::Ptr<PatchMatchMatcher> left_pm = PatchMatchMatcher::create(_minDisparity, _numDisparities, m_SADWindowSize);
+		left_pm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		return left_pm;
+	}
+	else if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_ULTRA_FAST || m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_CENSUS)
+	{
+		// in-tree SIMD block matcher, Sum of Absolute Differences or census transform + hamming distance
+		int mode = m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_CENSUS ? BlockMatcher::MODE_CENSUS : BlockMatcher::MODE_SAD;
+		cv::Ptr<BlockMatcher> left_sbm = BlockMatcher::create(_numDisparities, m_SADWindowSize, mode);
+		left_sbm->setMinDisparity(_minDisparity);
+		left_sbm->setUniquenessRatio(m_UniquenessRatio);
+		left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		return left_sbm;
+	}
+	else
+	{
+		// Block Matching or BM algorithm
+		cv::Ptr<cv::StereoBM> left_sbm = cv::StereoBM::create(_numDisparities, m_SADWindowSize);
+		left_sbm->setMinDisparity(_minDisparity);
+		left_sbm->setUniquenessRatio(m_UniquenessRatio);
+		left_sbm->setDisp12MaxDiff(m_Disp12MaxDiff);
+		left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
+		return left_sbm;
+	}
+}
+cv::Ptr<cv::StereoMatcher> DisparityMapper::_createRightMatcher(cv::Ptr<cv::StereoMatcher> _leftMatcher)
+{
+	int min_disparity = _leftMatcher->getMinDisparity();
+	int num_disparities = _leftMatcher->getNumDisparities();
 
-	// scale down the image
-	if (m_Downscale)
+	if (m_Quality == DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_SGM)
 	{
-		cv::resize(left_grey, left_grey, cv::Size(), 0.5, 0.5);
-		cv::resize(right_grey, right_grey, cv::Size(), 0.5, 0.5);
+		// createRightMatcher only knows BM and SGBM, mirror the disparity range the same way it does
+		return SGMMatcher::create(-(min_disparity + num_disparities) + 1, num_disparities, m_SADWindowSize, m_P1, m_P2, m_NumPaths, _sgmMode());
 	}
+	return cv::ximgproc::createRightMatcher(_leftMatcher);
+}
+cv::Ptr<cv::StereoMatcher> DisparityMapper::_createSubsampledRightMatcher()
+{
+	// the right disparity only feeds the smoother's left-right consistency check. matched at half the matching
+	// resolution over half the range it costs an eighth of a full pass, the mirror of a plain left matcher is enough there
+	int minDisparity = cvFloor(m_MatchMinDisparity * 0.5);
+	int numDisparities = ((m_MatchNumDisparities / 2 + 15) / 16) * 16;
+	return _createRightMatcher(_createLeftMatcher(minDisparity, numDisparities));
+}
+int DisparityMapper::_sgmMode()
+{
+	return m_Mode == cv::StereoSGBM::MODE_HH ? SGMMatcher::MODE_FULL : SGMMatcher::MODE_ROLLING;
+}
+void DisparityMapper::_computeQuality()
+{
+	// get greyscale images at the matching resolution
+	_prepareGrey();
 
-	// compute left disparity map using stereo correspondence algorithm (Block Matching or BM algorithm)
-	cv::Ptr<cv::StereoBM> left_sbm = cv::StereoBM::create(m_NumDisparities, m_SADWindowSize);
-	left_sbm->setMinDisparity(m_MinDisparity);
-	left_sbm->setUniquenessRatio(m_UniquenessRatio);
-	left_sbm->setDisp12MaxDiff(m_Disp12MaxDiff);
-	left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
-	m_LeftRegionOfInterest = _computeRegionOfInterest(m_LeftOriginal.size(), left_sbm);
-	left_sbm->compute(left_grey, right_grey, left_disp);
+	// compute left disparity map using stereo correspondence algorithm (Semi-Global Block Matching, SGBM or in-tree SGM)
+	m_LeftMatcher->compute(m_LeftGrey, m_RightGrey, m_LeftDisparity);
 
 	// compute right disparity map
-	cv::Ptr<cv::StereoMatcher> right_sbm = cv::ximgproc::createRightMatcher(left_sbm);
-	m_RightRegionOfInterest = _computeRegionOfInterest(m_RightOriginal.size(), right_sbm);
-	right_sbm->compute(right_grey, left_grey, right_disp);
+	_computeRightDisparity();
 
-	// create disparity map filter based one Weighted Least Squares or WLS filter (in form of Fast Global Smoother)
-	cv::Ptr<cv::ximgproc::DisparityWLSFilter> filter = cv::ximgproc::createDisparityWLSFilterGeneric(m_UseConfidence);
-	filter->setDepthDiscontinuityRadius((int)ceil(0.5*m_SADWindowSize));
-	filter->setLambda(m_LambdaValue);
-	filter->setSigmaColor(m_SigmaColor);
+	// compute filtered disparity map
+	_filterDisparity();
+	m_RawDisparity = m_FilteredDisparity;
+	_upsampleDisparity();
+}
+void DisparityMapper::_computeFast()
+{
+	// get greyscale images at the matching resolution
+	_prepareGrey();
+
+	// compute left disparity map using stereo correspondence algorithm (Block Matching or BM algorithm)
+	_computeStriped(m_LeftMatcher, m_LeftStripeMatchers, m_LeftGrey, m_RightGrey, m_LeftDisparity);
+
+	// compute right disparity map
+	_computeRightDisparity();
 
 	// compute filtered disparity map
-	filter->filter(left_disp, left_grey, filtered_disp, right_disp);
+	_filterDisparity();
+	m_RawDisparity = m_FilteredDisparity;
+	_upsampleDisparity();
+}
+void DisparityMapper::_computeRightDisparity()
+{
+	if (!m_RightMatcher)
+	{
+		// the smoother runs without confidence and never looks at it
+		m_RightDisparity.release();
+		return;
+	}
+
+	cv::pyrDown(m_LeftGrey, m_LeftGreySmall);
+	cv::pyrDown(m_RightGrey, m_RightGreySmall);
+	_computeStriped(m_RightMatcher, m_RightStripeMatchers, m_RightGreySmall, m_LeftGreySmall, m_RightSmallDisparity);
 
-	// convert filtered disparity map from 16 bit short to 8 bit unsigned char and normalize values
-	double minVal, maxVal;
-	cv::minMaxLoc(filtered_disp, &minVal, &maxVal);
-	filtered_disp.convertTo(m_Disparity, CV_8UC1, 255 / (maxVal - minVal));
+	// back to the left's size and disparity scale, invalid pixels stay below the mirrored full range
+	cv::resize(m_RightSmallDisparity, m_RightDisparity, m_LeftGrey.size(), 0.0, 0.0, cv::INTER_NEAREST);
+	m_RightDisparity.convertTo(m_RightDisparity, CV_16S, 2.0);
+}
+void DisparityMapper::_filterDisparity()
+{
+	// the right disparity was matched at half the resolution, its range at full resolution is twice the matcher's
+	int rightMinDisparity = m_RightMatcher ? 2 * m_RightMatcher->getMinDisparity() : 0;
+	m_Smoother->Filter(m_LeftDisparity, m_LeftGrey, m_RightDisparity, m_MatchMinDisparity, rightMinDisparity, m_FilteredDisparity, m_SmoothedConfidence);
 }
 void DisparityMapper::_computeVeryFast()
 {
-	cv::Mat left_grey, right_grey;
-	cv::Mat left_disp; // 16 bit short
-
-	// get greyscale images
-	cv::cvtColor(m_LeftOriginal, left_grey, CV_BGR2GRAY);
-	cv::cvtColor(m_RightOriginal, right_grey, CV_BGR2GRAY);
+	// get greyscale images at the matching resolution
+	_prepareGrey();
 
 	// compute left disparity map using stereo correspondence algorithm (Block Matching or BM algorithm)
-	cv::Ptr<cv::StereoBM> left_sbm = cv::StereoBM::create(m_NumDisparities, m_SADWindowSize);
-	left_sbm->setUniquenessRatio(m_UniquenessRatio);
-	left_sbm->setDisp12MaxDiff(m_Disp12MaxDiff);
-	left_sbm->setSpeckleWindowSize(m_SpeckleWindowSize);
-	m_LeftRegionOfInterest = _computeRegionOfInterest(m_LeftOriginal.size(), left_sbm);
-	left_sbm->compute(left_grey, right_grey, left_disp);
+	_computeStriped(m_LeftMatcher, m_LeftStripeMatchers, m_LeftGrey, m_RightGrey, m_LeftDisparity);
 
-	// convert disparity map from 16 bit short to 8 bit unsigned char and normalize values
-	double minVal, maxVal;
-	cv::minMaxLoc(left_disp, &minVal, &maxVal);
-	left_disp.convertTo(m_Disparity, CV_8UC1, 255 / (maxVal - minVal));
+	m_RawDisparity = m_LeftDisparity;
+	_upsampleDisparity();
 }
+void DisparityMapper::_prepareGrey()
+{
+	// the rectified pair when rectifying, the disparity, Q and point cloud all refer to those frames
+	cv::Mat left = GetLeftImage();
+	cv::Mat right = GetRightImage();
+	if (m_Downscale == 1)
+	{
+		cv::cvtColor(left, m_LeftGrey, CV_BGR2GRAY);
+		cv::cvtColor(right, m_RightGrey, CV_BGR2GRAY);
+		return;
+	}
 
-void DisparityMapper::_createPointCloud()
+	// area averages over whole blocks, so every low resolution pixel sits exactly on its block
+	cv::cvtColor(left, m_LeftGreyFull, CV_BGR2GRAY);
+	cv::cvtColor(right, m_RightGreyFull, CV_BGR2GRAY);
+	cv::Rect blocks(0, 0, m_MatchSize.width * m_Downscale, m_MatchSize.height * m_Downscale);
+	cv::resize(m_LeftGreyFull(blocks), m_LeftGrey, m_MatchSize, 0.0, 0.0, cv::INTER_AREA);
+	cv::resize(m_RightGreyFull(blocks), m_RightGrey, m_MatchSize, 0.0, 0.0, cv::INTER_AREA);
+}
+void DisparityMapper::_upsampleDisparity()
+{
+	if (m_Downscale == 1)
+	{
+		return;
+	}
+
+	// edge-aware upsampling steered by the full resolution left image, the disparities scale with the factor
+	m_Upsampler.Upsample(m_RawDisparity, m_LeftGrey, m_LeftGreyFull, m_Downscale, m_MatchMinDisparity, m_UpsampledDisparity);
+	m_RawDisparity = m_UpsampledDisparity;
+}
+void DisparityMapper::_computeStriped(cv::Ptr<cv::StereoMatcher> _matcher, std::vector<cv::Ptr<cv::StereoMatcher>>& _stripeMatchers, const cv::Mat& _left, const cv::Mat& _right, cv::Mat& _disparity)
+{
+	if (_stripeMatchers.empty())
+	{
+		_matcher->compute(_left, _right, _disparity);
+		return;
+	}
+
+	int height = _left.rows;
+	int overlap = _stripeOverlap(_matcher);
+	cv::Ptr<cv::StereoBM> bm = _matcher.dynamicCast<cv::StereoBM>();
+
+	// a few stripes per worker so the pool can even out stripes that take longer
+	int minRows = std::max(32, _matcher->getBlockSize());
+	int numStripes = std::max(std::min((int)_stripeMatchers.size() * 4, height / minRows), 1);
+	if ((int)m_StripeDisparities.size() < numStripes)
+	{
+		m_StripeDisparities.resize(numStripes);
+	}
+
+	_disparity.create(_left.size(), CV_16S);
+	m_ThreadPool->Run(numStripes, [&](int _stripe, int _worker)
+	{
+		int yBegin = _stripe * height / numStripes;
+		int yEnd = (_stripe + 1) * height / numStripes;
+		int yFirst = std::max(yBegin - overlap, 0);
+		int yLast = std::min(yEnd + overlap, height);
+
+		cv::Mat& stripe = m_StripeDisparities[_stripe];
+		_stripeMatchers[_worker]->compute(_left.rowRange(yFirst, yLast), _right.rowRange(yFirst, yLast), stripe);
+		stripe.rowRange(yBegin - yFirst, yEnd - yFirst).copyTo(_disparity.rowRange(yBegin, yEnd));
+	});
+
+	// the speckle removal the matcher runs on the whole image, cv::StereoBM takes the range unscaled
+	int speckleWindowSize = _matcher->getSpeckleWindowSize();
+	int speckleRange = _matcher->getSpeckleRange();
+	if (speckleWindowSize > 0 && speckleRange >= 0)
+	{
+		double invalid = (_matcher->getMinDisparity() - 1) * cv::StereoMatcher::DISP_SCALE;
+		cv::filterSpeckles(_disparity, invalid, speckleWindowSize, bm ? speckleRange : speckleRange * cv::StereoMatcher::DISP_SCALE, m_SpeckleBuffer);
+	}
+}
+int DisparityMapper::_stripeOverlap(cv::Ptr<cv::StereoMatcher> _matcher)
+{
+	// rows a stripe needs above and below its own rows so they come out exactly as on the whole image,
+	// the block radius plus the rows the StereoBM prefilter or the 5x5 census transform read around it
+	int overlap = _matcher->getBlockSize() / 2;
+	cv::Ptr<cv::StereoBM> bm = _matcher.dynamicCast<cv::StereoBM>();
+	cv::Ptr<BlockMatcher> block = _matcher.dynamicCast<BlockMatcher>();
+	if (bm)
+	{
+		overlap += bm->getPreFilterType() == cv::StereoBM::PREFILTER_XSOBEL ? 1 : bm->getPreFilterSize() / 2;
+	}
+	if (block && block->getMode() == BlockMatcher::MODE_CENSUS)
+	{
+		overlap += 2;
+	}
+	return overlap;
+}
+
+void DisparityMapper::_updateDisparityView()
+{
+	if (m_DisparityViewValid)
+	{
+		return;
+	}
+
+	// the disparity range maps onto 0-255 the same way every frame, invalid pixels come out black
+	double scale = 255.0 / (m_NumDisparities * STEREO_DISP_SCALE);
+	m_RawDisparity.convertTo(m_Disparity, CV_8UC1, scale, -m_MinDisparity * STEREO_DISP_SCALE * scale);
+	m_DisparityViewValid = true;
+}
+void DisparityMapper::_updateConfidence()
 {
-	cv::Mat flippedDisp;
-	cv::flip(m_Disparity(m_LeftRegionOfInterest), flippedDisp, 0);
-	reprojectImageTo3D(flippedDisp, m_PointCloud, m_Q, false, CV_32F);
+	if (m_ConfidenceValid)
+	{
+		return;
+	}
+
+	if (!m_Smoother)
+	{
+		// the unfiltered tiers have nothing finer than the matcher's own uniqueness and consistency checks
+		cv::compare(m_RawDisparity, m_MinDisparity * STEREO_DISP_SCALE, m_Confidence, cv::CMP_GE);
+	}
+	else if (m_Downscale == 1)
+	{
+		m_Confidence = m_SmoothedConfidence;
+	}
+	else
+	{
+		// brought up over the whole blocks, the columns and rows past them repeat the last ones like the disparity
+		cv::Size blocks(m_MatchSize.width * m_Downscale, m_MatchSize.height * m_Downscale);
+		cv::resize(m_SmoothedConfidence, m_ConfidenceBlocks, blocks, 0.0, 0.0, cv::INTER_LINEAR);
+		cv::copyMakeBorder(m_ConfidenceBlocks, m_Confidence, 0, m_RawDisparity.rows - blocks.height, 0, m_RawDisparity.cols - blocks.width, cv::BORDER_REPLICATE);
+	}
+	m_ConfidenceValid = true;
 }
+void DisparityMapper::_createPointCloud()
+{
+	if (m_PointCloudValid)
+	{
+		return;
+	}
 
+	// reprojects the fixed point disparity of the cropped region, bottom row first so the cloud comes out
+	// upside down like the images. the same as reprojectImageTo3D on the flipped crop with the fractional
+	// bits kept, pixels without a valid disparity or below the confidence threshold get an infinite position
+	cv::Mat disparity = m_RawDisparity(m_LeftRegionOfInterest);
+	cv::Mat confidence = m_ConfidenceThreshold > 0 ? GetCroppedConfidence() : cv::Mat();
+	int width = disparity.cols;
+	int height = disparity.rows;
+	m_PointCloud.create(height, width, CV_32FC3);
+
+	double q[4][4];
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			q[i][j] = m_Q.at<double>(i, j);
+		}
+	}
+	short minValid = (short)(m_MinDisparity * STEREO_DISP_SCALE);
+	float infinite = std::numeric_limits<float>::infinity();
+	int tableSize = m_DepthTable.Update(q, m_MinDisparity, m_NumDisparities) ? m_DepthTable.GetSize() : 0;
+	const float* inverseWTable = m_DepthTable.GetInverseW();
+	const float* depthTable = m_DepthTable.GetDepth();
+
+	for (int y = 0; y < height; ++y)
+	{
+		const short* row = disparity.ptr<short>(height - y - 1);
+		const uchar* rowConfidence = confidence.empty() ? NULL : confidence.ptr<uchar>(height - y - 1);
+		cv::Vec3f* points = m_PointCloud.ptr<cv::Vec3f>(y);
+		float rowY = (float)(q[1][1] * y + q[1][3]);
+		for (int x = 0; x < width; ++x)
+		{
+			if (row[x] < minValid || (rowConfidence && rowConfidence[x] < m_ConfidenceThreshold))
+			{
+				points[x] = cv::Vec3f(infinite, infinite, infinite);
+				continue;
+			}
+
+			// rectified Q, depth and 1 / W come from the table and X, Y are scaled pixel coordinates
+			int entry = row[x] - minValid;
+			if (entry < tableSize)
+			{
+				float iW = inverseWTable[entry];
+				points[x] = cv::Vec3f((float)(q[0][0] * x + q[0][3]) * iW, rowY * iW, depthTable[entry]);
+				continue;
+			}
+
+			double d = row[x] * (1.0 / STEREO_DISP_SCALE);
+			double X = q[0][0] * x + q[0][1] * y + q[0][2] * d + q[0][3];
+			double Y = q[1][0] * x + q[1][1] * y + q[1][2] * d + q[1][3];
+			double Z = q[2][0] * x + q[2][1] * y + q[2][2] * d + q[2][3];
+			double iW = 1.0 / (q[3][0] * x + q[3][1] * y + q[3][2] * d + q[3][3]);
+			points[x] = cv::Vec3f((float)(X * iW), (float)(Y * iW), (float)(Z * iW));
+		}
+	}
+	m_PointCloudValid = true;
+}
 cv::Rect DisparityMapper::_computeRegionOfInterest(cv::Size2i _size, cv::Ptr<cv::StereoMatcher> _matcher)
 {
 	int min_disparity = _matcher->getMinDisparity();
@@ -197,9 +571,9 @@ cv::Rect DisparityMapper::_computeRegionOfInterest(cv::Size2i _size, cv::Ptr<cv:
 }
 
 
-bool DisparityMapper::_getCalibrationImages()
+bool DisparityMapper::_getCalibrationImageFilenames(std::vector<std::string>& _filenames)
 {
-	m_CalibrationImages.clear();
+	_filenames.clear();
 	cv::FileStorage fs(m_CalibrationImagesFilename, cv::FileStorage::READ);
 	if (!fs.isOpened())
 		return false;
@@ -208,137 +582,214 @@ bool DisparityMapper::_getCalibrationImages()
 		return false;
 	for (auto it : n)
 	{
-		cv::Mat image = cv::imread(it, cv::IMREAD_COLOR);
-		m_CalibrationImages.push_back(image);
+		_filenames.push_back((std::string)it);
 	}
 	return true;
 }
-void DisparityMapper::_rectifyImages()
+bool DisparityMapper::_getCalibrationKey(cv::Size _imageSize, unsigned long long& _key)
+{
+	// the image list, every image's name, size and modification time, the board and the frame size the remap
+	// tables are built for. reading every image through on each start would cost about what loading it does
+	std::vector<std::string> filenames;
+	if (!_getCalibrationImageFilenames(filenames))
+		return false;
+	_key = CalibrationCache::CALIBRATION_HASH_SEED;
+	if (!CalibrationCache::HashFileStatus(m_CalibrationImagesFilename, _key))
+		return false;
+	for (auto& filename : filenames)
+	{
+		_key = CalibrationCache::Hash(filename.c_str(), filename.size() + 1, _key);
+		if (!CalibrationCache::HashFileStatus(filename, _key))
+			return false;
+	}
+	int parameters[5] = { m_Calibrator.GetBoardSize().width, m_Calibrator.GetBoardSize().height, m_Calibrator.GetSquareSize(), _imageSize.width, _imageSize.height };
+	_key = CalibrationCache::Hash(parameters, sizeof(parameters), _key);
+	return true;
+}
+void DisparityMapper::_prepareRectification()
 {
-	// get rectification (rotation), projection, and disparity to depth (Q) matrices
-	cv::Mat R1, R2, P1, P2;
-	cv::Rect validRoi[2];
 	cv::Size imageSize = m_LeftOriginal.size();
+	if (m_Calibrator.IsCalibrated() || m_Calibrator.GetNumPairs() > 0)
+	{
+		// a frame size change or pairs from AddCalibrationPair, the cameras stay the same and only the remap
+		// tables are rebuilt. the cache is keyed on the image list alone and left as it is
+		if (!m_Calibrator.IsCalibrated())
+		{
+			m_Calibrator.Refine();
+		}
+		_takeCalibration();
+		_computeRectification(imageSize);
+	}
+	else
+	{
+		if (m_CalibrationImagesFilename == NULL)
+		{
+			throw "Please set calibration images filename";
+		}
 
-	cv::stereoRectify(m_CameraMatrix[0], m_DistortionCoef[0],
-		m_CameraMatrix[1], m_DistortionCoef[1],
-		imageSize, m_StereoRotation, m_StereoTranslation, R1, R2, P1, P2, m_Q,
-		0, 1, imageSize, &validRoi[0], &validRoi[1]);
+		std::string cacheFilename = m_CalibrationCacheFilename != NULL ? m_CalibrationCacheFilename : std::string(m_CalibrationImagesFilename) + ".cache";
+		unsigned long long key = 0;
+		bool keyed = _getCalibrationKey(imageSize, key);
+
+		StereoCalibration calibration;
+		cv::Ptr<CalibrationCache> cache = cv::makePtr<CalibrationCache>();
+		if (keyed && cache->Load(cacheFilename, key, calibration))
+		{
+			// the matrices point into the mapped file, which lives as long as m_CalibrationCache.
+			// the calibrator starts from copies once pairs are added
+			m_CalibrationCache = cache;
+			for (int eye = 0; eye < 2; ++eye)
+			{
+				m_CameraMatrix[eye] = calibration.m_CameraMatrix[eye];
+				m_DistortionCoef[eye] = calibration.m_DistortionCoef[eye];
+			}
+			m_Rectifier.SetMaps(calibration.m_RectifyMap);
+			m_StereoRotation = calibration.m_StereoRotation;
+			m_StereoTranslation = calibration.m_StereoTranslation;
+			m_Q = calibration.m_Q;
+			m_Calibrator.SetSolution(m_CameraMatrix, m_DistortionCoef, m_StereoRotation, m_StereoTranslation);
+		}
+		else
+		{
+			_calibrateCamera();
+			_computeRectification(imageSize);
+
+			for (int eye = 0; eye < 2; ++eye)
+			{
+				calibration.m_CameraMatrix[eye] = m_CameraMatrix[eye];
+				calibration.m_DistortionCoef[eye] = m_DistortionCoef[eye];
+				calibration.m_RectifyMap[eye][0] = m_Rectifier.GetMap(eye, 0);
+				calibration.m_RectifyMap[eye][1] = m_Rectifier.GetMap(eye, 1);
+			}
+			calibration.m_StereoRotation = m_StereoRotation;
+			calibration.m_StereoTranslation = m_StereoTranslation;
+			calibration.m_Q = m_Q;
+			if (keyed)
+			{
+				// a cache that cannot be written only costs the next start another calibration
+				CalibrationCache::Save(cacheFilename, key, calibration);
+			}
+		}
+	}
 
 	m_FocalLength = m_Q.at<double>(2, 3);
 	m_Baseline = 1.0 / m_Q.at<double>(3, 2);
-
 	m_QMatSet = true;
+	m_RectifiedSize = imageSize;
+}
+void DisparityMapper::_computeRectification(cv::Size _imageSize)
+{
+	// get rectification (rotation), projection, and disparity to depth (Q) matrices
+	cv::Mat R1, R2, P1, P2;
+	cv::Rect validRoi[2];
+
+	// a Q loaded from the cache points into the read-only mapped file, stereoRectify must not write into it
+	m_Q.release();
+
+	cv::stereoRectify(m_CameraMatrix[0], m_DistortionCoef[0],
+		m_CameraMatrix[1], m_DistortionCoef[1],
+		_imageSize, m_StereoRotation, m_StereoTranslation, R1, R2, P1, P2, m_Q,
+		0, 1, _imageSize, &validRoi[0], &validRoi[1]);
 
 	// calibration wasn't perfected by the time this needed to be done, resulting rotation
 	// matrices rotated too much so using identity matrices instead
 	cv::Mat rmap[2][2];
-	cv::initUndistortRectifyMap(m_CameraMatrix[0], m_DistortionCoef[0], cv::Mat(), P1, imageSize, CV_16SC2, rmap[0][0], rmap[0][1]);
-	cv::initUndistortRectifyMap(m_CameraMatrix[1], m_DistortionCoef[1], cv::Mat(), P2, imageSize, CV_16SC2, rmap[1][0], rmap[1][1]);
+	cv::initUndistortRectifyMap(m_CameraMatrix[0], m_DistortionCoef[0], cv::Mat(), P1, _imageSize, CV_16SC2, rmap[0][0], rmap[0][1]);
+	cv::initUndistortRectifyMap(m_CameraMatrix[1], m_DistortionCoef[1], cv::Mat(), P2, _imageSize, CV_16SC2, rmap[1][0], rmap[1][1]);
+	m_Rectifier.SetMaps(rmap);
 
-	cv::remap(m_LeftOriginal, m_LeftRectified, rmap[0][0], rmap[0][1], CV_INTER_LINEAR, cv::BORDER_CONSTANT);
-	cv::remap(m_RightOriginal, m_RightRectified, rmap[1][0], rmap[1][1], CV_INTER_LINEAR, cv::BORDER_CONSTANT);
+	// nothing points into a loaded cache anymore
+	m_CalibrationCache.release();
+}
+void DisparityMapper::_rectifyImages()
+{
+	// both eyes in parallel row bands, same result as cv::remap with CV_INTER_LINEAR and a constant border
+	m_Rectifier.Rectify(m_LeftOriginal, m_RightOriginal, m_LeftRectified, m_RightRectified);
 }
 
-void DisparityMapper::_getCalibrationQuality()
+int DisparityMapper::_numThreads()
+{
+	return m_NumThreads > 0 ? m_NumThreads : std::max((int)std::thread::hardware_concurrency(), 1);
+}
+bool DisparityMapper::AddCalibrationPair(cv::Mat _left, cv::Mat _right)
 {
-	int numberOfImages = m_CalibrationImages.size()*0.5;
-	double err = 0;
-	int npoints = 0;
-	std::vector<cv::Vec3f> lines[2];
-	for (int i = 0; i < numberOfImages; i++)
+	// new pairs extend the image list's, a calibration that came from the cache has not seen those yet
+	if (m_Calibrator.GetNumPairs() == 0 && m_CalibrationImagesFilename != NULL)
 	{
-		int npt = (int)m_ImagePoints[0][i].size();
-		cv::Mat imgpt[2];
-		for (int k = 0; k < 2; k++)
-		{
-			imgpt[k] = cv::Mat(m_ImagePoints[k][i]);
-			undistortPoints(imgpt[k], imgpt[k], m_CameraMatrix[k], m_DistortionCoef[k], cv::Mat(), m_CameraMatrix[k]);
-			computeCorrespondEpilines(imgpt[k], k + 1, m_Fundamental, lines[k]);
-		}
-		for (int j = 0; j < npt; j++)
-		{
-			double errij = fabs(m_ImagePoints[0][i][j].x*lines[1][j][0] +
-				m_ImagePoints[0][i][j].y*lines[1][j][1] + lines[1][j][2]) +
-				fabs(m_ImagePoints[1][i][j].x*lines[0][j][0] +
-					m_ImagePoints[1][i][j].y*lines[0][j][1] + lines[0][j][2]);
-			err += errij;
-		}
-		npoints += npt;
+		_collectCalibrationPoints();
 	}
-	double avg = err / npoints;
+	return m_Calibrator.AddCalibrationPair(_left, _right);
+}
+double DisparityMapper::RefineCalibration()
+{
+	// warm starts from the current solution, the next Compute rebuilds the remap tables from the result
+	double error = m_Calibrator.Refine();
+	_takeCalibration();
+	m_RectifiedSize = cv::Size();
+	return error;
 }
-
 void DisparityMapper::_calibrateCamera()
 {
-	if (m_CalibrationImagesFilename == NULL)
+	_collectCalibrationPoints();
+	m_Calibrator.Refine();
+	_takeCalibration();
+}
+void DisparityMapper::_takeCalibration()
+{
+	// copies, the calibrator solves into its own matrices on the next refinement
+	for (int eye = 0; eye < 2; ++eye)
 	{
-		throw "Please set calibration images filename";
+		m_CameraMatrix[eye] = m_Calibrator.GetCameraMatrix(eye).clone();
+		m_DistortionCoef[eye] = m_Calibrator.GetDistortionCoef(eye).clone();
 	}
-
-	// get all calibration images
-	_getCalibrationImages();
-
-	int numberOfImages = m_CalibrationImages.size()*0.5;
-
-	cv::Size imageSize = m_CalibrationImages[0].size(); // all sizes should match first image size
-
-	m_ImagePoints[0].resize(numberOfImages);
-	m_ImagePoints[1].resize(numberOfImages);
-
-	// find image points
-	// for each image
-	for (int image_idx = 0; image_idx < numberOfImages; ++image_idx)
+	m_StereoRotation = m_Calibrator.GetRotation().clone();
+	m_StereoTranslation = m_Calibrator.GetTranslation().clone();
+}
+void DisparityMapper::_collectCalibrationPoints()
+{
+	std::vector<std::string> filenames;
+	if (!_getCalibrationImageFilenames(filenames))
 	{
-		// for each eye
-		for (int eye_idx = 0; eye_idx < 2; ++eye_idx)
-		{
-			cv::Mat view = m_CalibrationImages[image_idx * 2 + eye_idx];
-
-			std::vector<cv::Point2f>& corners = m_ImagePoints[eye_idx][image_idx];
-
-			bool found = findCirclesGrid(view, m_CalibrationBoardSize, corners, cv::CALIB_CB_ASYMMETRIC_GRID);
-
-			/*if (found)
-			{
-				cv::drawChessboardCorners(view, m_CalibrationBoardSize, cv::Mat(corners), found);
-
-				cv::imshow("distorted", view);
-				cv::waitKey(0);
-			}*/
-		}
+		throw "Could not read the calibration image list";
 	}
+	int numberOfImages = (int)filenames.size() / 2;
+
+	// find image points, one pool task per image and eye. every task decodes its image straight to grey
+	// and lets go of the pixels once the grid points are out, so at most one image per worker is in memory
+	std::vector<std::vector<cv::Point2f>> points(numberOfImages * 2);
+	std::vector<cv::Size> sizes(numberOfImages * 2);
+	std::vector<uchar> found(numberOfImages * 2, 0);
+	ThreadPool pool(_numThreads());
+	pool.Run(numberOfImages * 2, [&](int _image, int _worker)
+	{
+		cv::Mat grey = cv::imread(filenames[_image], cv::IMREAD_GRAYSCALE);
+		sizes[_image] = grey.size();
+		found[_image] = !grey.empty() && m_Calibrator.FindGrid(grey, points[_image]) ? 1 : 0;
+	});
 
-	// calculate object points
-	m_ObjectPoints.clear();
-	m_ObjectPoints.resize(numberOfImages);
+	// a pair is only usable if the board was found by both eyes, in images of the size of the first such pair
 	for (int image_idx = 0; image_idx < numberOfImages; ++image_idx)
 	{
-		for (int i = 0; i < m_CalibrationBoardSize.height; ++i)
+		bool pairFound = found[image_idx * 2] && found[image_idx * 2 + 1];
+		if (pairFound && sizes[image_idx * 2] == sizes[image_idx * 2 + 1]
+			&& m_Calibrator.AddCalibrationPoints(points[image_idx * 2], points[image_idx * 2 + 1], sizes[image_idx * 2]))
+		{
+			continue;
+		}
+		for (int eye_idx = 0; eye_idx < 2; ++eye_idx)
 		{
-			for (int j = 0; j < m_CalibrationBoardSize.width; ++j)
+			if (!found[image_idx * 2 + eye_idx])
 			{
-				m_ObjectPoints[image_idx].push_back(cv::Point3f((2 * j + i % 2)*m_CalibrationSquareSize, i*m_CalibrationSquareSize, 0));
+				std::cerr << "Calibration board not found in " << filenames[image_idx * 2 + eye_idx] << ", dropping the pair" << std::endl;
 			}
 		}
+		if (pairFound)
+		{
+			std::cerr << "Calibration images " << filenames[image_idx * 2] << " and " << filenames[image_idx * 2 + 1] << " differ in size from the first pair, dropping them" << std::endl;
+		}
 	}
-
-	// calibrate camera matrices and get distortion coefficients
-	m_CameraMatrix[0] = cv::Mat::eye(3, 3, CV_64F);
-	m_CameraMatrix[1] = cv::Mat::eye(3, 3, CV_64F);
-	double rms = cv::stereoCalibrate(m_ObjectPoints, m_ImagePoints[0], m_ImagePoints[1],
-		m_CameraMatrix[0], m_DistortionCoef[0],
-		m_CameraMatrix[1], m_DistortionCoef[1],
-		imageSize, 
-		m_StereoRotation,
-		m_StereoTranslation, 
-		m_Essential, 
-		m_Fundamental,
-		cv::CALIB_FIX_K3
-		+ cv::CALIB_FIX_K5
-		+ cv::CALIB_ZERO_TANGENT_DIST
-		+ cv::CALIB_FIX_ASPECT_RATIO
-		+ cv::CALIB_SAME_FOCAL_LENGTH
-		+ cv::CALIB_FIX_PRINCIPAL_POINT,
-		cv::TermCriteria::TermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 100, 1e-5));
-}
\ No newline at end of file
+	if (m_Calibrator.GetNumPairs() == 0)
+	{
+		throw "Calibration board not found in any image pair";
+	}
+}
@@ -5,41 +5,86 @@
 #include <opencv2\imgproc\imgproc.hpp>
 #include <opencv2\ximgproc\disparity_filter.hpp>
 #include <opencv2\xfeatures2d\nonfree.hpp>
-
-enum class DISPARITY_MAPPER_QUALITY { DISPARITY_MAPPER_QUALITY_VERY_FAST, DISPARITY_MAPPER_QUALITY_FAST, DISPARITY_MAPPER_QUALITY_QUALITY };
+#include "blockmatcher.h"
+#include "sgmmatcher.h"
+#include "supportmatcher.h"
+#include "patchmatchmatcher.h"
+#include "pyramidmatcher.h"
+#include "temporalmatcher.h"
+#include "threadpool.h"
+#include "calibrationcache.h"
+#include "depthtable.h"
+#include "stereorectifier.h"
+#include "stereocalibrator.h"
+#include "disparitysmoother.h"
+#include "disparityupsampler.h"
+
+enum class DISPARITY_MAPPER_QUALITY { DISPARITY_MAPPER_QUALITY_VERY_FAST, DISPARITY_MAPPER_QUALITY_FAST, DISPARITY_MAPPER_QUALITY_QUALITY, DISPARITY_MAPPER_QUALITY_ULTRA_FAST, DISPARITY_MAPPER_QUALITY_CENSUS, DISPARITY_MAPPER_QUALITY_SGM, DISPARITY_MAPPER_QUALITY_SUPPORT, DISPARITY_MAPPER_QUALITY_PATCHMATCH };
 
 class DisparityMapper
 {
 public:
 	DisparityMapper(cv::Mat _left, cv::Mat _right, int _numDisparities, int _wsize, bool _rectify = false, DISPARITY_MAPPER_QUALITY _quality = DISPARITY_MAPPER_QUALITY::DISPARITY_MAPPER_QUALITY_FAST);
-	DisparityMapper(const DisparityMapper& _other) = default;
+	// the matchers, the temporal history and the stripe pool hold the state of the frame being matched, two
+	// mappers sharing them would race. a mapper can be moved but not copied
+	DisparityMapper(const DisparityMapper& _other) = delete;
+	DisparityMapper(DisparityMapper&& _other) = default;
 	~DisparityMapper() = default;
 
 	void Compute();
-
-	inline cv::Mat GetDisparity()							{ return m_Disparity; }
-	inline cv::Mat GetCroppedDisparity()					{ return m_Disparity(m_LeftRegionOfInterest); }
+	void ComputeNext(cv::Mat _left, cv::Mat _right);
+
+	// incremental calibration, the pairs join the image list's and RefineCalibration warm starts from the
+	// current solution. returns the mean epipolar error in pixels, the next Compute rectifies with the result
+	bool AddCalibrationPair(cv::Mat _left, cv::Mat _right);
+	double RefineCalibration();
+
+	// CV_16S fixed point with STEREO_DISP_SHIFT fractional bits, invalid pixels below the minimum disparity
+	inline cv::Mat GetRawDisparity()						{ return m_RawDisparity; }
+	inline cv::Mat GetCroppedRawDisparity()					{ return m_RawDisparity(m_LeftRegionOfInterest); }
+	// 8 bit view of the raw disparity for display, converted on first use after every frame
+	inline cv::Mat GetDisparity()							{ _updateDisparityView(); return m_Disparity; }
+	inline cv::Mat GetCroppedDisparity()					{ _updateDisparityView(); return m_Disparity(m_LeftRegionOfInterest); }
+	// 8 bit confidence of every raw disparity pixel, next to it. the smoothed left-right consistency of the filtered
+	// tiers, 255 for the matches of the others. converted on first use after every frame
+	inline cv::Mat GetConfidence()							{ _updateConfidence(); return m_Confidence; }
+	inline cv::Mat GetCroppedConfidence()					{ _updateConfidence(); return m_Confidence(m_LeftRegionOfInterest); }
 	inline cv::Mat GetLeftOriginal()						{ return m_LeftOriginal; }
 	inline cv::Mat GetCroppedLeftOriginal()					{ return m_LeftOriginal(m_LeftRegionOfInterest); }
 	inline cv::Mat GetRightOriginal()						{ return m_RightOriginal; }
 	inline cv::Mat GetCroppedRightOriginal()				{ return m_RightOriginal(m_LeftRegionOfInterest); }
-
-	inline void SetNumDisparities(int _value)				{ m_NumDisparities = _value; }
-	inline void SetMinDisparity(int _value)					{ m_MinDisparity = _value; }
-	inline void SetSADWindowSize(int _value)				{ m_SADWindowSize = _value; }
-	inline void SetUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; }
-	inline void SetDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; }
-	inline void SetP1(int _value)							{ m_P1 = _value; }
-	inline void SetP2(int _value)							{ m_P2 = _value; }
-	inline void SetSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
-	inline void SetMode(int _value)							{ m_Mode = _value; }
-	inline void SetLambdaValue(double _value)				{ m_LambdaValue = _value; }
-	inline void SetSigmaColor(double _value)				{ m_SigmaColor = _value; }
-	inline void SetUseConfidence(bool _value)				{ m_UseConfidence = _value; }
-	inline void SetQuality(DISPARITY_MAPPER_QUALITY _value)	{ m_Quality = _value; }
-	inline void SetDownscale(bool _value)					{ m_Downscale = _value; }
-	inline void SetQMatrix(cv::Mat _value)					{ m_Q = _value; m_QMatSet = true; }
-	inline void SetCalibrationImageFilename(char* _value)	{ m_CalibrationImagesFilename = _value; }
+	// the frames the disparity belongs to, the rectified pair when the mapper rectifies and the originals otherwise
+	inline cv::Mat GetLeftImage()							{ return m_RectifyImages ? m_LeftRectified : m_LeftOriginal; }
+	inline cv::Mat GetCroppedLeftImage()					{ return GetLeftImage()(m_LeftRegionOfInterest); }
+	inline cv::Mat GetRightImage()							{ return m_RectifyImages ? m_RightRectified : m_RightOriginal; }
+	inline cv::Mat GetCroppedRightImage()					{ return GetRightImage()(m_LeftRegionOfInterest); }
+
+	inline void SetNumDisparities(int _value)				{ m_NumDisparities = _value; m_ConfigurationChanged = true; }
+	inline void SetMinDisparity(int _value)					{ m_MinDisparity = _value; m_ConfigurationChanged = true; }
+	inline void SetSADWindowSize(int _value)				{ m_SADWindowSize = _value; m_ConfigurationChanged = true; }
+	inline void SetUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; m_ConfigurationChanged = true; }
+	inline void SetDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; m_ConfigurationChanged = true; }
+	inline void SetP1(int _value)							{ m_P1 = _value; m_ConfigurationChanged = true; }
+	inline void SetP2(int _value)							{ m_P2 = _value; m_ConfigurationChanged = true; }
+	inline void SetSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; m_ConfigurationChanged = true; }
+	inline void SetNumPaths(int _value)						{ m_NumPaths = _value; m_ConfigurationChanged = true; }
+	inline void SetNumThreads(int _value)					{ m_NumThreads = _value; m_ConfigurationChanged = true; }
+	inline void SetMode(int _value)							{ m_Mode = _value; m_ConfigurationChanged = true; }
+	inline void SetLambdaValue(double _value)				{ m_LambdaValue = _value; m_ConfigurationChanged = true; }
+	inline void SetSigmaColor(double _value)				{ m_SigmaColor = _value; m_ConfigurationChanged = true; }
+	inline void SetUseConfidence(bool _value)				{ m_UseConfidence = _value; m_ConfigurationChanged = true; }
+	inline void SetQuality(DISPARITY_MAPPER_QUALITY _value)	{ m_Quality = _value; m_ConfigurationChanged = true; }
+	// coarse-to-fine levels of the ULTRA_FAST tier, the other tiers ignore it and match at the matching resolution only
+	inline void SetPyramidLevels(int _value)				{ m_PyramidLevels = _value; m_ConfigurationChanged = true; }
+	inline void SetTemporalPrior(bool _value)				{ m_TemporalPrior = _value; m_ConfigurationChanged = true; }
+	// match at 1 / _value of the resolution, 1 matches at full resolution
+	inline void SetDownscaleFactor(int _value)				{ m_Downscale = std::max(_value, 1); m_ConfigurationChanged = true; }
+	// the original switch, true matches at half resolution like it always did
+	inline void SetDownscale(bool _value)					{ SetDownscaleFactor(_value ? 2 : 1); }
+	inline void SetConfidenceThreshold(int _value)			{ m_ConfidenceThreshold = _value; m_PointCloudValid = false; }
+	inline void SetQMatrix(cv::Mat _value)					{ m_Q = _value; m_QMatSet = true; m_PointCloudValid = false; }
+	inline void SetCalibrationImageFilename(char* _value)	{ m_CalibrationImagesFilename = _value; m_RectifiedSize = cv::Size(); m_Calibrator.Clear(); }
+	inline void SetCalibrationCacheFilename(char* _value)	{ m_CalibrationCacheFilename = _value; m_RectifiedSize = cv::Size(); m_Calibrator.Clear(); }
 
 	inline int		GetNumDisparities()						{ return m_NumDisparities; }
 	inline int		GetMinDisparity()						{ return m_MinDisparity; }
@@ -49,43 +94,112 @@ public:
 	inline int		GetP1()									{ return m_P1; }
 	inline int		GetP2()									{ return m_P2; }
 	inline int		GetSpeckleWindowSize()					{ return m_SpeckleWindowSize; }
+	inline int		GetNumPaths()							{ return m_NumPaths; }
+	inline int		GetNumThreads()							{ return m_NumThreads; }
 	inline int		GetMode()								{ return m_Mode; }
 	inline double	GetLambdaValue()						{ return m_LambdaValue; }
 	inline double	GetSigmaColor()							{ return m_SigmaColor; }
 	inline bool		GetUseConfidence()						{ return m_UseConfidence; }
 	inline DISPARITY_MAPPER_QUALITY GetQuality()			{ return m_Quality; }
-	inline bool		GetDownscale()							{ return m_Downscale; }
+	inline int		GetPyramidLevels()						{ return m_PyramidLevels; }
+	inline bool		GetTemporalPrior()						{ return m_TemporalPrior; }
+	inline int		GetDownscaleFactor()					{ return m_Downscale; }
+	inline bool		GetDownscale()							{ return m_Downscale > 1; }
+	inline double	GetFastPathFraction()					{ return m_LeftTemporal ? m_LeftTemporal->getFastPathFraction() : 0.0; }
+	inline int		GetConfidenceThreshold()				{ return m_ConfidenceThreshold; }
 	inline cv::Mat	GetQMatrix()							{ return m_Q; }
-	inline cv::Mat	GetPointCloud()							{ return m_PointCloud; }
+	inline cv::Mat	GetPointCloud()							{ _createPointCloud(); return m_PointCloud; }
 	inline double GetBaseline()								{ return m_Baseline; }
 	inline double GetFocalLength()							{ return m_FocalLength; }
+	inline double GetCalibrationError()						{ return m_Calibrator.GetEpipolarError(); }
 
 private:
 	void _computeQuality();
 	void _computeFast();
 	void _computeVeryFast();
+	void _prepareGrey();
+	void _upsampleDisparity();
+	void _updateDisparityView();
+	void _updateConfidence();
 	void _createPointCloud();
+	void _configureMatchers();
+	cv::Ptr<cv::StereoMatcher> _createLeftMatcher(int _minDisparity, int _numDisparities);
+	cv::Ptr<cv::StereoMatcher> _createRightMatcher(cv::Ptr<cv::StereoMatcher> _leftMatcher);
+	cv::Ptr<cv::StereoMatcher> _createSubsampledRightMatcher();
+	void _computeRightDisparity();
+	void _filterDisparity();
+	void _computeStriped(cv::Ptr<cv::StereoMatcher> _matcher, std::vector<cv::Ptr<cv::StereoMatcher>>& _stripeMatchers, const cv::Mat& _left, const cv::Mat& _right, cv::Mat& _disparity);
+	int _stripeOverlap(cv::Ptr<cv::StereoMatcher> _matcher);
+	int _sgmMode();
 	cv::Rect _computeRegionOfInterest(cv::Size2i _size, cv::Ptr<cv::StereoMatcher> _matcher);
-	bool _getCalibrationImages();
+	bool _getCalibrationImageFilenames(std::vector<std::string>& _filenames);
+	bool _getCalibrationKey(cv::Size _imageSize, unsigned long long& _key);
+	void _prepareRectification();
 	void _calibrateCamera();
+	void _collectCalibrationPoints();
+	void _takeCalibration();
+	int _numThreads();
+	void _computeRectification(cv::Size _imageSize);
 	void _rectifyImages();
-	void _getCalibrationQuality();
 
 private:
 	cv::Mat m_LeftOriginal;
 	cv::Mat m_RightOriginal;
 	cv::Mat m_LeftRectified;
 	cv::Mat m_RightRectified;
-	cv::Mat m_Disparity;
+	cv::Mat m_RawDisparity;	// 16S, the filtered or left disparity of the last frame
+	cv::Mat m_Disparity;	// 8 bit view of m_RawDisparity
+	bool m_DisparityViewValid;
+	cv::Mat m_Confidence;	// 8 bit, at full resolution
+	bool m_ConfidenceValid;
+
+	// matchers, filter and intermediate images kept alive between frames
+	cv::Ptr<cv::StereoMatcher> m_LeftMatcher;
+	cv::Ptr<cv::StereoMatcher> m_RightMatcher;
+	cv::Ptr<DisparitySmoother> m_Smoother;
+	cv::Mat m_LeftGrey;	// at the matching resolution
+	cv::Mat m_RightGrey;
+	cv::Mat m_LeftGreyFull;	// full resolution when downscaled, the upsampler's guide
+	cv::Mat m_RightGreyFull;
+	cv::Mat m_LeftDisparity;	// 16S
+	cv::Mat m_RightDisparity;	// 16S, brought up from the subsampled one
+	cv::Mat m_LeftGreySmall;	// half resolution for the right disparity
+	cv::Mat m_RightGreySmall;
+	cv::Mat m_RightSmallDisparity;	// 16S
+	cv::Mat m_FilteredDisparity;	// 16S
+	cv::Mat m_SmoothedConfidence;	// 8 bit, the smoother's at the matching resolution
+	cv::Mat m_ConfidenceBlocks;	// 8 bit, m_SmoothedConfidence brought up over the whole blocks
+	cv::Mat m_UpsampledDisparity;	// 16S
+	DisparityUpsampler m_Upsampler;
+
+	// block matching tiers match overlapping row stripes on the pool, one matcher per worker
+	cv::Ptr<ThreadPool> m_ThreadPool;
+	std::vector<cv::Ptr<cv::StereoMatcher>> m_LeftStripeMatchers;
+	std::vector<cv::Ptr<cv::StereoMatcher>> m_RightStripeMatchers;	// subsampled like m_RightMatcher
+	std::vector<cv::Mat> m_StripeDisparities;	// 16S
+	cv::Mat m_SpeckleBuffer;
+	cv::Ptr<TemporalMatcher> m_LeftTemporal;	// wraps m_LeftMatcher with the temporal prior on and a band search for its cost
+	cv::Size m_ConfiguredSize;
+	cv::Size m_MatchSize;	// frame size divided by m_Downscale
+	int m_MatchMinDisparity;	// disparity range at the matching resolution
+	int m_MatchNumDisparities;
+	bool m_ConfigurationChanged;
 
 	cv::Rect m_LeftRegionOfInterest;
 	cv::Rect m_RightRegionOfInterest;
 
 	cv::Mat m_CameraMatrix[2];
 	cv::Mat m_DistortionCoef[2];
+	StereoRectifier m_Rectifier;	// remap tables of both eyes
+	cv::Size m_RectifiedSize;	// frame size the remap tables were built for, empty before the first
+	cv::Ptr<CalibrationCache> m_CalibrationCache;	// mapped file the calibration matrices point into
+	StereoCalibrator m_Calibrator;	// points of every pair so far and the solution the matrices above are copied from
 
 	cv::Mat m_Q;
-	cv::Mat m_PointCloud;
+	cv::Mat m_PointCloud;	// computed on first use after every frame
+	bool m_PointCloudValid;
+	int m_ConfidenceThreshold;	// 8 bit confidence below which the point cloud leaves pixels out, 0 keeps every valid one
+	DepthTable m_DepthTable;	// kept while Q and the range stay the same
 
 	int m_NumDisparities;
 	int m_MinDisparity;
@@ -95,11 +209,15 @@ private:
 	int m_P1;
 	int m_P2;
 	int m_SpeckleWindowSize;
+	int m_NumPaths;	// in-tree SGM only, 4, 8 or 16
+	int m_NumThreads;	// stripe and calibration workers, 0 uses every core
 	int m_Mode;
 	double m_LambdaValue;
 	double m_SigmaColor;
 	bool m_UseConfidence;
-	bool m_Downscale;
+	int m_PyramidLevels;	// coarser levels searched before the full resolution, 0 matches only the full resolution. ULTRA_FAST only
+	bool m_TemporalPrior;	// for ComputeNext streams, seeds every frame's search from the previous one. only where the left matcher is the SAD block matcher
+	int m_Downscale;	// every tier matches at 1 / m_Downscale of the resolution and upsamples the result, 1 matches at full resolution
 	bool m_RectifyImages;
 	DISPARITY_MAPPER_QUALITY m_Quality;
 	bool m_QMatSet;
@@ -108,15 +226,8 @@ private:
 	double m_Baseline;
 
 	char* m_CalibrationImagesFilename;
-	std::vector<cv::Mat> m_CalibrationImages;
-	cv::Size m_CalibrationBoardSize;
-	int m_CalibrationSquareSize;
+	char* m_CalibrationCacheFilename;	// NULL keeps the cache next to the image list, <list>.cache
 
 	cv::Mat m_StereoRotation;
 	cv::Mat m_StereoTranslation;
-	cv::Mat m_Fundamental;
-	cv::Mat m_Essential;
-
-	std::vector<std::vector<cv::Point2f>> m_ImagePoints[2];
-	std::vector<std::vector<cv::Point3f>> m_ObjectPoints;
 };
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include "disparitysmoother.h"
+#include <algorithm>
+#include <math.h>
+
+const float DisparitySmoother::SMOOTH_MIN_CONFIDENCE = 1e-4f;
+
+DisparitySmoother::DisparitySmoother(double _lambda, double _sigmaColor, bool _useConfidence)
+	: m_Lambda(_lambda), m_SigmaColor(_sigmaColor), m_UseConfidence(_useConfidence)
+{
+	m_LRCThreshold = 24;
+	m_DepthDiscontinuityRadius = 0;
+	m_NumIterations = 3;
+	m_LambdaAttenuation = 0.25;
+	m_Kernels = NULL;
+	m_MinValid = 0;
+	m_RightMinValid = 0;
+	m_CurrentLambda = 0.0f;
+	m_NumBlocks = 0;
+	m_NumStripes = 0;
+}
+
+void DisparitySmoother::Filter(const cv::Mat& _left, const cv::Mat& _guide, const cv::Mat& _right, int _minDisparity, int _rightMinDisparity, cv::Mat& _filtered)
+{
+	_filter(_left, _guide, _right, _minDisparity, _rightMinDisparity, _filtered, NULL);
+}
+
+void DisparitySmoother::Filter(const cv::Mat& _left, const cv::Mat& _guide, const cv::Mat& _right, int _minDisparity, int _rightMinDisparity, cv::Mat& _filtered, cv::Mat& _confidence)
+{
+	_filter(_left, _guide, _right, _minDisparity, _rightMinDisparity, _filtered, &_confidence);
+}
+
+void DisparitySmoother::_filter(const cv::Mat& _left, const cv::Mat& _guide, const cv::Mat& _right, int _minDisparity, int _rightMinDisparity, cv::Mat& _filtered, cv::Mat* _confidence)
+{
+	if (_left.type() != CV_16S || _guide.type() != CV_8UC1 || _left.size() != _guide.size())
+	{
+		throw "Smoother needs a CV_16S disparity and an 8 bit grey guide of the same size";
+	}
+	if (m_UseConfidence && (_right.type() != CV_16S || _right.size() != _left.size()))
+	{
+		throw "Smoother needs the CV_16S right disparity at the left's size for the confidence";
+	}
+
+	int width = _left.cols;
+	int height = _left.rows;
+	m_Kernels = &GetStereoKernels();
+	m_Left = _left;
+	m_Guide = _guide;
+	m_Right = m_UseConfidence ? _right : cv::Mat();
+	m_MinValid = (short)(_minDisparity * STEREO_DISP_SCALE);
+	m_RightMinValid = (short)(_rightMinDisparity * STEREO_DISP_SCALE);
+
+	for (int i = 0; i < 256; ++i)
+	{
+		m_WeightTable[i] = (float)-exp(-i / m_SigmaColor);
+	}
+
+	// no-ops once the buffers exist
+	m_NumBlocks = (height + SMOOTH_BLOCK_ROWS - 1) / SMOOTH_BLOCK_ROWS;
+	size_t packedSize = (size_t)m_NumBlocks * width * SMOOTH_BLOCK_ROWS;
+	m_Planes[0].create(height, width, CV_32F);
+	m_Planes[1].create(height, width, CV_32F);
+	m_ColumnWeights.create(height, width, CV_32F);
+	m_ColumnRecursion.create(height, width, CV_32F);
+	m_RowWeights.resize(packedSize);
+	m_PackedPlanes[0].resize(packedSize);
+	m_PackedPlanes[1].resize(packedSize);
+	m_RowRecursion.resize(packedSize);
+	m_Zeros.assign(std::max(width, (int)SMOOTH_BLOCK_ROWS), 0.0f);
+
+	// the disparity spread around every pixel. invalid pixels are taken out of the minimum by the largest value
+	// and never reach the maximum, they are below every valid one
+	if (!m_Right.empty() && m_DepthDiscontinuityRadius > 0)
+	{
+		cv::Mat window = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * m_DepthDiscontinuityRadius + 1, 2 * m_DepthDiscontinuityRadius + 1));
+		_left.copyTo(m_DisparityMin);
+		m_DisparityMin.setTo(SHRT_MAX, _left < (double)m_MinValid);
+		cv::erode(m_DisparityMin, m_DisparityMin, window);
+		cv::dilate(_left, m_DisparityMax, window);
+	}
+
+	// column stripes a multiple of 8 wide, a few per core
+	int numThreads = std::max(cv::getNumThreads(), 1);
+	m_NumStripes = std::max(std::min(numThreads * 2, width / 64), 1);
+
+	cv::parallel_for_(cv::Range(0, m_NumBlocks), PassBody(this, SMOOTH_PASS::SMOOTH_PASS_PREPARE));
+	double lambda = m_Lambda;
+	for (int iteration = 0; iteration < m_NumIterations; ++iteration)
+	{
+		m_CurrentLambda = (float)lambda;
+		cv::parallel_for_(cv::Range(0, m_NumBlocks), PassBody(this, SMOOTH_PASS::SMOOTH_PASS_ROWS));
+		cv::parallel_for_(cv::Range(0, m_NumStripes), PassBody(this, SMOOTH_PASS::SMOOTH_PASS_COLUMNS));
+		lambda *= m_LambdaAttenuation;
+	}
+
+	_filtered.create(height, width, CV_16S);
+	m_Filtered = _filtered;
+	if (_confidence)
+	{
+		_confidence->create(height, width, CV_8UC1);
+		m_Confidence = *_confidence;
+	}
+	cv::parallel_for_(cv::Range(0, m_NumBlocks), PassBody(this, SMOOTH_PASS::SMOOTH_PASS_RESULT));
+
+	// the frame is only referenced while filtering
+	m_Left.release();
+	m_Guide.release();
+	m_Right.release();
+	m_Filtered.release();
+	m_Confidence.release();
+}
+
+void DisparitySmoother::PassBody::operator()(const cv::Range& _range) const
+{
+	for (int i = _range.start; i < _range.end; ++i)
+	{
+		switch (m_Pass)
+		{
+		case SMOOTH_PASS::SMOOTH_PASS_PREPARE:
+			m_Smoother->_prepareBlock(i);
+			break;
+		case SMOOTH_PASS::SMOOTH_PASS_ROWS:
+			m_Smoother->_solveRowBlock(i);
+			break;
+		case SMOOTH_PASS::SMOOTH_PASS_COLUMNS:
+			m_Smoother->_solveColumnStripe(i);
+			break;
+		case SMOOTH_PASS::SMOOTH_PASS_RESULT:
+			m_Smoother->_resultBlock(i);
+			break;
+		}
+	}
+}
+
+void DisparitySmoother::_prepareBlock(int _block)
+{
+	int width = m_Guide.cols;
+	int height = m_Guide.rows;
+	int yBegin = _block * SMOOTH_BLOCK_ROWS;
+	const short* right = NULL;
+
+	for (int k = 0; k < SMOOTH_BLOCK_ROWS; ++k)
+	{
+		int y = yBegin + k;
+		if (y >= height)
+		{
+			// lanes past the last row are solved too, without links they stay 0
+			for (int x = 0; x < width; ++x)
+			{
+				_packed(m_RowWeights, _block, x)[k] = 0.0f;
+			}
+			continue;
+		}
+
+		// confidence and the disparity weighted by it
+		if (!m_Right.empty())
+		{
+			right = m_Right.ptr<short>(y);
+		}
+		m_Kernels->ConsistencyCheckRow(m_Left.ptr<short>(y), right, width, m_MinValid, m_RightMinValid, (short)m_LRCThreshold,
+			m_Planes[0].ptr<float>(y), m_Planes[1].ptr<float>(y));
+		if (right && m_DepthDiscontinuityRadius > 0)
+		{
+			_discontinuityRow(y);
+		}
+
+		// links to the right and below
+		const uchar* guide = m_Guide.ptr<uchar>(y);
+		for (int x = 0; x + 1 < width; ++x)
+		{
+			_packed(m_RowWeights, _block, x)[k] = m_WeightTable[std::abs(guide[x + 1] - guide[x])];
+		}
+		_packed(m_RowWeights, _block, width - 1)[k] = 0.0f;
+
+		float* columnWeights = m_ColumnWeights.ptr<float>(y);
+		if (y + 1 < height)
+		{
+			const uchar* below = m_Guide.ptr<uchar>(y + 1);
+			for (int x = 0; x < width; ++x)
+			{
+				columnWeights[x] = m_WeightTable[std::abs(below[x] - guide[x])];
+			}
+		}
+		else
+		{
+			std::fill(columnWeights, columnWeights + width, 0.0f);
+		}
+	}
+}
+
+void DisparitySmoother::_discontinuityRow(int _y)
+{
+	// full confidence up to a spread of the LRC threshold, none from twice the threshold on
+	int width = m_Guide.cols;
+	const short* low = m_DisparityMin.ptr<short>(_y);
+	const short* high = m_DisparityMax.ptr<short>(_y);
+	float* weighted = m_Planes[0].ptr<float>(_y);
+	float* confidence = m_Planes[1].ptr<float>(_y);
+	float threshold = (float)std::max(m_LRCThreshold, 1);
+	for (int x = 0; x < width; ++x)
+	{
+		int spread = high[x] - low[x];
+		if (confidence[x] > 0.0f && spread > m_LRCThreshold)
+		{
+			float scale = std::max(2.0f - spread / threshold, 0.0f);
+			weighted[x] *= scale;
+			confidence[x] *= scale;
+		}
+	}
+}
+
+void DisparitySmoother::_solveRowBlock(int _block)
+{
+	int width = m_Guide.cols;
+	int height = m_Guide.rows;
+	int yBegin = _block * SMOOTH_BLOCK_ROWS;
+	const int lanes = SMOOTH_BLOCK_ROWS;
+	const float* zeros = &m_Zeros[0];
+
+	// the block's rows side by side, a column of the block is one step of all of their solves
+	for (int k = 0; k < lanes; ++k)
+	{
+		int y = yBegin + k;
+		const float* plane0 = y < height ? m_Planes[0].ptr<float>(y) : zeros;
+		const float* plane1 = y < height ? m_Planes[1].ptr<float>(y) : zeros;
+		int step = y < height ? 1 : 0;
+		for (int x = 0; x < width; ++x)
+		{
+			_packed(m_PackedPlanes[0], _block, x)[k] = plane0[x * step];
+			_packed(m_PackedPlanes[1], _block, x)[k] = plane1[x * step];
+		}
+	}
+
+	float* x0 = _packed(m_PackedPlanes[0], _block, 0);
+	float* x1 = _packed(m_PackedPlanes[1], _block, 0);
+	const float* weights = _packed(m_RowWeights, _block, 0);
+	float* recursion = _packed(m_RowRecursion, _block, 0);
+	m_Kernels->SmoothForwardRow(x0, x1, zeros, zeros, zeros, weights, zeros, recursion, m_CurrentLambda, lanes);
+	for (int x = 1; x < width; ++x)
+	{
+		m_Kernels->SmoothForwardRow(x0 + x * lanes, x1 + x * lanes, x0 + (x - 1) * lanes, x1 + (x - 1) * lanes,
+			weights + (x - 1) * lanes, weights + x * lanes, recursion + (x - 1) * lanes, recursion + x * lanes, m_CurrentLambda, lanes);
+	}
+	for (int x = width - 2; x >= 0; --x)
+	{
+		m_Kernels->SmoothBackwardRow(x0 + x * lanes, x1 + x * lanes, x0 + (x + 1) * lanes, x1 + (x + 1) * lanes, recursion + x * lanes, lanes);
+	}
+
+	for (int k = 0; k < lanes && yBegin + k < height; ++k)
+	{
+		float* plane0 = m_Planes[0].ptr<float>(yBegin + k);
+		float* plane1 = m_Planes[1].ptr<float>(yBegin + k);
+		for (int x = 0; x < width; ++x)
+		{
+			plane0[x] = x0[x * lanes + k];
+			plane1[x] = x1[x * lanes + k];
+		}
+	}
+}
+
+void DisparitySmoother::_solveColumnStripe(int _stripe)
+{
+	int width = m_Guide.cols;
+	int height = m_Guide.rows;
+	int xBegin = (int)((long long)width * _stripe / m_NumStripes) & ~7;
+	int xEnd = _stripe + 1 == m_NumStripes ? width : (int)((long long)width * (_stripe + 1) / m_NumStripes) & ~7;
+	int lanes = xEnd - xBegin;
+	const float* zeros = &m_Zeros[0];
+
+	// row by row down the stripe, every column is its own solve
+	for (int y = 0; y < height; ++y)
+	{
+		float* x0 = m_Planes[0].ptr<float>(y) + xBegin;
+		float* x1 = m_Planes[1].ptr<float>(y) + xBegin;
+		const float* weights = m_ColumnWeights.ptr<float>(y) + xBegin;
+		float* recursion = m_ColumnRecursion.ptr<float>(y) + xBegin;
+		if (y == 0)
+		{
+			m_Kernels->SmoothForwardRow(x0, x1, zeros, zeros, zeros, weights, zeros, recursion, m_CurrentLambda, lanes);
+			continue;
+		}
+		m_Kernels->SmoothForwardRow(x0, x1, m_Planes[0].ptr<float>(y - 1) + xBegin, m_Planes[1].ptr<float>(y - 1) + xBegin,
+			m_ColumnWeights.ptr<float>(y - 1) + xBegin, weights, m_ColumnRecursion.ptr<float>(y - 1) + xBegin, recursion, m_CurrentLambda, lanes);
+	}
+	for (int y = height - 2; y >= 0; --y)
+	{
+		m_Kernels->SmoothBackwardRow(m_Planes[0].ptr<float>(y) + xBegin, m_Planes[1].ptr<float>(y) + xBegin,
+			m_Planes[0].ptr<float>(y + 1) + xBegin, m_Planes[1].ptr<float>(y + 1) + xBegin, m_ColumnRecursion.ptr<float>(y) + xBegin, lanes);
+	}
+}
+
+void DisparitySmoother::_resultBlock(int _block)
+{
+	int width = m_Guide.cols;
+	int yBegin = _block * SMOOTH_BLOCK_ROWS;
+	int yEnd = std::min(yBegin + SMOOTH_BLOCK_ROWS, m_Guide.rows);
+	short invalid = (short)(m_MinValid - STEREO_DISP_SCALE);
+
+	for (int y = yBegin; y < yEnd; ++y)
+	{
+		const float* weighted = m_Planes[0].ptr<float>(y);
+		const float* confidence = m_Planes[1].ptr<float>(y);
+		short* filtered = m_Filtered.ptr<short>(y);
+		for (int x = 0; x < width; ++x)
+		{
+			filtered[x] = confidence[x] > SMOOTH_MIN_CONFIDENCE ? cv::saturate_cast<short>(weighted[x] / confidence[x]) : invalid;
+		}
+
+		// the smoothed confidence stays within 0 and 1, every solve is a weighted average
+		if (!m_Confidence.empty())
+		{
+			uchar* output = m_Confidence.ptr<uchar>(y);
+			for (int x = 0; x < width; ++x)
+			{
+				output[x] = confidence[x] > SMOOTH_MIN_CONFIDENCE ? cv::saturate_cast<uchar>(confidence[x] * 255.0f) : 0;
+			}
+		}
+	}
+}
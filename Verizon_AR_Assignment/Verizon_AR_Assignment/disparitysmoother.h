@@ -0,0 +1,116 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <opencv2\imgproc\imgproc.hpp>
+#include <vector>
+#include "stereokernels.h"
+
+// In-tree edge-aware smoothing of a disparity map, the fast global smoother of Min et al. that
+// cv::ximgproc::DisparityWLSFilter runs.
+// Every iteration solves the 1D weighted least squares problem along every row and then along every
+// column, each a tridiagonal system solved with one recursive pass forward and one back. The links
+// between neighbours are -exp(-|dI| / sigmaColor) of the guide and lambda is multiplied by the
+// attenuation after every iteration, the defaults are those of the OpenCV filter.
+// The disparity is smoothed together with its confidence, 1 where it is valid and, with confidence on,
+// consistent with the right disparity, and the result is their ratio so that invalid and inconsistent
+// pixels take the disparity of their surroundings. The weights and recursion coefficients only depend
+// on the guide, both planes share them.
+// Columns are solved in parallel stripes with SIMD across the columns. For the rows, blocks of
+// SMOOTH_BLOCK_ROWS rows are packed side by side and solved in parallel the same way.
+// With confidence and a depth discontinuity radius, like the OpenCV filter the confidence is also lowered
+// near depth discontinuities, where block matches spill over the edge of the nearer surface. A consistent
+// pixel keeps it while the spread of the valid disparities in the window of that radius around it stays
+// within the LRC threshold, and it falls linearly to 0 at twice the threshold.
+class DisparitySmoother
+{
+public:
+	DisparitySmoother(double _lambda = 8000.0, double _sigmaColor = 1.5, bool _useConfidence = false);
+	DisparitySmoother(const DisparitySmoother& _other) = default;
+	~DisparitySmoother() = default;
+
+	// _left CV_16S with STEREO_DISP_SHIFT fractional bits, invalid below _minDisparity, _guide 8 bit grey of the
+	// same size. _right is only read with confidence, the right disparity at the left's size and scale with
+	// the mirrored range, invalid below _rightMinDisparity. pixels without any confidence nearby come out invalid
+	void Filter(const cv::Mat& _left, const cv::Mat& _guide, const cv::Mat& _right, int _minDisparity, int _rightMinDisparity, cv::Mat& _filtered);
+	// the same, also writing the smoothed confidence of every pixel as 8 bit, 255 where its whole neighbourhood
+	// was valid and consistent down to 0 where the disparity came out invalid
+	void Filter(const cv::Mat& _left, const cv::Mat& _guide, const cv::Mat& _right, int _minDisparity, int _rightMinDisparity, cv::Mat& _filtered, cv::Mat& _confidence);
+
+	inline void SetLambda(double _value)				{ m_Lambda = _value; }
+	inline void SetSigmaColor(double _value)			{ m_SigmaColor = _value; }
+	inline void SetUseConfidence(bool _value)			{ m_UseConfidence = _value; }
+	inline void SetLRCThreshold(int _value)				{ m_LRCThreshold = _value; }
+	inline void SetDepthDiscontinuityRadius(int _value)	{ m_DepthDiscontinuityRadius = _value; }
+	inline void SetNumIterations(int _value)			{ m_NumIterations = _value; }
+	inline void SetLambdaAttenuation(double _value)		{ m_LambdaAttenuation = _value; }
+
+	inline double	GetLambda() const					{ return m_Lambda; }
+	inline double	GetSigmaColor() const				{ return m_SigmaColor; }
+	inline bool		GetUseConfidence() const			{ return m_UseConfidence; }
+	inline int		GetLRCThreshold() const				{ return m_LRCThreshold; }
+	inline int		GetDepthDiscontinuityRadius() const	{ return m_DepthDiscontinuityRadius; }
+	inline int		GetNumIterations() const			{ return m_NumIterations; }
+	inline double	GetLambdaAttenuation() const		{ return m_LambdaAttenuation; }
+
+	static const int SMOOTH_BLOCK_ROWS = 16;	// rows packed side by side for the row passes
+	static const float SMOOTH_MIN_CONFIDENCE;	// smoothed confidence below which a pixel stays invalid
+
+private:
+	enum class SMOOTH_PASS { SMOOTH_PASS_PREPARE, SMOOTH_PASS_ROWS, SMOOTH_PASS_COLUMNS, SMOOTH_PASS_RESULT };
+
+	// runs one pass over a range of row blocks, or column stripes for the column pass
+	class PassBody : public cv::ParallelLoopBody
+	{
+	public:
+		PassBody(DisparitySmoother* _smoother, SMOOTH_PASS _pass) : m_Smoother(_smoother), m_Pass(_pass) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		DisparitySmoother* m_Smoother;
+		SMOOTH_PASS m_Pass;
+	};
+
+	void _filter(const cv::Mat& _left, const cv::Mat& _guide, const cv::Mat& _right, int _minDisparity, int _rightMinDisparity, cv::Mat& _filtered, cv::Mat* _confidence);
+	void _prepareBlock(int _block);
+	void _discontinuityRow(int _y);
+	void _solveRowBlock(int _block);
+	void _solveColumnStripe(int _stripe);
+	void _resultBlock(int _block);
+
+	// block major, then column, then the block's rows
+	inline float* _packed(std::vector<float>& _buffer, int _block, int _x)	{ return &_buffer[((size_t)_block * m_Guide.cols + _x) * SMOOTH_BLOCK_ROWS]; }
+
+private:
+	double m_Lambda;
+	double m_SigmaColor;
+	bool m_UseConfidence;
+	int m_LRCThreshold;	// in 1 / STEREO_DISP_SCALE pixels
+	int m_DepthDiscontinuityRadius;	// 0 leaves the confidence near depth discontinuities alone
+	int m_NumIterations;
+	double m_LambdaAttenuation;
+
+	// state of the frame being filtered, shared with the pass bodies
+	const StereoKernels* m_Kernels;
+	cv::Mat m_Left;
+	cv::Mat m_Guide;
+	cv::Mat m_Right;
+	cv::Mat m_Filtered;
+	cv::Mat m_Confidence;	// empty when not asked for
+	short m_MinValid;
+	short m_RightMinValid;
+	float m_CurrentLambda;
+	int m_NumBlocks;
+	int m_NumStripes;
+
+	// kept between calls so a stream of same sized frames does not allocate
+	float m_WeightTable[256];
+	cv::Mat m_Planes[2];	// CV_32F, the disparity times the confidence and the confidence
+	cv::Mat m_DisparityMin;	// CV_16S, lowest and highest valid disparity in the discontinuity window
+	cv::Mat m_DisparityMax;
+	cv::Mat m_ColumnWeights;	// CV_32F, link of every pixel to the one below, 0 on the last row
+	cv::Mat m_ColumnRecursion;	// CV_32F, forward coefficients of the column solve
+	std::vector<float> m_RowWeights;	// packed, link of every pixel to the one on its right, 0 on the last column
+	std::vector<float> m_PackedPlanes[2];
+	std::vector<float> m_RowRecursion;
+	std::vector<float> m_Zeros;
+};
@@ -0,0 +1,126 @@
+#include "disparityupsampler.h"
+#include <algorithm>
+#include <math.h>
+
+DisparityUpsampler::DisparityUpsampler(double _sigmaSpace, double _sigmaColor)
+	: m_SigmaSpace(_sigmaSpace), m_SigmaColor(_sigmaColor)
+{
+	m_Factor = 1;
+	m_MinValid = 0;
+}
+
+void DisparityUpsampler::Upsample(const cv::Mat& _disparity, const cv::Mat& _lowGuide, const cv::Mat& _guide, int _factor, int _minDisparity, cv::Mat& _upsampled)
+{
+	if (_disparity.type() != CV_16S || _lowGuide.type() != CV_8UC1 || _guide.type() != CV_8UC1 || _disparity.size() != _lowGuide.size())
+	{
+		throw "Upsampler needs a CV_16S disparity with its 8 bit grey image and the full resolution grey image";
+	}
+	if (_factor < 1 || _disparity.cols * _factor > _guide.cols || _disparity.rows * _factor > _guide.rows)
+	{
+		throw "Upsampler guide is smaller than the disparity times the factor";
+	}
+
+	m_Disparity = _disparity;
+	m_LowGuide = _lowGuide;
+	m_Guide = _guide;
+	m_Factor = _factor;
+	m_MinValid = (short)(_minDisparity * STEREO_DISP_SCALE);
+
+	for (int i = 0; i < 256; ++i)
+	{
+		m_ColorTable[i] = (float)exp(-0.5 * i * i / (m_SigmaColor * m_SigmaColor));
+	}
+
+	// the centre of low resolution pixel q is at (q + 0.5) * factor - 0.5, a pixel at phase p in its block
+	// is (p + 0.5) / factor - 0.5 low resolution pixels off its own block's centre
+	m_SpaceTable.resize(_factor * _factor * 9);
+	for (int py = 0; py < _factor; ++py)
+	{
+		for (int px = 0; px < _factor; ++px)
+		{
+			double u = (px + 0.5) / _factor - 0.5;
+			double v = (py + 0.5) / _factor - 0.5;
+			float* weights = &m_SpaceTable[(py * _factor + px) * 9];
+			for (int k = 0; k < 9; ++k)
+			{
+				double du = u - (k % 3 - 1);
+				double dv = v - (k / 3 - 1);
+				weights[k] = (float)exp(-0.5 * (du * du + dv * dv) / (m_SigmaSpace * m_SigmaSpace));
+			}
+		}
+	}
+
+	_upsampled.create(_guide.size(), CV_16S);
+	m_Upsampled = _upsampled;
+	int numBands = std::min(_guide.rows, std::max(cv::getNumThreads(), 1) * 4);
+	cv::parallel_for_(cv::Range(0, numBands), BandBody(this, numBands));
+
+	// the frame is only referenced while upsampling
+	m_Disparity.release();
+	m_LowGuide.release();
+	m_Guide.release();
+	m_Upsampled.release();
+}
+
+void DisparityUpsampler::BandBody::operator()(const cv::Range& _range) const
+{
+	int height = m_Upsampler->m_Guide.rows;
+	for (int band = _range.start; band < _range.end; ++band)
+	{
+		for (int y = height * band / m_NumBands; y < height * (band + 1) / m_NumBands; ++y)
+		{
+			m_Upsampler->_upsampleRow(y);
+		}
+	}
+}
+
+void DisparityUpsampler::_upsampleRow(int _y)
+{
+	int lowWidth = m_Disparity.cols;
+	int lowHeight = m_Disparity.rows;
+	int width = m_Guide.cols;
+	short invalid = (short)(m_MinValid * m_Factor - STEREO_DISP_SCALE);
+
+	// rows past the last full block take its last phase
+	int by = std::min(_y / m_Factor, lowHeight - 1);
+	int py = std::min(_y - by * m_Factor, m_Factor - 1);
+	const short* disparity[3];
+	const uchar* lowGuide[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		int row = by + k - 1;
+		disparity[k] = row >= 0 && row < lowHeight ? m_Disparity.ptr<short>(row) : NULL;
+		lowGuide[k] = row >= 0 && row < lowHeight ? m_LowGuide.ptr<uchar>(row) : NULL;
+	}
+	const uchar* guide = m_Guide.ptr<uchar>(_y);
+	short* upsampled = m_Upsampled.ptr<short>(_y);
+
+	for (int x = 0; x < width; ++x)
+	{
+		int bx = std::min(x / m_Factor, lowWidth - 1);
+		int px = std::min(x - bx * m_Factor, m_Factor - 1);
+		const float* space = &m_SpaceTable[(py * m_Factor + px) * 9];
+		int value = guide[x];
+
+		float sum = 0.0f, sumWeights = 0.0f;
+		for (int ky = 0; ky < 3; ++ky)
+		{
+			if (!disparity[ky])
+			{
+				continue;
+			}
+			for (int kx = 0; kx < 3; ++kx)
+			{
+				int qx = bx + kx - 1;
+				if (qx < 0 || qx >= lowWidth || disparity[ky][qx] < m_MinValid)
+				{
+					continue;
+				}
+				float weight = space[ky * 3 + kx] * m_ColorTable[std::abs(value - lowGuide[ky][qx])];
+				sum += weight * disparity[ky][qx];
+				sumWeights += weight;
+			}
+		}
+		upsampled[x] = sumWeights > 0.0f ? cv::saturate_cast<short>(sum * m_Factor / sumWeights) : invalid;
+	}
+}
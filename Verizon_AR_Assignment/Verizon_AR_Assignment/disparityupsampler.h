@@ -0,0 +1,60 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <vector>
+#include "stereokernels.h"
+
+// Joint bilateral upsampling of a disparity matched at 1 / factor of the resolution.
+// Every full resolution pixel averages the valid disparities of the 3 x 3 low resolution pixels around
+// it, weighted by their distance and by how close the full resolution guide at the pixel is to the low
+// resolution guide at them, so the disparity edges follow the edges of the full resolution image instead
+// of the blocks of the low resolution one. The disparities are scaled to full resolution pixels.
+// The low resolution image covers the top left width / factor x height / factor blocks, the columns and
+// rows past them take the last block's neighbours. Bands of rows run in parallel.
+class DisparityUpsampler
+{
+public:
+	DisparityUpsampler(double _sigmaSpace = 1.0, double _sigmaColor = 12.0);
+	DisparityUpsampler(const DisparityUpsampler& _other) = default;
+	~DisparityUpsampler() = default;
+
+	// _disparity CV_16S with STEREO_DISP_SHIFT fractional bits, invalid below _minDisparity, _lowGuide the 8 bit
+	// grey image it was matched on and _guide the full resolution one. pixels without a valid neighbour come
+	// out below _minDisparity * _factor
+	void Upsample(const cv::Mat& _disparity, const cv::Mat& _lowGuide, const cv::Mat& _guide, int _factor, int _minDisparity, cv::Mat& _upsampled);
+
+	inline void SetSigmaSpace(double _value)		{ m_SigmaSpace = _value; }
+	inline void SetSigmaColor(double _value)		{ m_SigmaColor = _value; }
+
+	inline double GetSigmaSpace() const				{ return m_SigmaSpace; }
+	inline double GetSigmaColor() const				{ return m_SigmaColor; }
+
+private:
+	class BandBody : public cv::ParallelLoopBody
+	{
+	public:
+		BandBody(DisparityUpsampler* _upsampler, int _numBands) : m_Upsampler(_upsampler), m_NumBands(_numBands) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		DisparityUpsampler* m_Upsampler;
+		int m_NumBands;
+	};
+
+	void _upsampleRow(int _y);
+
+private:
+	double m_SigmaSpace;	// in low resolution pixels
+	double m_SigmaColor;	// in grey levels
+
+	// state of the frame being upsampled, shared with the band body
+	cv::Mat m_Disparity;
+	cv::Mat m_LowGuide;
+	cv::Mat m_Guide;
+	cv::Mat m_Upsampled;
+	int m_Factor;
+	short m_MinValid;
+
+	float m_ColorTable[256];
+	std::vector<float> m_SpaceTable;	// per phase of the pixel in its block, the weights of the 3 x 3 neighbours
+};
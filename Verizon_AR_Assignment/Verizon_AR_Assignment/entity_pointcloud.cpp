@@ -5,7 +5,7 @@ Entity_PointCloud::Entity_PointCloud()
 {
 }
 
-bool Entity_PointCloud::Initialize(OpenGLRenderer* _renderer, ColorShader::VertexType* _points, int _numPoints)
+bool Entity_PointCloud::Initialize(OpenGLRenderer* _renderer, const ColorShader::VertexType* _points, int _numPoints)
 {
 	bool result;
 
@@ -14,8 +14,41 @@ bool Entity_PointCloud::Initialize(OpenGLRenderer* _renderer, ColorShader::Verte
 	// Initialize the world/model matrix to the identity matrix.
 	Math::BuildIdentityMatrix(m_worldMatrix);
 
+	// Float positions are used as they are.
+	for (int i = 0; i < 3; ++i)
+	{
+		m_positionOffset[i] = 0.0f;
+		m_positionScale[i] = 1.0f;
+	}
+
+	// Initialize the vertex and index buffer that hold the geometry for the triangle.
+	result = _initializeBuffers(_points, _numPoints, false);
+	if (!result)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool Entity_PointCloud::Initialize(OpenGLRenderer* _renderer, const ColorShader::PackedVertexType* _points, int _numPoints, const float* _boundsMin, const float* _boundsMax)
+{
+	bool result;
+
+	m_Renderer = _renderer;
+
+	// Initialize the world/model matrix to the identity matrix.
+	Math::BuildIdentityMatrix(m_worldMatrix);
+
+	// The shader gets the normalized positions back into the bounding box.
+	for (int i = 0; i < 3; ++i)
+	{
+		m_positionOffset[i] = _boundsMin[i];
+		m_positionScale[i] = _boundsMax[i] - _boundsMin[i];
+	}
+
 	// Initialize the vertex and index buffer that hold the geometry for the triangle.
-	result = _initializeBuffers(_points, _numPoints);
+	result = _initializeBuffers(_points, _numPoints, true);
 	if (!result)
 	{
 		return false;
@@ -75,7 +108,9 @@ void Entity_PointCloud::Render(float* viewMatrix)
 
 	// set the shader stuff
 	m_Renderer->SetShader(GetShaderID());
-	static_cast<ColorShader*>(m_Renderer->GetShader(GetShaderID()))->SetShaderParameters(m_worldMatrix, viewMatrix, projectionMatrix);
+	ColorShader* shader = static_cast<ColorShader*>(m_Renderer->GetShader(GetShaderID()));
+	shader->SetShaderParameters(m_worldMatrix, viewMatrix, projectionMatrix);
+	shader->SetPositionDecode(m_positionOffset, m_positionScale);
 
 	// Put the vertex and index buffers on the graphics pipeline to prepare them for drawing.
 	_renderBuffers();
@@ -83,9 +118,10 @@ void Entity_PointCloud::Render(float* viewMatrix)
 	return;
 }
 
-bool Entity_PointCloud::_initializeBuffers(ColorShader::VertexType* points, int numPoints)
+bool Entity_PointCloud::_initializeBuffers(const void* points, int numPoints, bool packed)
 {
 	m_vertexCount = numPoints;
+	int vertexSize = packed ? sizeof(ColorShader::PackedVertexType) : sizeof(ColorShader::VertexType);
 	
 	// Allocate an OpenGL vertex array object.
 	m_Renderer->glGenVertexArrays(1, &m_vertexArrayId);
@@ -98,19 +134,31 @@ bool Entity_PointCloud::_initializeBuffers(ColorShader::VertexType* points, int
 
 	// Bind the vertex buffer and load the vertex (position and color) data into the vertex buffer.
 	m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
-	m_Renderer->glBufferData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(ColorShader::VertexType), points, GL_STATIC_DRAW);
+	m_Renderer->glBufferData(GL_ARRAY_BUFFER, m_vertexCount * vertexSize, points, GL_STATIC_DRAW);
 
 	// Enable the two vertex array attributes.
 	m_Renderer->glEnableVertexAttribArray(0);  // Vertex position.
 	m_Renderer->glEnableVertexAttribArray(1);  // Vertex color.
 
-	// Specify the location and format of the position portion of the vertex buffer.
-	m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
-	m_Renderer->glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(ColorShader::VertexType), 0);
+	if (packed)
+	{
+		// Packed positions and colors are normalized integers, the shader sees them as 0 to 1.
+		m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+		m_Renderer->glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, true, vertexSize, 0);
 
-	// Specify the location and format of the color portion of the vertex buffer.
-	m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
-	m_Renderer->glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(ColorShader::VertexType), (unsigned char*)(3 * sizeof(float)));
+		m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+		m_Renderer->glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, true, vertexSize, (unsigned char*)(4 * sizeof(unsigned short)));
+	}
+	else
+	{
+		// Specify the location and format of the position portion of the vertex buffer.
+		m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+		m_Renderer->glVertexAttribPointer(0, 3, GL_FLOAT, false, vertexSize, 0);
+
+		// Specify the location and format of the color portion of the vertex buffer.
+		m_Renderer->glBindBuffer(GL_ARRAY_BUFFER, m_vertexBufferId);
+		m_Renderer->glVertexAttribPointer(1, 3, GL_FLOAT, false, vertexSize, (unsigned char*)(3 * sizeof(float)));
+	}
 
 	return true;
 }
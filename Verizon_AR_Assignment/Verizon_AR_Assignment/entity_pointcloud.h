@@ -14,7 +14,9 @@ public:
 	Entity_PointCloud(const Entity_PointCloud& _other) = default;
 	~Entity_PointCloud() = default;
 
-	bool Initialize(OpenGLRenderer* _renderer, ColorShader::VertexType* _points, int _numPoints);
+	bool Initialize(OpenGLRenderer* _renderer, const ColorShader::VertexType* _points, int _numPoints);
+	// packed points with the bounding box ColorShader::PackVertices normalized them to
+	bool Initialize(OpenGLRenderer* _renderer, const ColorShader::PackedVertexType* _points, int _numPoints, const float* _boundsMin, const float* _boundsMax);
 
 	void Update();
 	void Shutdown();
@@ -31,7 +33,7 @@ public:
 	inline int GetShaderID() { return ColorShader::SHADER_ID; }
 
 private:
-	bool _initializeBuffers(ColorShader::VertexType*, int);
+	bool _initializeBuffers(const void*, int, bool);
 	void _shutdownBuffers();
 	void _renderBuffers();
 
@@ -40,6 +42,7 @@ private:
 	float m_rotationX, m_rotationY, m_rotationZ;
 	float m_worldMatrix[16];
 	int m_vertexCount;
+	float m_positionOffset[3], m_positionScale[3];
 	unsigned int m_vertexArrayId, m_vertexBufferId;
 
 	OpenGLRenderer* m_Renderer;
@@ -0,0 +1,286 @@
+#include "patchmatchmatcher.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+const float PatchMatchMatcher::PATCHMATCH_MAX_SLOPE = 1.0f;
+const float PatchMatchMatcher::PATCHMATCH_GAMMA = 10.0f;
+const float PatchMatchMatcher::PATCHMATCH_ALPHA = 0.9f;
+const float PatchMatchMatcher::PATCHMATCH_MAX_GREY_COST = 10.0f;
+const float PatchMatchMatcher::PATCHMATCH_MAX_GRADIENT_COST = 2.0f;
+
+cv::Ptr<PatchMatchMatcher> PatchMatchMatcher::create(int _minDisparity, int _numDisparities, int _blockSize, int _iterations)
+{
+	return cv::makePtr<PatchMatchMatcher>(_minDisparity, _numDisparities, _blockSize, _iterations);
+}
+
+PatchMatchMatcher::PatchMatchMatcher(int _minDisparity, int _numDisparities, int _blockSize, int _iterations)
+	: m_MinDisparity(_minDisparity), m_NumDisparities(_numDisparities), m_BlockSize(_blockSize), m_Iterations(_iterations)
+{
+	m_SpeckleWindowSize = 0;
+	// neighbours on a slanted plane differ by up to PATCHMATCH_MAX_SLOPE, a speckle range of 0 would split every slope
+	m_SpeckleRange = 1;
+	m_Disp12MaxDiff = -1;
+
+	m_Weights.resize(256);
+	for (int i = 0; i < 256; ++i)
+	{
+		m_Weights[i] = expf(-i / PATCHMATCH_GAMMA);
+	}
+}
+
+void PatchMatchMatcher::compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity)
+{
+	m_Left = _left.getMat();
+	m_Right = _right.getMat();
+
+	if (m_Left.type() != CV_8UC1 || m_Right.type() != CV_8UC1 || m_Left.size() != m_Right.size())
+	{
+		throw "PatchMatch matcher needs two greyscale images of the same size";
+	}
+	if (m_BlockSize < 3 || m_BlockSize % 2 == 0)
+	{
+		throw "Block size must be odd and at least 3";
+	}
+	if (m_NumDisparities < 1 || m_Iterations < 1)
+	{
+		throw "PatchMatch matcher needs a disparity range and at least one iteration";
+	}
+
+	int height = m_Left.rows;
+	m_LeftGradient.create(m_Left.size(), CV_32F);
+	m_RightGradient.create(m_Left.size(), CV_32F);
+	m_Planes.create(m_Left.size(), CV_32FC3);
+	m_Cost.create(m_Left.size(), CV_32F);
+	cv::parallel_for_(cv::Range(0, height), PassBody(this, PATCHMATCH_PASS::PATCHMATCH_PASS_GRADIENT));
+	cv::parallel_for_(cv::Range(0, height), PassBody(this, PATCHMATCH_PASS::PATCHMATCH_PASS_INITIALIZE));
+
+	// each colour only reads the planes of the other one, so its rows can be updated in any order
+	for (int iteration = 0; iteration < m_Iterations; ++iteration)
+	{
+		for (int colour = 0; colour < 2; ++colour)
+		{
+			cv::parallel_for_(cv::Range(0, height), PassBody(this, PATCHMATCH_PASS::PATCHMATCH_PASS_PROPAGATE, iteration, colour));
+		}
+	}
+
+	_disparity.create(m_Left.size(), CV_16S);
+	m_Disparity = _disparity.getMat();
+	cv::parallel_for_(cv::Range(0, height), PassBody(this, PATCHMATCH_PASS::PATCHMATCH_PASS_OUTPUT));
+
+	if (m_SpeckleWindowSize > 0)
+	{
+		cv::filterSpeckles(m_Disparity, StereoInvalidDisparity(m_MinDisparity), m_SpeckleWindowSize, m_SpeckleRange * STEREO_DISP_SCALE, m_SpeckleBuffer);
+	}
+
+	// the frame is only referenced while matching
+	m_Left.release();
+	m_Right.release();
+	m_Disparity.release();
+}
+
+void PatchMatchMatcher::PassBody::operator()(const cv::Range& _range) const
+{
+	for (int y = _range.start; y < _range.end; ++y)
+	{
+		switch (m_Pass)
+		{
+		case PATCHMATCH_PASS::PATCHMATCH_PASS_GRADIENT:
+			m_Matcher->_gradientRow(y);
+			break;
+		case PATCHMATCH_PASS::PATCHMATCH_PASS_INITIALIZE:
+			m_Matcher->_initializeRow(y);
+			break;
+		case PATCHMATCH_PASS::PATCHMATCH_PASS_PROPAGATE:
+			m_Matcher->_propagateRow(y, m_Iteration, m_Colour);
+			break;
+		case PATCHMATCH_PASS::PATCHMATCH_PASS_OUTPUT:
+			m_Matcher->_outputRow(y);
+			break;
+		}
+	}
+}
+
+void PatchMatchMatcher::_gradientRow(int _y)
+{
+	// central differences, one sided at the borders
+	int width = m_Left.cols;
+	const uchar* images[2] = { m_Left.ptr<uchar>(_y), m_Right.ptr<uchar>(_y) };
+	float* gradients[2] = { m_LeftGradient.ptr<float>(_y), m_RightGradient.ptr<float>(_y) };
+	for (int i = 0; i < 2; ++i)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			int previous = std::max(x - 1, 0);
+			int next = std::min(x + 1, width - 1);
+			gradients[i][x] = next > previous ? (images[i][next] - images[i][previous]) / (float)(next - previous) : 0.0f;
+		}
+	}
+}
+
+void PatchMatchMatcher::_initializeRow(int _y)
+{
+	// random disparity and a slant close to fronto-parallel, a random slant up to the limit almost never fits
+	// a window. seeded by the row so the result does not depend on the threads
+	cv::RNG rng((uint64)(_y + 1) * 0x9E3779B97F4A7C15ULL);
+	int width = m_Left.cols;
+	cv::Vec3f* planes = m_Planes.ptr<cv::Vec3f>(_y);
+	float* cost = m_Cost.ptr<float>(_y);
+	for (int x = 0; x < width; ++x)
+	{
+		float disparity = rng.uniform((float)m_MinDisparity, (float)(m_MinDisparity + m_NumDisparities - 1));
+		float a = rng.uniform(-PATCHMATCH_MAX_SLOPE, PATCHMATCH_MAX_SLOPE) * 0.1f;
+		float b = rng.uniform(-PATCHMATCH_MAX_SLOPE, PATCHMATCH_MAX_SLOPE) * 0.1f;
+		planes[x] = cv::Vec3f(a, b, disparity - a * x - b * _y);
+		cost[x] = _planeCost(x, _y, planes[x], FLT_MAX);
+	}
+}
+
+void PatchMatchMatcher::_propagateRow(int _y, int _iteration, int _colour)
+{
+	cv::RNG rng(((uint64)(_iteration * 2 + _colour + 1) << 32) + (uint64)(_y + 1) * 0x9E3779B97F4A7C15ULL);
+	int width = m_Left.cols;
+	int height = m_Left.rows;
+	cv::Vec3f* planes = m_Planes.ptr<cv::Vec3f>(_y);
+	float* cost = m_Cost.ptr<float>(_y);
+	const int offsets[8][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+		{ -PATCHMATCH_FAR_NEIGHBOUR, 0 }, { PATCHMATCH_FAR_NEIGHBOUR, 0 }, { 0, -PATCHMATCH_FAR_NEIGHBOUR }, { 0, PATCHMATCH_FAR_NEIGHBOUR } };
+
+	// the perturbations shrink with every iteration and every step of one
+	float depthRange = m_NumDisparities * 0.25f / (float)(1 << std::min(_iteration, 16));
+	float normalRange = 0.5f / (float)(1 << std::min(_iteration, 16));
+
+	for (int x = (_y + _colour) & 1; x < width; x += 2)
+	{
+		cv::Vec3f best = planes[x];
+		float bestCost = cost[x];
+
+		// spatial propagation from the other colour
+		for (int i = 0; i < 8; ++i)
+		{
+			int nx = x + offsets[i][0];
+			int ny = _y + offsets[i][1];
+			if (nx < 0 || nx >= width || ny < 0 || ny >= height)
+			{
+				continue;
+			}
+			const cv::Vec3f& candidate = m_Planes.ptr<cv::Vec3f>(ny)[nx];
+			if (candidate == best)
+			{
+				continue;
+			}
+			float candidateCost = _planeCost(x, _y, candidate, bestCost);
+			if (candidateCost < bestCost)
+			{
+				best = candidate;
+				bestCost = candidateCost;
+			}
+		}
+
+		// random refinement around the best plane, as its disparity at the pixel and its unit normal
+		float dz = depthRange;
+		float dn = normalRange;
+		for (int step = 0; step < PATCHMATCH_REFINE_STEPS; ++step, dz *= 0.25f, dn *= 0.5f)
+		{
+			float scale = 1.0f / sqrtf(best[0] * best[0] + best[1] * best[1] + 1.0f);
+			float nx = -best[0] * scale + rng.uniform(-dn, dn);
+			float ny = -best[1] * scale + rng.uniform(-dn, dn);
+			float nz = scale + rng.uniform(-dn, dn);
+			if (nz <= 0.0f)
+			{
+				continue;
+			}
+			float disparity = best[0] * x + best[1] * _y + best[2] + rng.uniform(-dz, dz);
+			cv::Vec3f candidate(-nx / nz, -ny / nz, 0.0f);
+			candidate[2] = disparity - candidate[0] * x - candidate[1] * _y;
+			_clampPlane(candidate, x, _y);
+
+			float candidateCost = _planeCost(x, _y, candidate, bestCost);
+			if (candidateCost < bestCost)
+			{
+				best = candidate;
+				bestCost = candidateCost;
+			}
+		}
+
+		planes[x] = best;
+		cost[x] = bestCost;
+	}
+}
+
+void PatchMatchMatcher::_outputRow(int _y)
+{
+	// the plane's disparity at the pixel, invalid where it leaves the range or the right image
+	int width = m_Left.cols;
+	short invalid = StereoInvalidDisparity(m_MinDisparity);
+	float maxDisparity = (float)(m_MinDisparity + m_NumDisparities - 1);
+	const cv::Vec3f* planes = m_Planes.ptr<cv::Vec3f>(_y);
+	short* disparity = m_Disparity.ptr<short>(_y);
+	for (int x = 0; x < width; ++x)
+	{
+		float d = planes[x][0] * x + planes[x][1] * _y + planes[x][2];
+		bool valid = d >= m_MinDisparity && d <= maxDisparity && x - d >= 0.0f;
+		disparity[x] = valid ? (short)cvRound(d * STEREO_DISP_SCALE) : invalid;
+	}
+}
+
+float PatchMatchMatcher::_planeCost(int _x, int _y, const cv::Vec3f& _plane, float _bound) const
+{
+	int width = m_Left.cols;
+	int height = m_Left.rows;
+	int radius = m_BlockSize / 2;
+	int xBegin = std::max(_x - radius, 0);
+	int xEnd = std::min(_x + radius + 1, width);
+	int yEnd = std::min(_y + radius + 1, height);
+	int centre = m_Left.ptr<uchar>(_y)[_x];
+	const float outsideCost = (1.0f - PATCHMATCH_ALPHA) * PATCHMATCH_MAX_GREY_COST + PATCHMATCH_ALPHA * PATCHMATCH_MAX_GRADIENT_COST;
+
+	// adaptive support weights, window pixels that look like the centre count more
+	float cost = 0.0f;
+	for (int y = std::max(_y - radius, 0); y < yEnd; ++y)
+	{
+		const uchar* left = m_Left.ptr<uchar>(y);
+		const uchar* right = m_Right.ptr<uchar>(y);
+		const float* leftGradient = m_LeftGradient.ptr<float>(y);
+		const float* rightGradient = m_RightGradient.ptr<float>(y);
+		float rowDisparity = _plane[1] * y + _plane[2];
+		for (int x = xBegin; x < xEnd; ++x)
+		{
+			float weight = m_Weights[abs(left[x] - centre)];
+			float xr = x - (_plane[0] * x + rowDisparity);
+			if (xr < 0.0f || xr > (float)(width - 1))
+			{
+				cost += weight * outsideCost;
+				continue;
+			}
+
+			// linear interpolation between the two right pixels around the match
+			int x0 = (int)xr;
+			int x1 = std::min(x0 + 1, width - 1);
+			float fraction = xr - x0;
+			float grey = right[x0] + fraction * (right[x1] - right[x0]);
+			float gradient = rightGradient[x0] + fraction * (rightGradient[x1] - rightGradient[x0]);
+			float greyCost = std::min(fabsf(left[x] - grey), PATCHMATCH_MAX_GREY_COST);
+			float gradientCost = std::min(fabsf(leftGradient[x] - gradient), PATCHMATCH_MAX_GRADIENT_COST);
+			cost += weight * ((1.0f - PATCHMATCH_ALPHA) * greyCost + PATCHMATCH_ALPHA * gradientCost);
+		}
+
+		// every term is positive, a plane already above the bound can not win anymore
+		if (cost >= _bound)
+		{
+			return cost;
+		}
+	}
+	return cost;
+}
+
+void PatchMatchMatcher::_clampPlane(cv::Vec3f& _plane, int _x, int _y) const
+{
+	// keep the slant bounded and the disparity at the pixel inside the range
+	float disparity = _plane[0] * _x + _plane[1] * _y + _plane[2];
+	_plane[0] = std::min(std::max(_plane[0], -PATCHMATCH_MAX_SLOPE), PATCHMATCH_MAX_SLOPE);
+	_plane[1] = std::min(std::max(_plane[1], -PATCHMATCH_MAX_SLOPE), PATCHMATCH_MAX_SLOPE);
+	disparity = std::min(std::max(disparity, (float)m_MinDisparity), (float)(m_MinDisparity + m_NumDisparities - 1));
+	_plane[2] = disparity - _plane[0] * _x - _plane[1] * _y;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <vector>
+#include "stereokernels.h"
+
+// PatchMatch stereo with slanted support windows, after Bleyer et al., PatchMatch Stereo - Stereo Matching with
+// Slanted Support Windows. Every pixel holds a plane d = a * x + b * y + c rather than a disparity, and its cost
+// is the adaptive support weight window of the left pixels the plane maps into the right image at sub-pixel
+// positions, so floors and walls match with windows that follow their slant.
+// The planes start random and each iteration tries the planes of the neighbours and a few random perturbations
+// of the pixel's own plane. Pixels are updated in a red-black checkerboard, first the pixels with x + y even and
+// then the odd ones, so the pixels of one colour only read the other one and every row of a colour can be
+// updated in parallel. The neighbours are the four at distance 1 and the four at PATCHMATCH_FAR_NEIGHBOUR, both
+// of the other colour, the far ones carry good planes across the image in fewer iterations.
+// The work per iteration is a fixed number of window costs per pixel whatever the disparity range.
+class PatchMatchMatcher : public cv::StereoMatcher
+{
+public:
+	static cv::Ptr<PatchMatchMatcher> create(int _minDisparity = 0, int _numDisparities = 64, int _blockSize = 9, int _iterations = PATCHMATCH_ITERATIONS);
+
+	PatchMatchMatcher(int _minDisparity, int _numDisparities, int _blockSize, int _iterations);
+	PatchMatchMatcher(const PatchMatchMatcher& _other) = default;
+	~PatchMatchMatcher() = default;
+
+	void compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity);
+
+	inline int getMinDisparity() const						{ return m_MinDisparity; }
+	inline void setMinDisparity(int _value)					{ m_MinDisparity = _value; }
+	inline int getNumDisparities() const					{ return m_NumDisparities; }
+	inline void setNumDisparities(int _value)				{ m_NumDisparities = _value; }
+	inline int getBlockSize() const							{ return m_BlockSize; }
+	inline void setBlockSize(int _value)					{ m_BlockSize = _value; }
+	inline int getSpeckleWindowSize() const					{ return m_SpeckleWindowSize; }
+	inline void setSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
+	inline int getSpeckleRange() const						{ return m_SpeckleRange; }
+	inline void setSpeckleRange(int _value)					{ m_SpeckleRange = _value; }
+	inline int getDisp12MaxDiff() const						{ return m_Disp12MaxDiff; }
+	inline void setDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; }
+	inline int getIterations() const						{ return m_Iterations; }
+	inline void setIterations(int _value)					{ m_Iterations = _value; }
+
+	static const int PATCHMATCH_ITERATIONS = 4;			// red-black sweeps over the image
+	static const int PATCHMATCH_REFINE_STEPS = 4;		// random perturbations of a pixel's plane per iteration
+	static const int PATCHMATCH_FAR_NEIGHBOUR = 3;		// odd, so the far neighbours are of the other colour too
+	static const float PATCHMATCH_MAX_SLOPE;			// disparity change per pixel a plane may have along x or y
+	static const float PATCHMATCH_GAMMA;				// grey difference at which a window pixel's weight drops to 1 / e
+	static const float PATCHMATCH_ALPHA;				// share of the gradient in the pixel dissimilarity
+	static const float PATCHMATCH_MAX_GREY_COST;		// truncation of the grey difference
+	static const float PATCHMATCH_MAX_GRADIENT_COST;	// truncation of the gradient difference
+
+private:
+	enum class PATCHMATCH_PASS { PATCHMATCH_PASS_GRADIENT, PATCHMATCH_PASS_INITIALIZE, PATCHMATCH_PASS_PROPAGATE, PATCHMATCH_PASS_OUTPUT };
+
+	// runs one pass over a range of rows, the propagation pass only updates the pixels of one colour
+	class PassBody : public cv::ParallelLoopBody
+	{
+	public:
+		PassBody(PatchMatchMatcher* _matcher, PATCHMATCH_PASS _pass, int _iteration = 0, int _colour = 0)
+			: m_Matcher(_matcher), m_Pass(_pass), m_Iteration(_iteration), m_Colour(_colour) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		PatchMatchMatcher* m_Matcher;
+		PATCHMATCH_PASS m_Pass;
+		int m_Iteration;
+		int m_Colour;
+	};
+
+	void _gradientRow(int _y);
+	void _initializeRow(int _y);
+	void _propagateRow(int _y, int _iteration, int _colour);
+	void _outputRow(int _y);
+	// weighted window cost of a plane at a pixel, stops early once it is no longer below _bound
+	float _planeCost(int _x, int _y, const cv::Vec3f& _plane, float _bound) const;
+	void _clampPlane(cv::Vec3f& _plane, int _x, int _y) const;
+
+private:
+	int m_MinDisparity;
+	int m_NumDisparities;
+	int m_BlockSize;
+	int m_SpeckleWindowSize;
+	int m_SpeckleRange;
+	int m_Disp12MaxDiff;	// not used, only the left view is matched
+	int m_Iterations;
+
+	// the frame being matched
+	cv::Mat m_Left;
+	cv::Mat m_Right;
+	cv::Mat m_Disparity;
+
+	// kept between calls so a stream of same sized frames does not allocate
+	cv::Mat m_LeftGradient;		// 32F horizontal gradients
+	cv::Mat m_RightGradient;
+	cv::Mat m_Planes;			// 32FC3 a, b, c of every pixel's plane
+	cv::Mat m_Cost;				// 32F window cost of the planes
+	std::vector<float> m_Weights;	// window weight of every grey difference to the centre
+	cv::Mat m_SpeckleBuffer;
+};
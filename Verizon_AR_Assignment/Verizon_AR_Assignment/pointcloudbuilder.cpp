@@ -0,0 +1,203 @@
+#include "pointcloudbuilder.h"
+#include <algorithm>
+#include <float.h>
+
+PointCloudBuilder::PointCloudBuilder()
+{
+	SetNormalization(1.0f, 1.0f, 1.0f, 0.0f);
+	m_ConfidenceThreshold = 0;
+	m_MinValid = 0;
+	m_UseDepthTable = false;
+	m_NumBands = 0;
+}
+
+void PointCloudBuilder::SetNormalization(float _xScale, float _yScale, float _zScale, float _depthOffset)
+{
+	m_Scale[0] = _xScale;
+	m_Scale[1] = _yScale;
+	m_Scale[2] = _zScale;
+	m_DepthOffset = _depthOffset;
+}
+
+void PointCloudBuilder::FitToExtent(cv::Size _size, float _nearDepth, float _extent, float _depthOffset)
+{
+	SetNormalization(_extent / _size.width, _extent / _size.height, _extent / _nearDepth, _depthOffset);
+}
+
+int PointCloudBuilder::Count(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat& _q, int _minDisparity, int _numDisparities)
+{
+	_prepare(_disparity, _confidence, NULL, _q, _minDisparity, _numDisparities);
+	int numVertices = _countRows();
+	m_Disparity.release();
+	m_Confidence.release();
+	return numVertices;
+}
+
+PointCloudBuilder::Statistics PointCloudBuilder::Build(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat& _color, const cv::Mat& _q, int _minDisparity, int _numDisparities, ColorShader::VertexType* _vertices)
+{
+	_prepare(_disparity, _confidence, &_color, _q, _minDisparity, _numDisparities);
+	_countRows();
+	cv::parallel_for_(cv::Range(0, m_NumBands), BandBody(this, _vertices));
+	return _gatherStatistics();
+}
+
+const ColorShader::VertexType* PointCloudBuilder::Build(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat& _color, const cv::Mat& _q, int _minDisparity, int _numDisparities, Statistics& _statistics)
+{
+	_prepare(_disparity, _confidence, &_color, _q, _minDisparity, _numDisparities);
+	m_Vertices.resize(_countRows());
+	cv::parallel_for_(cv::Range(0, m_NumBands), BandBody(this, m_Vertices.data()));
+	_statistics = _gatherStatistics();
+	return m_Vertices.data();
+}
+
+void PointCloudBuilder::BandBody::operator()(const cv::Range& _range) const
+{
+	for (int band = _range.start; band < _range.end; ++band)
+	{
+		m_Builder->_processBand(band, m_Vertices);
+	}
+}
+
+void PointCloudBuilder::_prepare(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat* _color, const cv::Mat& _q, int _minDisparity, int _numDisparities)
+{
+	if (_disparity.type() != CV_16S)
+	{
+		throw "Point cloud needs the raw CV_16S disparity";
+	}
+	if (_color && (_color->type() != CV_8UC3 || _color->size() != _disparity.size()))
+	{
+		throw "Point cloud needs an 8 bit colour image the size of the disparity";
+	}
+	if (!_confidence.empty() && (_confidence.type() != CV_8UC1 || _confidence.size() != _disparity.size()))
+	{
+		throw "Point cloud needs an 8 bit confidence the size of the disparity";
+	}
+	if (_q.rows != 4 || _q.cols != 4 || _q.type() != CV_64F)
+	{
+		throw "Point cloud needs a 4x4 CV_64F Q matrix";
+	}
+
+	m_Disparity = _disparity;
+	m_Color = _color ? *_color : cv::Mat();
+	m_Confidence = m_ConfidenceThreshold > 0 ? _confidence : cv::Mat();
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			m_Q[i][j] = _q.at<double>(i, j);
+		}
+	}
+	m_MinValid = (short)(_minDisparity * STEREO_DISP_SCALE);
+	m_UseDepthTable = m_DepthTable.Update(m_Q, _minDisparity, _numDisparities);
+
+	// a few bands per core, rows differ in their share of valid pixels
+	m_NumBands = std::min(_disparity.rows, std::max(cv::getNumThreads(), 1) * 4);
+	m_BandBounds.resize(m_NumBands * 6);
+}
+
+int PointCloudBuilder::_countRows()
+{
+	int height = m_Disparity.rows;
+	m_RowOffsets.assign(height + 1, 0);
+	cv::parallel_for_(cv::Range(0, m_NumBands), BandBody(this, NULL));
+	for (int y = 0; y < height; ++y)
+	{
+		m_RowOffsets[y + 1] += m_RowOffsets[y];
+	}
+	return m_RowOffsets[height];
+}
+
+void PointCloudBuilder::_processBand(int _band, ColorShader::VertexType* _vertices)
+{
+	int height = m_Disparity.rows;
+	int width = m_Disparity.cols;
+	int yBegin = height * _band / m_NumBands;
+	int yEnd = height * (_band + 1) / m_NumBands;
+	const StereoKernels& kernels = GetStereoKernels();
+	short invalid = (short)(m_MinValid - STEREO_DISP_SCALE);
+	cv::AutoBuffer<short> masked(m_Confidence.empty() ? 1 : width);
+
+	float* bounds = &m_BandBounds[_band * 6];
+	for (int i = 0; i < 3; ++i)
+	{
+		bounds[i] = FLT_MAX;
+		bounds[3 + i] = -FLT_MAX;
+	}
+
+	for (int y = yBegin; y < yEnd; ++y)
+	{
+		// row y of the flipped disparity, the coordinates reprojectImageTo3D would see on it
+		int sourceY = height - y - 1;
+		const short* disparity = m_Disparity.ptr<short>(sourceY);
+		if (!m_Confidence.empty())
+		{
+			// the kernel sees the pixels below the threshold as invalid, they take no space in the output
+			const uchar* confidence = m_Confidence.ptr<uchar>(sourceY);
+			for (int x = 0; x < width; ++x)
+			{
+				masked[x] = confidence[x] < m_ConfidenceThreshold ? invalid : disparity[x];
+			}
+			disparity = masked;
+		}
+
+		StereoReprojectRow row;
+		float* coefficients[4] = { row.m_X, row.m_Y, row.m_Z, row.m_W };
+		for (int i = 0; i < 4; ++i)
+		{
+			double scale = i < 3 ? m_Scale[i] : 1.0;
+			coefficients[i][0] = (float)(scale * m_Q[i][0]);
+			coefficients[i][1] = (float)(scale * m_Q[i][2] / STEREO_DISP_SCALE);
+			coefficients[i][2] = (float)(scale * (m_Q[i][1] * y + m_Q[i][3]));
+		}
+		row.m_DepthOffset = m_DepthOffset;
+		row.m_InverseW = m_UseDepthTable ? m_DepthTable.GetInverseW() : NULL;
+		row.m_InverseWSize = m_UseDepthTable ? m_DepthTable.GetSize() : 0;
+
+		if (!_vertices)
+		{
+			m_RowOffsets[y + 1] = kernels.ReprojectRowToVertices(disparity, NULL, width, m_MinValid, row, NULL);
+			continue;
+		}
+
+		// the row's vertices are still in cache for the bounds
+		ColorShader::VertexType* first = &_vertices[m_RowOffsets[y]];
+		int count = kernels.ReprojectRowToVertices(disparity, m_Color.ptr<uchar>(sourceY), width, m_MinValid, row, &first->x);
+		for (int v = 0; v < count; ++v)
+		{
+			const float* position = &first[v].x;
+			for (int i = 0; i < 3; ++i)
+			{
+				bounds[i] = std::min(bounds[i], position[i]);
+				bounds[3 + i] = std::max(bounds[3 + i], position[i]);
+			}
+		}
+	}
+}
+
+PointCloudBuilder::Statistics PointCloudBuilder::_gatherStatistics()
+{
+	Statistics statistics;
+	statistics.m_NumVertices = m_RowOffsets[m_Disparity.rows];
+	statistics.m_NumPixels = m_Disparity.rows * m_Disparity.cols;
+	for (int i = 0; i < 3; ++i)
+	{
+		statistics.m_BoundsMin[i] = FLT_MAX;
+		statistics.m_BoundsMax[i] = -FLT_MAX;
+		for (int band = 0; band < m_NumBands; ++band)
+		{
+			statistics.m_BoundsMin[i] = std::min(statistics.m_BoundsMin[i], m_BandBounds[band * 6 + i]);
+			statistics.m_BoundsMax[i] = std::max(statistics.m_BoundsMax[i], m_BandBounds[band * 6 + 3 + i]);
+		}
+		if (statistics.m_NumVertices == 0)
+		{
+			statistics.m_BoundsMin[i] = 0.0f;
+			statistics.m_BoundsMax[i] = 0.0f;
+		}
+	}
+
+	// the frame is only referenced while building
+	m_Disparity.release();
+	m_Color.release();
+	m_Confidence.release();
+	return statistics;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <vector>
+#include "stereokernels.h"
+#include "depthtable.h"
+#include "colorshader.h"
+
+// Point vertices straight from a raw disparity map.
+// Every pixel with a valid disparity, and a confidence at or above the threshold when one is set, is
+// reprojected through Q, its position scaled per axis and offset in depth by the normalization, and
+// coloured from the matching pixel of the colour image. The rows come out bottom first, like a flipped
+// reprojectImageTo3D, and compacted in order: the kept pixels of every row are counted first, their
+// prefix sums give each row its place in the output, and the rows are then written in parallel in bands
+// on the SIMD reprojection kernel. With a Q in rectified form the rows carry a DepthTable of 1 / W over the
+// disparity range, kept while Q and the range stay the same, that the scalar kernel looks up instead of dividing.
+class PointCloudBuilder
+{
+public:
+	struct Statistics
+	{
+		int m_NumVertices;
+		int m_NumPixels;
+		float m_BoundsMin[3];	// of the normalized positions, 0 when there are no vertices
+		float m_BoundsMax[3];
+	};
+
+	PointCloudBuilder();
+	PointCloudBuilder(const PointCloudBuilder& _other) = default;
+	~PointCloudBuilder() = default;
+
+	// reprojected positions are multiplied by _scale per axis, then _depthOffset is added to z
+	void SetNormalization(float _xScale, float _yScale, float _zScale, float _depthOffset);
+	// a disparity of _size fills _extent across and down, the depth of the largest disparity is _extent deep
+	void FitToExtent(cv::Size _size, float _nearDepth, float _extent, float _depthOffset);
+
+	// pixels whose 8 bit confidence is below the threshold are left out like invalid ones, 0 keeps every valid pixel
+	inline void SetConfidenceThreshold(int _value)	{ m_ConfidenceThreshold = _value; }
+
+	// _disparity CV_16S with STEREO_DISP_SHIFT fractional bits, invalid below _minDisparity and matched over
+	// _numDisparities, _confidence 8 bit of the same size or empty, _color 8 bit BGR of the same size. the first
+	// writes into _vertices, which must hold Count vertices, the second into storage the builder keeps between calls and only grows, valid until the next Build
+	int Count(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat& _q, int _minDisparity, int _numDisparities);
+	Statistics Build(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat& _color, const cv::Mat& _q, int _minDisparity, int _numDisparities, ColorShader::VertexType* _vertices);
+	const ColorShader::VertexType* Build(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat& _color, const cv::Mat& _q, int _minDisparity, int _numDisparities, Statistics& _statistics);
+
+	inline const float* GetScale() const		{ return m_Scale; }
+	inline float GetDepthOffset() const			{ return m_DepthOffset; }
+	inline int GetConfidenceThreshold() const	{ return m_ConfidenceThreshold; }
+
+private:
+	// counts or writes the rows of bands, a band also keeps the bounds of the vertices it wrote
+	class BandBody : public cv::ParallelLoopBody
+	{
+	public:
+		BandBody(PointCloudBuilder* _builder, ColorShader::VertexType* _vertices)
+			: m_Builder(_builder), m_Vertices(_vertices)
+		{
+		}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		PointCloudBuilder* m_Builder;
+		ColorShader::VertexType* m_Vertices;
+	};
+
+	void _prepare(const cv::Mat& _disparity, const cv::Mat& _confidence, const cv::Mat* _color, const cv::Mat& _q, int _minDisparity, int _numDisparities);
+	int _countRows();
+	void _processBand(int _band, ColorShader::VertexType* _vertices);
+	Statistics _gatherStatistics();
+
+private:
+	float m_Scale[3];
+	float m_DepthOffset;
+	int m_ConfidenceThreshold;
+
+	// the frame being built
+	cv::Mat m_Disparity;
+	cv::Mat m_Color;
+	cv::Mat m_Confidence;	// empty without a threshold
+	double m_Q[4][4];
+	short m_MinValid;
+	bool m_UseDepthTable;
+	int m_NumBands;
+
+	std::vector<int> m_RowOffsets;	// first vertex of every row, the count of the row before the prefix sum
+	std::vector<float> m_BandBounds;	// min xyz and max xyz per band
+	std::vector<ColorShader::VertexType> m_Vertices;	// reused by Build without a buffer
+	DepthTable m_DepthTable;	// 1 / W over the range for a rectified Q
+};
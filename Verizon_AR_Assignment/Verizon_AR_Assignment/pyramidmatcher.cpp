@@ -0,0 +1,149 @@
+#include "pyramidmatcher.h"
+#include <algorithm>
+#include <limits.h>
+
+static int _floorShift(int _value, int _shift)
+{
+	return _value >= 0 ? _value >> _shift : -((-_value + (1 << _shift) - 1) >> _shift);
+}
+
+cv::Ptr<PyramidMatcher> PyramidMatcher::create(cv::Ptr<cv::StereoMatcher> _coarseMatcher, int _minDisparity, int _numDisparities, int _blockSize, int _levels)
+{
+	return cv::makePtr<PyramidMatcher>(_coarseMatcher, _minDisparity, _numDisparities, _blockSize, _levels);
+}
+
+PyramidMatcher::PyramidMatcher(cv::Ptr<cv::StereoMatcher> _coarseMatcher, int _minDisparity, int _numDisparities, int _blockSize, int _levels)
+	: m_CoarseMatcher(_coarseMatcher), m_MinDisparity(_minDisparity), m_NumDisparities(_numDisparities), m_BlockSize(_blockSize), m_Levels(_levels)
+{
+	m_SpeckleWindowSize = 0;
+	m_SpeckleRange = 0;
+	m_Disp12MaxDiff = -1;
+	m_UniquenessRatio = 0;
+}
+
+void PyramidMatcher::CoarseRange(int _minDisparity, int _numDisparities, int _levels, int& _coarseMinDisparity, int& _coarseNumDisparities)
+{
+	// the band on the finer levels reaches past the last whole coarse disparity
+	_coarseMinDisparity = _floorShift(_minDisparity, _levels);
+	int coarseMax = _floorShift(_minDisparity + _numDisparities - 1, _levels);
+	_coarseNumDisparities = std::max((coarseMax - _coarseMinDisparity + 16) / 16 * 16, 16);
+}
+
+void PyramidMatcher::compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity)
+{
+	cv::Mat left = _left.getMat();
+	cv::Mat right = _right.getMat();
+
+	if (left.type() != CV_8UC1 || right.type() != CV_8UC1 || left.size() != right.size())
+	{
+		throw "Pyramid matcher needs two greyscale images of the same size";
+	}
+	if (m_Levels < 1)
+	{
+		throw "Pyramid matcher needs at least one coarser level";
+	}
+	if (m_BlockSize < 3 || m_BlockSize % 2 == 0)
+	{
+		throw "Block size must be odd and at least 3";
+	}
+
+	m_LeftLevels.resize(m_Levels + 1);
+	m_RightLevels.resize(m_Levels + 1);
+	m_Disparities.resize(m_Levels + 1);
+	m_LeftLevels[0] = left;
+	m_RightLevels[0] = right;
+	for (int level = 1; level <= m_Levels; ++level)
+	{
+		cv::pyrDown(m_LeftLevels[level - 1], m_LeftLevels[level]);
+		cv::pyrDown(m_RightLevels[level - 1], m_RightLevels[level]);
+	}
+
+	// whole range on the coarsest level
+	m_CoarseMatcher->compute(m_LeftLevels[m_Levels], m_RightLevels[m_Levels], m_Disparities[m_Levels]);
+
+	// narrow bands on the way up, the output level writes straight into _disparity
+	_disparity.create(left.size(), CV_16S);
+	m_Disparities[0] = _disparity.getMat();
+	for (int level = m_Levels - 1; level >= 0; --level)
+	{
+		cv::Size size = m_LeftLevels[level].size();
+		m_Disparities[level].create(size, CV_16S);
+		m_Prediction.create(size, CV_16S);
+
+		int numBands = std::min(size.height, std::max(cv::getNumThreads(), 1) * 4);
+		cv::parallel_for_(cv::Range(0, size.height), RefineBody(this, level, 0));
+		cv::parallel_for_(cv::Range(0, numBands), RefineBody(this, level, numBands));
+	}
+
+	if (m_SpeckleWindowSize > 0)
+	{
+		cv::filterSpeckles(m_Disparities[0], StereoInvalidDisparity(m_MinDisparity), m_SpeckleWindowSize, m_SpeckleRange * STEREO_DISP_SCALE, m_SpeckleBuffer);
+	}
+}
+
+void PyramidMatcher::RefineBody::operator()(const cv::Range& _range) const
+{
+	// without bands the range is rows of the prediction
+	int height = m_Matcher->m_Prediction.rows;
+	for (int i = _range.start; i < _range.end; ++i)
+	{
+		if (m_NumBands == 0)
+		{
+			m_Matcher->_predictRow(m_Level, i);
+		}
+		else
+		{
+			m_Matcher->_refineBand(m_Level, i * height / m_NumBands, (i + 1) * height / m_NumBands);
+		}
+	}
+}
+
+void PyramidMatcher::_levelRange(int _level, int& _minDisparity, int& _maxDisparity)
+{
+	if (_level == m_Levels)
+	{
+		_minDisparity = m_CoarseMatcher->getMinDisparity();
+		_maxDisparity = _minDisparity + m_CoarseMatcher->getNumDisparities() - 1;
+		return;
+	}
+	_minDisparity = _floorShift(m_MinDisparity, _level);
+	_maxDisparity = _floorShift(m_MinDisparity + m_NumDisparities - 1, _level);
+}
+
+void PyramidMatcher::_predictRow(int _level, int _y)
+{
+	const cv::Mat& coarse = m_Disparities[_level + 1];
+	short* prediction = m_Prediction.ptr<short>(_y);
+	int width = m_Prediction.cols;
+
+	int coarseMin, coarseMax, minDisparity, maxDisparity;
+	_levelRange(_level + 1, coarseMin, coarseMax);
+	_levelRange(_level, minDisparity, maxDisparity);
+	int lowest = minDisparity + PYRAMID_SEARCH_RADIUS;
+	int highest = std::max(maxDisparity - PYRAMID_SEARCH_RADIUS, lowest);
+
+	// doubled coarse disparity, rounded to whole disparities, holes marked with SHRT_MIN
+	const short* coarseRow = coarse.ptr<short>(std::min(_y / 2, coarse.rows - 1));
+	for (int x = 0; x < width; ++x)
+	{
+		int value = coarseRow[std::min(x / 2, coarse.cols - 1)];
+		if (value < coarseMin * STEREO_DISP_SCALE)
+		{
+			prediction[x] = SHRT_MIN;
+			continue;
+		}
+		int doubled = (value * 2 + STEREO_DISP_SCALE / 2) >> STEREO_DISP_SHIFT;
+		prediction[x] = (short)std::min(std::max(doubled, lowest), highest);
+	}
+
+	// holes are mostly occlusions, filled from their background side
+	StereoFillPredictionHoles(prediction, width, (short)lowest);
+}
+
+void PyramidMatcher::_refineBand(int _level, int _yBegin, int _yEnd)
+{
+	int minDisparity, maxDisparity;
+	_levelRange(_level, minDisparity, maxDisparity);
+	StereoBandSearch(m_LeftLevels[_level], m_RightLevels[_level], m_Prediction, m_Disparities[_level], NULL,
+		_yBegin, _yEnd, m_BlockSize, minDisparity, maxDisparity, m_UniquenessRatio);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <opencv2\imgproc\imgproc.hpp>
+#include <vector>
+#include "bandsearch.h"
+
+// Coarse-to-fine disparity search.
+// The pair is reduced _levels times by cv::pyrDown and the coarsest level is matched over the whole
+// (scaled) range by any other matcher. Every finer level then only searches a band of
+// PYRAMID_SEARCH_RADIUS disparities around each pixel's prediction, the coarser result doubled and
+// upsampled, so the cost per pixel no longer grows with the number of disparities.
+// The band search and the filling of prediction holes are the ones in bandsearch.h.
+// The finer levels always cost plain grey SAD windows whatever the coarse matcher is, so the result only
+// keeps the coarse matcher's cost with a SAD block matcher. Prefilters, census or semi-global costs are
+// only used on the coarsest level.
+class PyramidMatcher : public cv::StereoMatcher
+{
+public:
+	static cv::Ptr<PyramidMatcher> create(cv::Ptr<cv::StereoMatcher> _coarseMatcher, int _minDisparity, int _numDisparities, int _blockSize, int _levels);
+
+	PyramidMatcher(cv::Ptr<cv::StereoMatcher> _coarseMatcher, int _minDisparity, int _numDisparities, int _blockSize, int _levels);
+	PyramidMatcher(const PyramidMatcher& _other) = default;
+	~PyramidMatcher() = default;
+
+	void compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity);
+
+	inline int getMinDisparity() const						{ return m_MinDisparity; }
+	inline void setMinDisparity(int _value)					{ m_MinDisparity = _value; }
+	inline int getNumDisparities() const					{ return m_NumDisparities; }
+	inline void setNumDisparities(int _value)				{ m_NumDisparities = _value; }
+	inline int getBlockSize() const							{ return m_BlockSize; }
+	inline void setBlockSize(int _value)					{ m_BlockSize = _value; }
+	inline int getSpeckleWindowSize() const					{ return m_SpeckleWindowSize; }
+	inline void setSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
+	inline int getSpeckleRange() const						{ return m_SpeckleRange; }
+	inline void setSpeckleRange(int _value)					{ m_SpeckleRange = _value; }
+	inline int getDisp12MaxDiff() const						{ return m_Disp12MaxDiff; }
+	inline void setDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; }
+	inline int getUniquenessRatio() const					{ return m_UniquenessRatio; }
+	inline void setUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; }
+	inline int getLevels() const							{ return m_Levels; }
+	inline cv::Ptr<cv::StereoMatcher> getCoarseMatcher()	{ return m_CoarseMatcher; }
+
+	// disparity range the coarse matcher has to cover for the full resolution range
+	static void CoarseRange(int _minDisparity, int _numDisparities, int _levels, int& _coarseMinDisparity, int& _coarseNumDisparities);
+
+	// number of disparities searched around every prediction on each side
+	static const int PYRAMID_SEARCH_RADIUS = STEREO_BAND_RADIUS;
+
+private:
+	// refines one band of rows of level _level from the prediction of the level below it
+	class RefineBody : public cv::ParallelLoopBody
+	{
+	public:
+		RefineBody(PyramidMatcher* _matcher, int _level, int _numBands) : m_Matcher(_matcher), m_Level(_level), m_NumBands(_numBands) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		PyramidMatcher* m_Matcher;
+		int m_Level;
+		int m_NumBands;
+	};
+
+	void _predictRow(int _level, int _y);
+	void _refineBand(int _level, int _yBegin, int _yEnd);
+	void _levelRange(int _level, int& _minDisparity, int& _maxDisparity);
+
+private:
+	cv::Ptr<cv::StereoMatcher> m_CoarseMatcher;
+	int m_MinDisparity;
+	int m_NumDisparities;
+	int m_BlockSize;
+	int m_Levels;
+	int m_SpeckleWindowSize;
+	int m_SpeckleRange;
+	int m_Disp12MaxDiff;	// not used, only the left disparity is refined
+	int m_UniquenessRatio;
+
+	// kept between calls so a stream of same sized frames does not allocate
+	std::vector<cv::Mat> m_LeftLevels;
+	std::vector<cv::Mat> m_RightLevels;
+	std::vector<cv::Mat> m_Disparities;	// 16S, index 0 is the full resolution output
+	cv::Mat m_Prediction;				// 16S whole disparities of the level being refined
+	cv::Mat m_SpeckleBuffer;
+};
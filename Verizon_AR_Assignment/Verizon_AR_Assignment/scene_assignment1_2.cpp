@@ -74,53 +74,20 @@ bool Scene_Assignment1_2::Initialize(OpenGLRenderer* _renderer, HWND _hwnd)
 	mapper.SetP2(32 * 3 * SADWindowSize * SADWindowSize);
 	mapper.SetMode(cv::StereoSGBM::MODE_SGBM_3WAY);
 	mapper.SetUseConfidence(true);
+	mapper.SetConfidenceThreshold(64);
 
 	// compute the disparity map and point cloud
 	mapper.Compute();
 
-	// get point cloud and cropped left color image
-	cv::Mat pointcloud = mapper.GetPointCloud();
-	cv::Mat color_left = mapper.GetCroppedLeftOriginal();
-
-	float whscale = 8.0f; // width/height scale
-	float xscale = whscale / pointcloud.cols; // downscale image
-	float yscale = whscale / pointcloud.rows; // downscale image
-	float cscale = 1.0f / 255.0f; // convert from 0-255 to 0-1
-	float dscale = whscale / ((focalLength*baseline)/ numDisparity);
-	float doffset = -6.0f;
-
-	// create point array from 3d image
-	ColorShader::VertexType* points = new ColorShader::VertexType[pointcloud.rows * pointcloud.cols];
-	int totalverts = 0;
-	for (int y = 0; y < pointcloud.rows; ++y)
-	{
-		for (int x = 0; x < pointcloud.cols; ++x)
-		{
-			// get point position
-			cv::Vec3f pos = pointcloud.at<cv::Vec3f>(y, x);
-
-			// skip this point if depth is unknown (+-infinity)
-			if (pos[2] == -INFINITY || pos[2] == INFINITY)
-			{
-				continue;
-			}
-
-			// get point color
-			cv::Vec3b color = color_left.at<cv::Vec3b>(color_left.rows - y - 1, x);
-
-			// convert colors from 0-255 to 0-1
-			float r = color[2] * cscale;
-			float g = color[1] * cscale;
-			float b = color[0] * cscale;
-
-			float posx = (pos[0] * xscale); // scale and center width
-			float posy = (pos[1] * yscale); // scale and center height
-			float posz = (pos[2] * dscale) + doffset; // scale depth
-
-			// store point
-			points[totalverts++] = { posx, posy, posz, r, g, b };
-		}
-	}
+	// the point cloud covers the cropped disparity, 8 units across and down and as deep at the largest
+	// disparity, points with unknown depth or that the smoother mostly filled in from their surroundings are
+	// left out. the builder owns the vertices
+	cv::Mat disparity = mapper.GetCroppedRawDisparity();
+	PointCloudBuilder builder;
+	builder.FitToExtent(disparity.size(), (float)((focalLength * baseline) / numDisparity), 8.0f, -6.0f);
+	builder.SetConfidenceThreshold(mapper.GetConfidenceThreshold());
+	PointCloudBuilder::Statistics statistics;
+	const ColorShader::VertexType* points = builder.Build(disparity, mapper.GetCroppedConfidence(), mapper.GetCroppedLeftImage(), mapper.GetQMatrix(), mapper.GetMinDisparity(), mapper.GetNumDisparities(), statistics);
 
 	// Create the full screen quad entity for left image
 	_createFullScreenQuad(left_img, _hwnd);
@@ -133,11 +100,9 @@ bool Scene_Assignment1_2::Initialize(OpenGLRenderer* _renderer, HWND _hwnd)
 	cv::cvtColor(mapper.GetCroppedDisparity(), disparityRGBA, CV_GRAY2RGBA, 4);
 	_createFullScreenQuad(disparityRGBA, _hwnd);
 
-	// create the point cloud entity to show the disparity map in 3d
-	_createPointCloud(points, totalverts, _hwnd);
-
-	// free everything not needed anymore
-	delete points;
+	// create the point cloud entity to show the disparity map in 3d, packed to half the size for the upload
+	bool packPoints = true;
+	_createPointCloud(points, statistics, packPoints, _hwnd);
 
 	return true;
 }
@@ -171,15 +136,28 @@ bool Scene_Assignment1_2::_createFullScreenQuad(cv::Mat _image, HWND _hwnd)
 
 	return true;
 }
-bool Scene_Assignment1_2::_createPointCloud(ColorShader::VertexType* _vertices, int _numVerts, HWND _hwnd)
+bool Scene_Assignment1_2::_createPointCloud(const ColorShader::VertexType* _vertices, const PointCloudBuilder::Statistics& _statistics, bool _packed, HWND _hwnd)
 {
+	int numVerts = _statistics.m_NumVertices;
+
 	Entity_PointCloud* pc = new Entity_PointCloud();
 	if (!pc)
 	{
 		return false;
 	}
 
-	pc->Initialize(m_Renderer, _vertices, _numVerts);
+	if (_packed)
+	{
+		// 16 bit positions in the bounding box of the cloud and 8 bit colours
+		ColorShader::PackedVertexType* packed = new ColorShader::PackedVertexType[numVerts];
+		ColorShader::PackVertices(_vertices, numVerts, _statistics.m_BoundsMin, _statistics.m_BoundsMax, packed);
+		pc->Initialize(m_Renderer, packed, numVerts, _statistics.m_BoundsMin, _statistics.m_BoundsMax);
+		delete[] packed;
+	}
+	else
+	{
+		pc->Initialize(m_Renderer, _vertices, numVerts);
+	}
 	m_Entities.push_back(pc);
 	m_Renderer->InitializeShader(_hwnd, pc->GetShaderID());
 
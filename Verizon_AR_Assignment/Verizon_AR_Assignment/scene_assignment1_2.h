@@ -2,6 +2,7 @@
 #include "interfaces.h"
 #include "entities.h"
 #include <opencv2\core.hpp>
+#include "pointcloudbuilder.h"
 
 class OpenGLRenderer;
 class Camera;
@@ -24,7 +25,7 @@ public:
 
 private:
 	bool _createFullScreenQuad(cv::Mat _image, HWND _hwnd);
-	bool _createPointCloud(ColorShader::VertexType* _vertices, int _numVerts, HWND _hwnd);
+	bool _createPointCloud(const ColorShader::VertexType* _vertices, const PointCloudBuilder::Statistics& _statistics, bool _packed, HWND _hwnd);
 
 private:
 	OpenGLRenderer* m_Renderer;
@@ -0,0 +1,416 @@
+#include "sgmmatcher.h"
+#include <algorithm>
+#include <string.h>
+
+// width of the column stripes the vertical paths are split into
+static const int SGM_COLUMN_STRIPE = 32;
+// width of the chunks a wavefront row is split into
+static const int SGM_ROW_CHUNK = 64;
+// predecessor offsets (dx, dy) of the paths that advance as a wavefront. the vertical path is first,
+// it only runs in the wavefront when rolling. then the diagonals, 2 are used with 8 paths, all 6 with 16
+static const int SGM_DIRECTIONS[7][2] = { { 0, 1 }, { 1, 1 }, { -1, 1 }, { 1, 2 }, { -1, 2 }, { 2, 1 }, { -2, 1 } };
+
+cv::Ptr<SGMMatcher> SGMMatcher::create(int _minDisparity, int _numDisparities, int _blockSize, int _P1, int _P2, int _numPaths, int _mode)
+{
+	return cv::makePtr<SGMMatcher>(_minDisparity, _numDisparities, _blockSize, _P1, _P2, _numPaths, _mode);
+}
+
+SGMMatcher::SGMMatcher(int _minDisparity, int _numDisparities, int _blockSize, int _P1, int _P2, int _numPaths, int _mode)
+	: m_MinDisparity(_minDisparity), m_NumDisparities(_numDisparities), m_BlockSize(_blockSize), m_P1(_P1), m_P2(_P2), m_NumPaths(_numPaths), m_Mode(_mode)
+{
+	m_SpeckleWindowSize = 0;
+	m_SpeckleRange = 0;
+	m_Disp12MaxDiff = -1;
+	m_UniquenessRatio = 0;
+	m_Kernels = NULL;
+}
+
+void SGMMatcher::compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity)
+{
+	m_Left = _left.getMat();
+	m_Right = _right.getMat();
+
+	if (m_Left.type() != CV_8UC1 || m_Right.type() != CV_8UC1 || m_Left.size() != m_Right.size())
+	{
+		throw "SGM matcher needs two greyscale images of the same size";
+	}
+	if (m_NumDisparities <= 0 || m_NumDisparities % 16 != 0)
+	{
+		throw "Number of disparities must be a positive multiple of 16";
+	}
+	if (m_BlockSize < 3 || m_BlockSize > 15 || m_BlockSize % 2 == 0)
+	{
+		throw "Block size must be odd and between 3 and 15";
+	}
+	if (m_NumPaths != 4 && m_NumPaths != 8 && m_NumPaths != 16)
+	{
+		throw "Number of SGM paths must be 4, 8 or 16";
+	}
+	if (m_Mode != MODE_FULL && m_Mode != MODE_ROLLING)
+	{
+		throw "SGM mode must be MODE_FULL or MODE_ROLLING";
+	}
+
+	m_Kernels = &GetStereoKernels();
+
+	int width = m_Left.cols;
+	int height = m_Left.rows;
+	int numDisp = m_NumDisparities;
+	int radius = m_BlockSize / 2;
+
+	// aggregate only where the block costs are defined, same region cv::StereoBM leaves filled
+	int maxDisparity = m_MinDisparity + numDisp - 1;
+	int xBegin = std::min(std::max(maxDisparity + radius, radius), width - radius);
+	int xEnd = std::max(std::min(width + m_MinDisparity - radius, width - radius), xBegin);
+	m_RegionX = xBegin;
+	m_RegionY = radius;
+	m_RegionWidth = xEnd - xBegin;
+	m_RegionHeight = std::max(height - 2 * radius, 0);
+
+	_disparity.create(m_Left.size(), CV_16S);
+	m_Disparity = _disparity.getMat();
+	short invalid = StereoInvalidDisparity(m_MinDisparity);
+	m_Disparity.setTo(invalid);
+
+	if (m_RegionWidth <= 0 || m_RegionHeight <= 0)
+	{
+		return;
+	}
+
+	// same defaults as cv::StereoSGBM when the penalties are left at 0
+	int P1 = m_P1 > 0 ? m_P1 : 2;
+	int P2 = std::max(m_P2 > 0 ? m_P2 : 5, P1 + 1);
+
+	// scale costs and penalties down until the worst case sum over all paths fits in 16 bits
+	long long worstSum = (long long)(255 * m_BlockSize * m_BlockSize + P2) * m_NumPaths;
+	m_CostShift = 0;
+	while ((worstSum >> m_CostShift) > 0xFFFF)
+	{
+		++m_CostShift;
+	}
+	m_ScaledP1 = P1 >> m_CostShift;
+	m_ScaledP2 = P2 >> m_CostShift;
+
+	int numDiagonals = m_NumPaths == 16 ? 6 : (m_NumPaths == 8 ? 2 : 0);
+	m_FirstDirection = m_Mode == MODE_ROLLING ? 0 : 1;
+	m_NumDirections = numDiagonals + 1 - m_FirstDirection;
+	m_NumChunks = (m_RegionWidth + SGM_ROW_CHUNK - 1) / SGM_ROW_CHUNK;
+	if (m_NumDirections > 0)
+	{
+		m_DiagonalPaths.assign((size_t)m_NumDirections * 3 * m_RegionWidth * (numDisp + 2), 0xFFFF);
+		m_DiagonalMins.resize(m_NumDirections * 3 * m_RegionWidth);
+	}
+
+	if (m_Mode == MODE_ROLLING)
+	{
+		_computeRolling();
+	}
+	else
+	{
+		size_t volumeSize = (size_t)m_RegionWidth * m_RegionHeight * numDisp;
+		m_CostVolume.resize(volumeSize);
+		m_SumVolume.assign(volumeSize, 0);
+
+		// matching cost, row bands in parallel, each band primes its own running column sums
+		int numBands = std::min(m_RegionHeight, std::max(cv::getNumThreads(), 1) * 4);
+		cv::parallel_for_(cv::Range(0, numBands), PassBody(this, SGM_PASS::SGM_PASS_COST, numBands));
+
+		// left to right and right to left, every row is independent
+		cv::parallel_for_(cv::Range(0, m_RegionHeight), PassBody(this, SGM_PASS::SGM_PASS_HORIZONTAL, 0));
+
+		// top to bottom and bottom to top, every column stripe is independent
+		int numStripes = (m_RegionWidth + SGM_COLUMN_STRIPE - 1) / SGM_COLUMN_STRIPE;
+		cv::parallel_for_(cv::Range(0, numStripes), PassBody(this, SGM_PASS::SGM_PASS_VERTICAL, 0));
+
+		// diagonals, a row only depends on the rows above (below) it so each row is a wavefront
+		if (m_NumDirections > 0)
+		{
+			for (int step = 0; step < m_RegionHeight; ++step)
+			{
+				cv::parallel_for_(cv::Range(0, m_NumChunks), PassBody(this, SGM_PASS::SGM_PASS_DIAGONAL_DOWN, step));
+			}
+			for (int step = 0; step < m_RegionHeight; ++step)
+			{
+				cv::parallel_for_(cv::Range(0, m_NumChunks), PassBody(this, SGM_PASS::SGM_PASS_DIAGONAL_UP, step));
+			}
+		}
+
+		// winner takes all over the aggregated costs
+		cv::parallel_for_(cv::Range(0, m_RegionHeight), PassBody(this, SGM_PASS::SGM_PASS_SELECT, 0));
+	}
+
+	if (m_SpeckleWindowSize > 0)
+	{
+		cv::filterSpeckles(m_Disparity, invalid, m_SpeckleWindowSize, m_SpeckleRange * STEREO_DISP_SCALE, m_SpeckleBuffer);
+	}
+}
+
+void SGMMatcher::PassBody::operator()(const cv::Range& _range) const
+{
+	for (int i = _range.start; i < _range.end; ++i)
+	{
+		switch (m_Pass)
+		{
+		case SGM_PASS::SGM_PASS_COST:
+			m_Matcher->_computeCostBand(i * m_Matcher->m_RegionHeight / m_Step, (i + 1) * m_Matcher->m_RegionHeight / m_Step);
+			break;
+		case SGM_PASS::SGM_PASS_HORIZONTAL:
+			m_Matcher->_aggregateRow(i, m_Matcher->_sum(0, i));
+			break;
+		case SGM_PASS::SGM_PASS_VERTICAL:
+			m_Matcher->_aggregateColumns(i * SGM_COLUMN_STRIPE, std::min((i + 1) * SGM_COLUMN_STRIPE, m_Matcher->m_RegionWidth));
+			break;
+		case SGM_PASS::SGM_PASS_DIAGONAL_DOWN:
+			m_Matcher->_aggregateDiagonalRow(m_Step, i * SGM_ROW_CHUNK, std::min((i + 1) * SGM_ROW_CHUNK, m_Matcher->m_RegionWidth), true, m_Matcher->_sum(0, m_Step));
+			break;
+		case SGM_PASS::SGM_PASS_DIAGONAL_UP:
+			m_Matcher->_aggregateDiagonalRow(m_Step, i * SGM_ROW_CHUNK, std::min((i + 1) * SGM_ROW_CHUNK, m_Matcher->m_RegionWidth), false, m_Matcher->_sum(0, m_Matcher->m_RegionHeight - 1 - m_Step));
+			break;
+		case SGM_PASS::SGM_PASS_SELECT:
+			m_Matcher->_selectRow(i, m_Matcher->_sum(0, i));
+			break;
+		case SGM_PASS::SGM_PASS_ROLLING:
+			if (i < m_Matcher->m_NumChunks)
+			{
+				// top down paths into sum row 0, every chunk clears its own part first
+				int xBegin = i * SGM_ROW_CHUNK;
+				int xEnd = std::min((i + 1) * SGM_ROW_CHUNK, m_Matcher->m_RegionWidth);
+				std::fill(m_Matcher->_sum(xBegin, 0), m_Matcher->_sum(xEnd, 0), 0);
+				m_Matcher->_aggregateDiagonalRow(m_Step, xBegin, xEnd, true, m_Matcher->_sum(0, 0));
+			}
+			else if (i == m_Matcher->m_NumChunks)
+			{
+				std::fill(m_Matcher->_sum(0, 1), m_Matcher->_sum(m_Matcher->m_RegionWidth, 1), 0);
+				m_Matcher->_aggregateRow(m_Step, m_Matcher->_sum(0, 1));
+			}
+			else if (m_Step + 1 < m_Matcher->m_RegionHeight)
+			{
+				m_Matcher->_computeCostRow(m_Step + 1, m_Matcher->m_RegionY, &m_Matcher->m_ColumnCost[0], &m_Matcher->m_RowCost[0], &m_Matcher->m_PaddedRows[0]);
+			}
+			break;
+		}
+	}
+}
+
+void SGMMatcher::_computeRolling()
+{
+	int width = m_Left.cols;
+	int numDisp = m_NumDisparities;
+	int radius = m_BlockSize / 2;
+	size_t rowSize = (size_t)m_RegionWidth * numDisp;
+
+	m_CostVolume.resize(rowSize * 2);
+	m_SumVolume.resize(rowSize * 2);
+	m_ColumnCost.assign(width * numDisp, 0);
+	m_RowCost.resize(width * numDisp);
+	m_PaddedRows.resize((width + numDisp) * 2);
+
+	// window rows of the first centre row, all but the last one, then its cost
+	int first = m_RegionY;
+	uchar* addRight = &m_PaddedRows[numDisp];
+	for (int y = first - radius; y < first + radius; ++y)
+	{
+		StereoPadRightRow(m_Right.ptr<uchar>(y), width, m_MinDisparity, numDisp, addRight);
+		m_Kernels->UpdateColumnCostSAD(m_Left.ptr<uchar>(y), addRight, NULL, NULL, &m_ColumnCost[0], width, numDisp);
+	}
+	_computeCostRow(0, first, &m_ColumnCost[0], &m_RowCost[0], &m_PaddedRows[0]);
+
+	// one pass per row, the cost of the next row is computed next to the aggregation of this one
+	for (int step = 0; step < m_RegionHeight; ++step)
+	{
+		cv::parallel_for_(cv::Range(0, m_NumChunks + 2), PassBody(this, SGM_PASS::SGM_PASS_ROLLING, step));
+
+		// the cost shift keeps the sum over all paths in 16 bits, no saturation needed
+		unsigned short* sum = _sum(0, 0);
+		const unsigned short* horizontal = _sum(0, 1);
+		for (size_t i = 0; i < rowSize; ++i)
+		{
+			sum[i] += horizontal[i];
+		}
+		_selectRow(step, sum);
+	}
+}
+
+void SGMMatcher::_computeCostBand(int _yBegin, int _yEnd)
+{
+	if (_yBegin >= _yEnd)
+	{
+		return;
+	}
+
+	int width = m_Left.cols;
+	int numDisp = m_NumDisparities;
+	int radius = m_BlockSize / 2;
+	int paddedWidth = width + numDisp;
+
+	cv::AutoBuffer<unsigned short> columnBuffer(width * numDisp);
+	cv::AutoBuffer<unsigned short> rowBuffer(width * numDisp);
+	cv::AutoBuffer<uchar> paddedBuffer(paddedWidth * 2);
+	unsigned short* columnCost = columnBuffer;
+	uchar* addRight = (uchar*)paddedBuffer + numDisp;
+	std::fill(columnCost, columnCost + width * numDisp, 0);
+
+	// window rows of the first centre row, all but the last one
+	int first = _yBegin + m_RegionY;
+	for (int y = first - radius; y < first + radius; ++y)
+	{
+		StereoPadRightRow(m_Right.ptr<uchar>(y), width, m_MinDisparity, numDisp, addRight);
+		m_Kernels->UpdateColumnCostSAD(m_Left.ptr<uchar>(y), addRight, NULL, NULL, columnCost, width, numDisp);
+	}
+
+	for (int ry = _yBegin; ry < _yEnd; ++ry)
+	{
+		_computeCostRow(ry, first, columnCost, rowBuffer, paddedBuffer);
+	}
+}
+
+void SGMMatcher::_computeCostRow(int _y, int _first, unsigned short* _columnCost, unsigned short* _rowCost, uchar* _padded)
+{
+	// slides the running column sums one row down and writes the cost row of region row _y.
+	// _first is the first centre row the column sums were primed for, rows above it never entered
+	int width = m_Left.cols;
+	int numDisp = m_NumDisparities;
+	int radius = m_BlockSize / 2;
+	int paddedWidth = width + numDisp;
+	uchar* addRight = _padded + numDisp;
+	uchar* subRight = _padded + paddedWidth + numDisp;
+
+	int y = _y + m_RegionY;
+	int enter = y + radius;
+	int leave = y - radius - 1;
+	StereoPadRightRow(m_Right.ptr<uchar>(enter), width, m_MinDisparity, numDisp, addRight);
+	if (leave >= _first - radius)
+	{
+		StereoPadRightRow(m_Right.ptr<uchar>(leave), width, m_MinDisparity, numDisp, subRight);
+		m_Kernels->UpdateColumnCostSAD(m_Left.ptr<uchar>(enter), addRight, m_Left.ptr<uchar>(leave), subRight, _columnCost, width, numDisp);
+	}
+	else
+	{
+		m_Kernels->UpdateColumnCostSAD(m_Left.ptr<uchar>(enter), addRight, NULL, NULL, _columnCost, width, numDisp);
+	}
+	m_Kernels->BoxSumRow(_columnCost, _rowCost, width, numDisp, radius);
+
+	const unsigned short* src = _rowCost + m_RegionX * numDisp;
+	unsigned short* dst = _cost(0, _y);
+	if (m_CostShift == 0)
+	{
+		memcpy(dst, src, m_RegionWidth * numDisp * sizeof(unsigned short));
+	}
+	else
+	{
+		for (int i = 0; i < m_RegionWidth * numDisp; ++i)
+		{
+			dst[i] = src[i] >> m_CostShift;
+		}
+	}
+}
+
+void SGMMatcher::_aggregateRow(int _y, unsigned short* _sumRow)
+{
+	int numDisp = m_NumDisparities;
+	int stride = numDisp + 2;
+
+	// two pixels worth of path, each framed by sentinels
+	cv::AutoBuffer<unsigned short> buffer(stride * 2);
+	std::fill((unsigned short*)buffer, (unsigned short*)buffer + stride * 2, 0xFFFF);
+	unsigned short* prev = (unsigned short*)buffer + 1;
+	unsigned short* cur = (unsigned short*)buffer + stride + 1;
+
+	unsigned short prevMin = 0;
+	for (int x = 0; x < m_RegionWidth; ++x)
+	{
+		prevMin = m_Kernels->AggregatePathPixel(_cost(x, _y), x > 0 ? prev : NULL, prevMin, cur, _sumRow + x * numDisp, numDisp, m_ScaledP1, m_ScaledP2);
+		std::swap(prev, cur);
+	}
+
+	for (int x = m_RegionWidth - 1; x >= 0; --x)
+	{
+		prevMin = m_Kernels->AggregatePathPixel(_cost(x, _y), x < m_RegionWidth - 1 ? prev : NULL, prevMin, cur, _sumRow + x * numDisp, numDisp, m_ScaledP1, m_ScaledP2);
+		std::swap(prev, cur);
+	}
+}
+
+void SGMMatcher::_aggregateColumns(int _xBegin, int _xEnd)
+{
+	int numDisp = m_NumDisparities;
+	int stride = numDisp + 2;
+	int count = _xEnd - _xBegin;
+
+	// one row of the stripe for the previous and the current step
+	cv::AutoBuffer<unsigned short> buffer(stride * count * 2);
+	cv::AutoBuffer<unsigned short> minBuffer(count * 2);
+	std::fill((unsigned short*)buffer, (unsigned short*)buffer + stride * count * 2, 0xFFFF);
+	unsigned short* prevRow = (unsigned short*)buffer + 1;
+	unsigned short* curRow = (unsigned short*)buffer + stride * count + 1;
+	unsigned short* prevMins = minBuffer;
+	unsigned short* curMins = (unsigned short*)minBuffer + count;
+
+	for (int step = 0; step < m_RegionHeight; ++step)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			const unsigned short* prev = step > 0 ? prevRow + i * stride : NULL;
+			curMins[i] = m_Kernels->AggregatePathPixel(_cost(_xBegin + i, step), prev, prevMins[i], curRow + i * stride, _sum(_xBegin + i, step), numDisp, m_ScaledP1, m_ScaledP2);
+		}
+		std::swap(prevRow, curRow);
+		std::swap(prevMins, curMins);
+	}
+
+	for (int step = 0; step < m_RegionHeight; ++step)
+	{
+		int y = m_RegionHeight - 1 - step;
+		for (int i = 0; i < count; ++i)
+		{
+			const unsigned short* prev = step > 0 ? prevRow + i * stride : NULL;
+			curMins[i] = m_Kernels->AggregatePathPixel(_cost(_xBegin + i, y), prev, prevMins[i], curRow + i * stride, _sum(_xBegin + i, y), numDisp, m_ScaledP1, m_ScaledP2);
+		}
+		std::swap(prevRow, curRow);
+		std::swap(prevMins, curMins);
+	}
+}
+
+void SGMMatcher::_aggregateDiagonalRow(int _step, int _xBegin, int _xEnd, bool _down, unsigned short* _sumRow)
+{
+	int numDisp = m_NumDisparities;
+	int stride = numDisp + 2;
+	int y = _down ? _step : m_RegionHeight - 1 - _step;
+	int direction = _down ? 1 : -1;
+
+	for (int k = 0; k < m_NumDirections; ++k)
+	{
+		int dx = SGM_DIRECTIONS[m_FirstDirection + k][0] * direction;
+		int prevStep = _step - SGM_DIRECTIONS[m_FirstDirection + k][1];
+
+		// rows of this direction live in a ring of 3, enough for predecessors 2 rows back
+		size_t curSlot = (size_t)(k * 3 + _step % 3) * m_RegionWidth;
+		unsigned short* curRow = &m_DiagonalPaths[curSlot * stride] + 1;
+		unsigned short* curMins = &m_DiagonalMins[curSlot];
+		const unsigned short* prevRow = NULL;
+		const unsigned short* prevMins = NULL;
+		if (prevStep >= 0)
+		{
+			size_t prevSlot = (size_t)(k * 3 + prevStep % 3) * m_RegionWidth;
+			prevRow = &m_DiagonalPaths[prevSlot * stride] + 1;
+			prevMins = &m_DiagonalMins[prevSlot];
+		}
+
+		for (int x = _xBegin; x < _xEnd; ++x)
+		{
+			int px = x - dx;
+			const unsigned short* prev = NULL;
+			unsigned short prevMin = 0;
+			if (prevRow && px >= 0 && px < m_RegionWidth)
+			{
+				prev = prevRow + px * stride;
+				prevMin = prevMins[px];
+			}
+			curMins[x] = m_Kernels->AggregatePathPixel(_cost(x, y), prev, prevMin, curRow + x * stride, _sumRow + x * numDisp, numDisp, m_ScaledP1, m_ScaledP2);
+		}
+	}
+}
+
+void SGMMatcher::_selectRow(int _y, const unsigned short* _sumRow)
+{
+	short* dispRow = m_Disparity.ptr<short>(_y + m_RegionY) + m_RegionX;
+	m_Kernels->SelectDisparityRow(_sumRow, dispRow, 0, m_RegionWidth, m_NumDisparities, m_MinDisparity, m_UniquenessRatio);
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <vector>
+#include "stereokernels.h"
+
+// In-tree multi-threaded Semi-Global Matching.
+// The data term is the block SAD of BlockMatcher::MODE_SAD, so P1 and P2 have the same meaning as
+// for cv::StereoSGBM on greyscale input. Costs and path sums are kept in 16 bit volumes, the costs
+// and penalties are scaled down by a power of two when needed so the sum over all paths can not
+// overflow. 4 paths aggregate along rows and columns, 8 add the diagonals and 16 add the
+// knight-move directions.
+// MODE_FULL keeps the whole W x H x D cost and sum volumes. Rows and column stripes are processed
+// in parallel, diagonal paths advance one row at a time with the row split over the workers (wavefront).
+// MODE_ROLLING streams through the image top to bottom in a single pass and keeps only a few rows,
+// so memory is O(W x D). Only the paths coming from above and both horizontal paths can be
+// aggregated that way (3, 5 or 9 of the 4, 8 or 16), like cv::StereoSGBM::MODE_SGBM.
+class SGMMatcher : public cv::StereoMatcher
+{
+public:
+	enum { MODE_FULL = 0, MODE_ROLLING = 1 };
+
+	static cv::Ptr<SGMMatcher> create(int _minDisparity = 0, int _numDisparities = 64, int _blockSize = 5, int _P1 = 0, int _P2 = 0, int _numPaths = 8, int _mode = MODE_FULL);
+
+	SGMMatcher(int _minDisparity, int _numDisparities, int _blockSize, int _P1, int _P2, int _numPaths, int _mode);
+	SGMMatcher(const SGMMatcher& _other) = default;
+	~SGMMatcher() = default;
+
+	void compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity);
+
+	inline int getMinDisparity() const						{ return m_MinDisparity; }
+	inline void setMinDisparity(int _value)					{ m_MinDisparity = _value; }
+	inline int getNumDisparities() const					{ return m_NumDisparities; }
+	inline void setNumDisparities(int _value)				{ m_NumDisparities = _value; }
+	inline int getBlockSize() const							{ return m_BlockSize; }
+	inline void setBlockSize(int _value)					{ m_BlockSize = _value; }
+	inline int getSpeckleWindowSize() const					{ return m_SpeckleWindowSize; }
+	inline void setSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
+	inline int getSpeckleRange() const						{ return m_SpeckleRange; }
+	inline void setSpeckleRange(int _value)					{ m_SpeckleRange = _value; }
+	inline int getDisp12MaxDiff() const						{ return m_Disp12MaxDiff; }
+	inline void setDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; }
+	inline int getUniquenessRatio() const					{ return m_UniquenessRatio; }
+	inline void setUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; }
+	inline int getP1() const								{ return m_P1; }
+	inline void setP1(int _value)							{ m_P1 = _value; }
+	inline int getP2() const								{ return m_P2; }
+	inline void setP2(int _value)							{ m_P2 = _value; }
+	inline int getNumPaths() const							{ return m_NumPaths; }
+	inline void setNumPaths(int _value)						{ m_NumPaths = _value; }
+	inline int getMode() const								{ return m_Mode; }
+	inline void setMode(int _value)							{ m_Mode = _value; }
+
+private:
+	enum class SGM_PASS { SGM_PASS_COST, SGM_PASS_HORIZONTAL, SGM_PASS_VERTICAL, SGM_PASS_DIAGONAL_DOWN, SGM_PASS_DIAGONAL_UP, SGM_PASS_SELECT, SGM_PASS_ROLLING };
+
+	// runs one pass over a range of rows, column stripes or row chunks on the cv::parallel_for_ workers.
+	// a rolling pass handles one row, the chunks of the top down paths, the horizontal paths and the
+	// cost of the next row
+	class PassBody : public cv::ParallelLoopBody
+	{
+	public:
+		PassBody(SGMMatcher* _matcher, SGM_PASS _pass, int _step) : m_Matcher(_matcher), m_Pass(_pass), m_Step(_step) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		SGMMatcher* m_Matcher;
+		SGM_PASS m_Pass;
+		int m_Step;
+	};
+
+	void _computeRolling();
+	void _computeCostBand(int _yBegin, int _yEnd);
+	void _computeCostRow(int _y, int _first, unsigned short* _columnCost, unsigned short* _rowCost, uchar* _padded);
+	void _aggregateRow(int _y, unsigned short* _sumRow);
+	void _aggregateColumns(int _xBegin, int _xEnd);
+	void _aggregateDiagonalRow(int _step, int _xBegin, int _xEnd, bool _down, unsigned short* _sumRow);
+	void _selectRow(int _y, const unsigned short* _sumRow);
+
+	// the rolling mode keeps 2 cost rows, the one being aggregated and the next one
+	inline unsigned short* _cost(int _x, int _y)			{ return &m_CostVolume[((size_t)(m_Mode == MODE_ROLLING ? _y % 2 : _y) * m_RegionWidth + _x) * m_NumDisparities]; }
+	inline unsigned short* _sum(int _x, int _y)				{ return &m_SumVolume[((size_t)_y * m_RegionWidth + _x) * m_NumDisparities]; }
+
+private:
+	int m_MinDisparity;
+	int m_NumDisparities;
+	int m_BlockSize;
+	int m_SpeckleWindowSize;
+	int m_SpeckleRange;
+	int m_Disp12MaxDiff;	// not used yet, only the left disparity is computed
+	int m_UniquenessRatio;
+	int m_P1;
+	int m_P2;
+	int m_NumPaths;
+	int m_Mode;
+
+	// state of the frame being computed, shared with the pass bodies
+	const StereoKernels* m_Kernels;
+	cv::Mat m_Left;
+	cv::Mat m_Right;
+	cv::Mat m_Disparity;
+	int m_RegionX, m_RegionY, m_RegionWidth, m_RegionHeight;
+	int m_CostShift;
+	int m_ScaledP1;
+	int m_ScaledP2;
+	int m_FirstDirection;	// into SGM_DIRECTIONS, the vertical path only runs in the wavefront when rolling
+	int m_NumDirections;
+	int m_NumChunks;
+
+	// kept between calls so a stream of same sized frames does not allocate
+	std::vector<unsigned short> m_CostVolume;		// W x H x D, or 2 rows when rolling
+	std::vector<unsigned short> m_SumVolume;		// W x H x D, or 2 rows when rolling, top down and horizontal paths
+	std::vector<unsigned short> m_DiagonalPaths;	// ring of 3 rows per wavefront direction
+	std::vector<unsigned short> m_DiagonalMins;
+	std::vector<unsigned short> m_ColumnCost;		// running window state of the rolling cost row
+	std::vector<unsigned short> m_RowCost;
+	std::vector<uchar> m_PaddedRows;
+	cv::Mat m_SpeckleBuffer;
+};
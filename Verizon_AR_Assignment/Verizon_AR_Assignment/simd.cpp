@@ -0,0 +1,64 @@
+#include "simd.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void _queryCpuId(int _info[4], int _leaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(_info, _leaf, 0);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(_leaf, 0, a, b, c, d);
+	_info[0] = a; _info[1] = b; _info[2] = c; _info[3] = d;
+#endif
+}
+
+static unsigned long long _readXcr0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static SIMD_LEVEL _detectSimdLevel()
+{
+	int info[4];
+	_queryCpuId(info, 0);
+	int maxLeaf = info[0];
+
+	_queryCpuId(info, 1);
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	bool sse42 = (info[2] & (1 << 20)) != 0;
+	bool popcnt = (info[2] & (1 << 23)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (!(ssse3 && sse41 && sse42 && popcnt))
+	{
+		return SIMD_LEVEL::SIMD_LEVEL_SCALAR;
+	}
+
+	// avx2 also needs the os to save the ymm registers on a context switch
+	bool avx2 = false;
+	if (maxLeaf >= 7 && osxsave && avx && (_readXcr0() & 6) == 6)
+	{
+		_queryCpuId(info, 7);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	return avx2 ? SIMD_LEVEL::SIMD_LEVEL_AVX2 : SIMD_LEVEL::SIMD_LEVEL_SSE42;
+}
+
+SIMD_LEVEL GetSimdLevel()
+{
+	static SIMD_LEVEL level = _detectSimdLevel();
+	return level;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+enum class SIMD_LEVEL { SIMD_LEVEL_SCALAR, SIMD_LEVEL_SSE42, SIMD_LEVEL_AVX2 };
+
+// highest instruction set supported by both the cpu and the os, detected once on first call
+SIMD_LEVEL GetSimdLevel();
@@ -0,0 +1,249 @@
+#include "stereocalibrator.h"
+#include <algorithm>
+#include <float.h>
+
+StereoCalibrator::StereoCalibrator(cv::Size _boardSize, int _squareSize)
+	: m_BoardSize(_boardSize), m_SquareSize(_squareSize)
+{
+	m_ReprojectionError = 0.0;
+	m_EpipolarError = 0.0;
+}
+
+bool StereoCalibrator::FindGrid(const cv::Mat& _grey, std::vector<cv::Point2f>& _centers) const
+{
+	// the blob detector is the slow part, it runs on a copy no larger than CALIBRATION_DETECTION_SIZE
+	double scale = std::min(1.0, (double)CALIBRATION_DETECTION_SIZE / std::max(_grey.cols, _grey.rows));
+	if (scale >= 1.0)
+	{
+		return cv::findCirclesGrid(_grey, m_BoardSize, _centers, cv::CALIB_CB_ASYMMETRIC_GRID);
+	}
+
+	cv::Mat small;
+	cv::resize(_grey, small, cv::Size(), scale, scale, cv::INTER_AREA);
+	if (!cv::findCirclesGrid(small, m_BoardSize, _centers, cv::CALIB_CB_ASYMMETRIC_GRID))
+	{
+		return false;
+	}
+	for (auto& center : _centers)
+	{
+		center.x = (float)((center.x + 0.5) / scale - 0.5);
+		center.y = (float)((center.y + 0.5) / scale - 0.5);
+	}
+	_refineCircleCenters(_grey, _centers);
+	return true;
+}
+
+bool StereoCalibrator::AddCalibrationPair(const cv::Mat& _left, const cv::Mat& _right)
+{
+	cv::Mat grey[2];
+	const cv::Mat* images[2] = { &_left, &_right };
+	std::vector<cv::Point2f> centers[2];
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		if (images[eye]->channels() == 3)
+		{
+			cv::cvtColor(*images[eye], grey[eye], CV_BGR2GRAY);
+		}
+		else
+		{
+			grey[eye] = *images[eye];
+		}
+		if (!FindGrid(grey[eye], centers[eye]))
+		{
+			return false;
+		}
+	}
+	if (_left.size() != _right.size())
+	{
+		return false;
+	}
+	return AddCalibrationPoints(centers[0], centers[1], _left.size());
+}
+
+bool StereoCalibrator::AddCalibrationPoints(const std::vector<cv::Point2f>& _left, const std::vector<cv::Point2f>& _right, cv::Size _imageSize)
+{
+	// all pairs are taken with the same cameras at the same resolution
+	if (m_ImageSize != cv::Size() && m_ImageSize != _imageSize)
+	{
+		return false;
+	}
+	if ((int)_left.size() != m_BoardSize.area() || (int)_right.size() != m_BoardSize.area())
+	{
+		return false;
+	}
+	m_ImageSize = _imageSize;
+	m_ImagePoints[0].push_back(_left);
+	m_ImagePoints[1].push_back(_right);
+
+	std::vector<cv::Point3f> objectPoints;
+	for (int i = 0; i < m_BoardSize.height; ++i)
+	{
+		for (int j = 0; j < m_BoardSize.width; ++j)
+		{
+			objectPoints.push_back(cv::Point3f((float)((2 * j + i % 2) * m_SquareSize), (float)(i * m_SquareSize), 0.0f));
+		}
+	}
+	m_ObjectPoints.push_back(objectPoints);
+	return true;
+}
+
+void StereoCalibrator::SetSolution(const cv::Mat _cameraMatrix[2], const cv::Mat _distortionCoef[2], const cv::Mat& _rotation, const cv::Mat& _translation)
+{
+	// copies, the solver writes into the matrices and the given ones may be read-only
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		m_CameraMatrix[eye] = _cameraMatrix[eye].clone();
+		m_DistortionCoef[eye] = _distortionCoef[eye].clone();
+	}
+	m_Rotation = _rotation.clone();
+	m_Translation = _translation.clone();
+}
+
+double StereoCalibrator::Refine()
+{
+	if (GetNumPairs() == 0)
+	{
+		throw "Calibration needs at least one pair with the board in both images";
+	}
+
+	int flags = cv::CALIB_FIX_K3
+		+ cv::CALIB_FIX_K5
+		+ cv::CALIB_ZERO_TANGENT_DIST
+		+ cv::CALIB_FIX_ASPECT_RATIO
+		+ cv::CALIB_SAME_FOCAL_LENGTH
+		+ cv::CALIB_FIX_PRINCIPAL_POINT;
+	int iterations = CALIBRATION_SOLVE_ITERATIONS;
+	if (IsCalibrated())
+	{
+		// the previous solution is close, the new pairs only move it a little. it also skips the
+		// separate calibration of each camera the solver does when it starts from scratch
+		flags += cv::CALIB_USE_INTRINSIC_GUESS;
+		iterations = CALIBRATION_REFINE_ITERATIONS;
+	}
+	else
+	{
+		m_CameraMatrix[0] = cv::Mat::eye(3, 3, CV_64F);
+		m_CameraMatrix[1] = cv::Mat::eye(3, 3, CV_64F);
+	}
+
+	m_ReprojectionError = cv::stereoCalibrate(m_ObjectPoints, m_ImagePoints[0], m_ImagePoints[1],
+		m_CameraMatrix[0], m_DistortionCoef[0],
+		m_CameraMatrix[1], m_DistortionCoef[1],
+		m_ImageSize,
+		m_Rotation,
+		m_Translation,
+		m_Essential,
+		m_Fundamental,
+		flags,
+		cv::TermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, iterations, 1e-5));
+	m_EpipolarError = _epipolarError();
+	return m_EpipolarError;
+}
+
+void StereoCalibrator::Clear()
+{
+	m_ImagePoints[0].clear();
+	m_ImagePoints[1].clear();
+	m_ObjectPoints.clear();
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		m_CameraMatrix[eye].release();
+		m_DistortionCoef[eye].release();
+	}
+	m_Rotation.release();
+	m_Translation.release();
+	m_Essential.release();
+	m_Fundamental.release();
+	m_ImageSize = cv::Size();
+	m_ReprojectionError = 0.0;
+	m_EpipolarError = 0.0;
+}
+
+void StereoCalibrator::_refineCircleCenters(const cv::Mat& _grey, std::vector<cv::Point2f>& _centers) const
+{
+	// neighbours in a grid row are two squares apart, a window of one square around a center only covers its circle
+	float spacing = FLT_MAX;
+	for (int i = 0; i < m_BoardSize.height; ++i)
+	{
+		for (int j = 1; j < m_BoardSize.width; ++j)
+		{
+			cv::Point2f step = _centers[i * m_BoardSize.width + j] - _centers[i * m_BoardSize.width + j - 1];
+			spacing = std::min(spacing, std::sqrt(step.dot(step)));
+		}
+	}
+	int radius = std::max((int)(spacing / 4), 2);
+
+	// centroid of the darkness below the window's mid grey, twice so the window settles on the circle
+	for (auto& center : _centers)
+	{
+		cv::Point2f refined = center;
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			int cx = cvRound(refined.x);
+			int cy = cvRound(refined.y);
+			cv::Rect window = cv::Rect(cx - radius, cy - radius, 2 * radius + 1, 2 * radius + 1) & cv::Rect(0, 0, _grey.cols, _grey.rows);
+			if (window.area() == 0)
+			{
+				break;
+			}
+			double minVal, maxVal;
+			cv::minMaxLoc(_grey(window), &minVal, &maxVal);
+			double threshold = 0.5 * (minVal + maxVal);
+
+			double sum = 0.0, sumX = 0.0, sumY = 0.0;
+			for (int y = window.y; y < window.y + window.height; ++y)
+			{
+				const uchar* row = _grey.ptr<uchar>(y);
+				for (int x = window.x; x < window.x + window.width; ++x)
+				{
+					double weight = std::max(threshold - row[x], 0.0);
+					sum += weight;
+					sumX += weight * x;
+					sumY += weight * y;
+				}
+			}
+			if (sum <= 0.0)
+			{
+				break;
+			}
+			refined = cv::Point2f((float)(sumX / sum), (float)(sumY / sum));
+		}
+
+		// a center that wanders off by more than half the window found something else
+		cv::Point2f shift = refined - center;
+		if (shift.dot(shift) < 0.25f * radius * radius)
+		{
+			center = refined;
+		}
+	}
+}
+
+double StereoCalibrator::_epipolarError()
+{
+	// distance of every point to the epipolar line of its partner in the other image, both ways
+	int numberOfImages = GetNumPairs();
+	double err = 0;
+	int npoints = 0;
+	std::vector<cv::Vec3f> lines[2];
+	std::vector<cv::Point2f> undistorted[2];
+	for (int i = 0; i < numberOfImages; i++)
+	{
+		// undistorted into copies, the points are needed again by the next refinement
+		int npt = (int)m_ImagePoints[0][i].size();
+		for (int k = 0; k < 2; k++)
+		{
+			cv::undistortPoints(m_ImagePoints[k][i], undistorted[k], m_CameraMatrix[k], m_DistortionCoef[k], cv::Mat(), m_CameraMatrix[k]);
+			cv::computeCorrespondEpilines(undistorted[k], k + 1, m_Fundamental, lines[k]);
+		}
+		for (int j = 0; j < npt; j++)
+		{
+			double errij = fabs(undistorted[0][j].x*lines[1][j][0] +
+				undistorted[0][j].y*lines[1][j][1] + lines[1][j][2]) +
+				fabs(undistorted[1][j].x*lines[0][j][0] +
+					undistorted[1][j].y*lines[0][j][1] + lines[0][j][2]);
+			err += errij;
+		}
+		npoints += npt;
+	}
+	return npoints > 0 ? err / npoints : 0.0;
+}
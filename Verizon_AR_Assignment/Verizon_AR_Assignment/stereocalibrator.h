@@ -0,0 +1,68 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <opencv2\imgproc\imgproc.hpp>
+#include <vector>
+
+// Incremental stereo calibration against an asymmetric circle grid.
+// Pairs are added one at a time, by image or as grid points found elsewhere, and Refine solves for
+// the intrinsics and extrinsics of both cameras over every pair so far. The first solve starts from
+// scratch, every later one starts from the previous solution (or one set with SetSolution) and only
+// needs a few iterations to take in the new pairs. Refine returns the mean epipolar error of the
+// solution in pixels, the distance of every grid point to the epipolar line of its partner.
+class StereoCalibrator
+{
+public:
+	StereoCalibrator(cv::Size _boardSize = cv::Size(4, 11), int _squareSize = 12);
+	StereoCalibrator(const StereoCalibrator& _other) = default;
+	~StereoCalibrator() = default;
+
+	// detection only reads the calibrator, several images may be searched at once
+	bool FindGrid(const cv::Mat& _grey, std::vector<cv::Point2f>& _centers) const;
+
+	// false if the board is missing in either image or they differ in size from the earlier pairs
+	bool AddCalibrationPair(const cv::Mat& _left, const cv::Mat& _right);
+	bool AddCalibrationPoints(const std::vector<cv::Point2f>& _left, const std::vector<cv::Point2f>& _right, cv::Size _imageSize);
+	void SetSolution(const cv::Mat _cameraMatrix[2], const cv::Mat _distortionCoef[2], const cv::Mat& _rotation, const cv::Mat& _translation);
+	double Refine();
+	void Clear();
+
+	inline const cv::Mat& GetCameraMatrix(int _eye) const	{ return m_CameraMatrix[_eye]; }
+	inline const cv::Mat& GetDistortionCoef(int _eye) const	{ return m_DistortionCoef[_eye]; }
+	inline const cv::Mat& GetRotation() const				{ return m_Rotation; }
+	inline const cv::Mat& GetTranslation() const			{ return m_Translation; }
+	inline const cv::Mat& GetFundamental() const			{ return m_Fundamental; }
+	inline const cv::Mat& GetEssential() const				{ return m_Essential; }
+	inline cv::Size GetImageSize() const					{ return m_ImageSize; }
+	inline cv::Size GetBoardSize() const					{ return m_BoardSize; }
+	inline int		GetSquareSize() const					{ return m_SquareSize; }
+	inline int		GetNumPairs() const						{ return (int)m_ImagePoints[0].size(); }
+	inline double	GetReprojectionError() const			{ return m_ReprojectionError; }
+	inline double	GetEpipolarError() const				{ return m_EpipolarError; }
+	inline bool		IsCalibrated() const					{ return !m_CameraMatrix[0].empty(); }
+
+	static const int CALIBRATION_DETECTION_SIZE = 1280;	// longest side of the copy the board is detected on
+	static const int CALIBRATION_SOLVE_ITERATIONS = 100;
+	static const int CALIBRATION_REFINE_ITERATIONS = 10;
+
+private:
+	void _refineCircleCenters(const cv::Mat& _grey, std::vector<cv::Point2f>& _centers) const;
+	double _epipolarError();
+
+private:
+	cv::Size m_BoardSize;
+	int m_SquareSize;
+	cv::Size m_ImageSize;
+
+	std::vector<std::vector<cv::Point2f>> m_ImagePoints[2];
+	std::vector<std::vector<cv::Point3f>> m_ObjectPoints;
+
+	cv::Mat m_CameraMatrix[2];
+	cv::Mat m_DistortionCoef[2];
+	cv::Mat m_Rotation;
+	cv::Mat m_Translation;
+	cv::Mat m_Essential;
+	cv::Mat m_Fundamental;
+	double m_ReprojectionError;
+	double m_EpipolarError;
+};
@@ -0,0 +1,223 @@
+#include "stereokernels.h"
+#include <algorithm>
+#include <stdlib.h>
+
+static void _updateColumnCostSAD(const unsigned char* _addLeft, const unsigned char* _addRight,
+	const unsigned char* _subLeft, const unsigned char* _subRight,
+	unsigned short* _columnCost, int _width, int _numDisparities)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		int la = _addLeft[x];
+		for (int d = 0; d < _numDisparities; ++d)
+		{
+			col[d] = (unsigned short)(col[d] + abs(la - _addRight[x - d]));
+		}
+
+		if (_subLeft)
+		{
+			int ls = _subLeft[x];
+			for (int d = 0; d < _numDisparities; ++d)
+			{
+				col[d] = (unsigned short)(col[d] - abs(ls - _subRight[x - d]));
+			}
+		}
+	}
+}
+
+static inline int _popCount32(unsigned int _value)
+{
+	_value = _value - ((_value >> 1) & 0x55555555);
+	_value = (_value & 0x33333333) + ((_value >> 2) & 0x33333333);
+	return (((_value + (_value >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+static void _updateColumnCostCensus(const unsigned int* _addLeft, const unsigned int* _addRight,
+	const unsigned int* _subLeft, const unsigned int* _subRight,
+	unsigned short* _columnCost, int _width, int _numDisparities)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		unsigned int la = _addLeft[x];
+		for (int d = 0; d < _numDisparities; ++d)
+		{
+			col[d] = (unsigned short)(col[d] + _popCount32(la ^ _addRight[x - d]));
+		}
+
+		if (_subLeft)
+		{
+			unsigned int ls = _subLeft[x];
+			for (int d = 0; d < _numDisparities; ++d)
+			{
+				col[d] = (unsigned short)(col[d] - _popCount32(ls ^ _subRight[x - d]));
+			}
+		}
+	}
+}
+
+static void _boxSumRow(const unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius)
+{
+	if (_width <= 2 * _radius)
+	{
+		return;
+	}
+
+	// first window is summed in full, every next one adds the entering and drops the leaving column
+	unsigned short* cost = _cost + _radius * _numDisparities;
+	for (int d = 0; d < _numDisparities; ++d)
+	{
+		unsigned short sum = 0;
+		for (int x = 0; x <= 2 * _radius; ++x)
+		{
+			sum += _columnCost[x * _numDisparities + d];
+		}
+		cost[d] = sum;
+	}
+
+	for (int x = _radius + 1; x < _width - _radius; ++x)
+	{
+		const unsigned short* enter = _columnCost + (x + _radius) * _numDisparities;
+		const unsigned short* leave = _columnCost + (x - _radius - 1) * _numDisparities;
+		const unsigned short* prev = _cost + (x - 1) * _numDisparities;
+		cost = _cost + x * _numDisparities;
+		for (int d = 0; d < _numDisparities; ++d)
+		{
+			cost[d] = (unsigned short)(prev[d] + enter[d] - leave[d]);
+		}
+	}
+}
+
+static void _updateBoxSumRowSAD(const unsigned char* _addLeft, const unsigned char* _addRight,
+	const unsigned char* _subLeft, const unsigned char* _subRight,
+	unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius)
+{
+	_updateColumnCostSAD(_addLeft, _addRight, _subLeft, _subRight, _columnCost, _width, _numDisparities);
+	_boxSumRow(_columnCost, _cost, _width, _numDisparities, _radius);
+}
+
+static unsigned short _aggregatePathPixel(const unsigned short* _cost, const unsigned short* _prev, unsigned short _prevMin,
+	unsigned short* _path, unsigned short* _sum, int _numDisparities, int _P1, int _P2)
+{
+	unsigned int pathMin = 0xFFFF;
+	unsigned int jump = _prevMin + _P2;
+	for (int d = 0; d < _numDisparities; ++d)
+	{
+		unsigned int value = _cost[d];
+		if (_prev)
+		{
+			unsigned int best = std::min(std::min((unsigned int)_prev[d], jump),
+				std::min((unsigned int)_prev[d - 1], (unsigned int)_prev[d + 1]) + _P1);
+			value += best - _prevMin;
+		}
+		value = std::min(value, 0xFFFFu);
+		_path[d] = (unsigned short)value;
+		_sum[d] = (unsigned short)std::min(_sum[d] + value, 0xFFFFu);
+		pathMin = std::min(pathMin, value);
+	}
+	return (unsigned short)pathMin;
+}
+
+static void _selectDisparityRow(const unsigned short* _cost, short* _disparity, int _xBegin, int _xEnd,
+	int _numDisparities, int _minDisparity, int _uniquenessRatio)
+{
+	short invalid = StereoInvalidDisparity(_minDisparity);
+	for (int x = _xBegin; x < _xEnd; ++x)
+	{
+		const unsigned short* cost = _cost + x * _numDisparities;
+
+		int best = 0;
+		unsigned int minCost = cost[0];
+		for (int d = 1; d < _numDisparities; ++d)
+		{
+			if (cost[d] < minCost)
+			{
+				minCost = cost[d];
+				best = d;
+			}
+		}
+
+		if (_uniquenessRatio > 0)
+		{
+			unsigned int threshold = StereoUniquenessThreshold(minCost, _uniquenessRatio);
+			int lowerCount = 0;
+			for (int d = 0; d < _numDisparities; ++d)
+			{
+				lowerCount += cost[d] <= threshold;
+			}
+			if (StereoIsAmbiguous(cost, best, _numDisparities, lowerCount, threshold))
+			{
+				_disparity[x] = invalid;
+				continue;
+			}
+		}
+
+		_disparity[x] = StereoSubpixelDisparity(cost, best, _numDisparities, _minDisparity);
+	}
+}
+
+static void _remapBilinearRowC3(const unsigned char* _src, size_t _srcStep, int _srcWidth, int _srcHeight,
+	const short* _xy, const unsigned short* _fraction, unsigned char* _dst, int _width)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		StereoRemapPixelC3(_src, _srcStep, _srcWidth, _srcHeight, _xy[2 * x], _xy[2 * x + 1], _fraction[x], _dst + 3 * x);
+	}
+}
+
+static int _reprojectRowToVertices(const short* _disparity, const unsigned char* _bgr, int _width, short _minValid,
+	const StereoReprojectRow& _row, float* _vertices)
+{
+	int count = 0;
+	for (int x = 0; x < _width; ++x)
+	{
+		if (StereoReprojectPixel(x, _disparity[x], _bgr, _minValid, _row, _vertices ? _vertices + 6 * count : NULL))
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+static void _consistencyCheckRow(const short* _left, const short* _right, int _width, short _minValid, short _rightMinValid,
+	short _threshold, float* _weighted, float* _confidence)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		StereoConsistencyPixel(x, _left, _right, _width, _minValid, _rightMinValid, _threshold, _weighted, _confidence);
+	}
+}
+
+static void _smoothForwardRow(float* _x0, float* _x1, const float* _x0Prev, const float* _x1Prev,
+	const float* _weightPrev, const float* _weight, const float* _dPrev, float* _d, float _lambda, int _width)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		StereoSmoothForwardPixel(x, _x0, _x1, _x0Prev, _x1Prev, _weightPrev, _weight, _dPrev, _d, _lambda);
+	}
+}
+
+static void _smoothBackwardRow(float* _x0, float* _x1, const float* _x0Next, const float* _x1Next, const float* _d, int _width)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		StereoSmoothBackwardPixel(x, _x0, _x1, _x0Next, _x1Next, _d);
+	}
+}
+
+const StereoKernels& GetStereoKernelsScalar()
+{
+	static const StereoKernels kernels = { _updateColumnCostSAD, _updateColumnCostCensus, _boxSumRow, _updateBoxSumRowSAD, _aggregatePathPixel, _selectDisparityRow,
+		_remapBilinearRowC3, _reprojectRowToVertices, _consistencyCheckRow, _smoothForwardRow, _smoothBackwardRow };
+	return kernels;
+}
+
+const StereoKernels& GetStereoKernels()
+{
+	static const StereoKernels& kernels =
+		GetSimdLevel() == SIMD_LEVEL::SIMD_LEVEL_AVX2 ? GetStereoKernelsAVX2() :
+		GetSimdLevel() == SIMD_LEVEL::SIMD_LEVEL_SSE42 ? GetStereoKernelsSSE42() :
+		GetStereoKernelsScalar();
+	return kernels;
+}
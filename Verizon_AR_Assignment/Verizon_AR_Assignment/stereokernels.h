@@ -0,0 +1,266 @@
+#pragma once
+#include <stddef.h>
+#include <limits.h>
+#include <cstdlib>
+#include "simd.h"
+
+// Row kernels shared by the in-tree stereo matchers, the stereo rectifier, the disparity smoother and the
+// point cloud reprojection.
+// Cost rows are stored pixel major, _numDisparities 16 bit costs per pixel, and _numDisparities
+// must be a multiple of 16. Right image rows are passed pre-shifted by the minimum disparity and
+// padded so that _right[x - d] is readable for every x in [0, width) and d in [0, _numDisparities).
+// one row of the reprojection of ReprojectRowToVertices. every component of the homogeneous point is
+// a * x + b * d + c, x the column in the row and d the raw fixed point disparity, so the row's y, the
+// 1 / STEREO_DISP_SCALE and any scale of the output are folded into the coefficients. when W only depends
+// on the disparity, m_InverseW may hold 1 / W of the raw disparities from _minValid on (see DepthTable),
+// the same quotients the kernels divide to. the scalar kernel looks them up, the vector kernels divide
+// all lanes at once and disparities past its m_InverseWSize entries are divided as well
+struct StereoReprojectRow
+{
+	float m_X[3];
+	float m_Y[3];
+	float m_Z[3];
+	float m_W[3];
+	float m_DepthOffset;
+	const float* m_InverseW;
+	int m_InverseWSize;
+};
+
+struct StereoKernels
+{
+	// adds |left(x) - right(x - d)| of the entering row to the column costs and subtracts the
+	// same term for the leaving row. _subLeft/_subRight may be NULL while the column is filling up
+	void(*UpdateColumnCostSAD)(const unsigned char* _addLeft, const unsigned char* _addRight,
+		const unsigned char* _subLeft, const unsigned char* _subRight,
+		unsigned short* _columnCost, int _width, int _numDisparities);
+
+	// same as UpdateColumnCostSAD for census signatures, the cost is the hamming distance
+	// popcount(left(x) ^ right(x - d)) of the packed 32 bit descriptors
+	void(*UpdateColumnCostCensus)(const unsigned int* _addLeft, const unsigned int* _addRight,
+		const unsigned int* _subLeft, const unsigned int* _subRight,
+		unsigned short* _columnCost, int _width, int _numDisparities);
+
+	// horizontal box sum of the column costs, writes _cost for x in [_radius, _width - _radius)
+	void(*BoxSumRow)(const unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius);
+
+	// UpdateColumnCostSAD of a full window followed by BoxSumRow in a single pass over the columns, the box sum
+	// of a pixel is taken while the column that enters it is still in registers. same results as the two calls
+	void(*UpdateBoxSumRowSAD)(const unsigned char* _addLeft, const unsigned char* _addRight,
+		const unsigned char* _subLeft, const unsigned char* _subRight,
+		unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius);
+
+	// one pixel step of a semi-global matching path:
+	// _path(d) = _cost(d) + min(_prev(d), _prev(d - 1) + P1, _prev(d + 1) + P1, _prevMin + P2) - _prevMin
+	// added to _sum with saturation. _prev is NULL where the path enters the image, otherwise
+	// _prev[-1] and _prev[_numDisparities] must hold 0xFFFF sentinels. returns min(_path)
+	unsigned short(*AggregatePathPixel)(const unsigned short* _cost, const unsigned short* _prev, unsigned short _prevMin,
+		unsigned short* _path, unsigned short* _sum, int _numDisparities, int _P1, int _P2);
+
+	// winner takes all over the cost row for x in [_xBegin, _xEnd), writes 16 bit fixed point
+	// disparities (4 fractional bits) with parabolic sub-pixel refinement and a uniqueness check
+	void(*SelectDisparityRow)(const unsigned short* _cost, short* _disparity, int _xBegin, int _xEnd,
+		int _numDisparities, int _minDisparity, int _uniquenessRatio);
+
+	// bilinear remap of one row of a 3 channel 8 bit image through the fixed point tables of
+	// cv::initUndistortRectifyMap, _xy the integer source positions and _fraction the STEREO_REMAP_BITS
+	// fractions as y * STEREO_REMAP_SIZE + x. taps outside the source read 0 like cv::BORDER_CONSTANT
+	void(*RemapBilinearRowC3)(const unsigned char* _src, size_t _srcStep, int _srcWidth, int _srcHeight,
+		const short* _xy, const unsigned short* _fraction, unsigned char* _dst, int _width);
+
+	// reprojects a row of fixed point disparities to point vertices of 6 floats, the position
+	// (X / W, Y / W, Z / W + depth offset) followed by the RGB colour of the 3 channel BGR row in 0-1.
+	// pixels below _minValid or with W == 0 get no vertex, the others are written one after the other.
+	// returns the number of vertices, with _vertices NULL they are only counted and _bgr is not read
+	int(*ReprojectRowToVertices)(const short* _disparity, const unsigned char* _bgr, int _width, short _minValid,
+		const StereoReprojectRow& _row, float* _vertices);
+
+	// confidence of a row of fixed point disparities, 1 where the disparity is valid and, with a _right row,
+	// the right disparity it points at is valid and mirrors it within _threshold, 0 elsewhere. _weighted is
+	// the disparity times the confidence
+	void(*ConsistencyCheckRow)(const short* _left, const short* _right, int _width, short _minValid, short _rightMinValid,
+		short _threshold, float* _weighted, float* _confidence);
+
+	// one step of the recursive tridiagonal solve of the fast global smoother over _width independent lanes,
+	// the columns of a row or rows packed side by side. with a = _lambda * _weightPrev and c = _lambda * _weight
+	// the links to the previous and next step and r = 1 / (1 - a - c - a * _dPrev), _d = c * r and on both
+	// planes x = (x - a * xPrev) * r. the first step passes rows of zeros for everything previous
+	void(*SmoothForwardRow)(float* _x0, float* _x1, const float* _x0Prev, const float* _x1Prev,
+		const float* _weightPrev, const float* _weight, const float* _dPrev, float* _d, float _lambda, int _width);
+
+	// the back substitution of the solve, x -= _d * xNext on both planes
+	void(*SmoothBackwardRow)(float* _x0, float* _x1, const float* _x0Next, const float* _x1Next, const float* _d, int _width);
+};
+
+// table for the best instruction set available on this machine
+const StereoKernels& GetStereoKernels();
+
+const StereoKernels& GetStereoKernelsScalar();
+const StereoKernels& GetStereoKernelsSSE42();
+const StereoKernels& GetStereoKernelsAVX2();
+
+// the helpers below are compiled into the SSE4.2 and AVX2 units as well, static gives every unit its own copy
+// so the linker can never hand the scalar path one encoded for a wider instruction set
+
+// fixed point scale of the disparities produced by the kernels, matches cv::StereoMatcher::DISP_SCALE
+const int STEREO_DISP_SHIFT = 4;
+const int STEREO_DISP_SCALE = 1 << STEREO_DISP_SHIFT;
+
+// shifts a right image row by the minimum disparity and replicates the border into _padded[-_numDisparities, _width)
+template<typename T> static inline void StereoPadRightRow(const T* _row, int _width, int _minDisparity, int _numDisparities, T* _padded)
+{
+	for (int i = -_numDisparities; i < _width; ++i)
+	{
+		int src = i - _minDisparity;
+		src = src < 0 ? 0 : (src > _width - 1 ? _width - 1 : src);
+		_padded[i] = _row[src];
+	}
+}
+
+static inline short StereoInvalidDisparity(int _minDisparity)
+{
+	return (short)((_minDisparity - 1) * STEREO_DISP_SCALE);
+}
+
+// true if some disparity other than _best and its direct neighbours costs less than
+// _uniquenessRatio percent more than the best one. _lowerCount is the number of costs
+// in the whole pixel that are <= the threshold, counted by the caller
+static inline bool StereoIsAmbiguous(const unsigned short* _cost, int _best, int _numDisparities, int _lowerCount, unsigned int _threshold)
+{
+	for (int d = _best - 1; d <= _best + 1; ++d)
+	{
+		if (d >= 0 && d < _numDisparities && _cost[d] <= _threshold)
+		{
+			--_lowerCount;
+		}
+	}
+	return _lowerCount > 0;
+}
+
+static inline unsigned int StereoUniquenessThreshold(unsigned int _minCost, int _uniquenessRatio)
+{
+	unsigned int threshold = _minCost + _minCost * _uniquenessRatio / 100;
+	return threshold > 0xFFFF ? 0xFFFF : threshold;
+}
+
+// parabola fit through the best cost and its neighbours, same rounding as cv::StereoSGBM
+static inline short StereoSubpixelDisparity(const unsigned short* _cost, int _best, int _numDisparities, int _minDisparity)
+{
+	int d = _best * STEREO_DISP_SCALE;
+	if (_best > 0 && _best < _numDisparities - 1)
+	{
+		int n = _cost[_best - 1];
+		int p = _cost[_best + 1];
+		int denom2 = n + p - 2 * _cost[_best];
+		if (denom2 < 1)
+		{
+			denom2 = 1;
+		}
+		d += ((n - p) * STEREO_DISP_SCALE + denom2) / (denom2 * 2);
+	}
+	return (short)(d + _minDisparity * STEREO_DISP_SCALE);
+}
+
+// fraction bits of the remap tables, matches cv::INTER_BITS
+const int STEREO_REMAP_BITS = 5;
+const int STEREO_REMAP_SIZE = 1 << STEREO_REMAP_BITS;
+// the bilinear weights of a pixel sum to 1 << STEREO_REMAP_WEIGHT_SHIFT
+const int STEREO_REMAP_WEIGHT_SHIFT = 2 * STEREO_REMAP_BITS;
+
+// one output pixel of RemapBilinearRowC3, also used by the vector kernels near the image border.
+// the rounding is the one of cv::remap, so the result is the same
+static inline void StereoRemapPixelC3(const unsigned char* _src, size_t _srcStep, int _srcWidth, int _srcHeight,
+	int _x, int _y, int _fraction, unsigned char* _dst)
+{
+	int fx = _fraction & (STEREO_REMAP_SIZE - 1);
+	int fy = _fraction >> STEREO_REMAP_BITS;
+	int weight[4] = { (STEREO_REMAP_SIZE - fx) * (STEREO_REMAP_SIZE - fy), fx * (STEREO_REMAP_SIZE - fy), (STEREO_REMAP_SIZE - fx) * fy, fx * fy };
+	int sum[3] = { 0, 0, 0 };
+	for (int tap = 0; tap < 4; ++tap)
+	{
+		int tx = _x + (tap & 1);
+		int ty = _y + (tap >> 1);
+		if (tx < 0 || ty < 0 || tx >= _srcWidth || ty >= _srcHeight)
+		{
+			continue;
+		}
+		const unsigned char* pixel = _src + ty * _srcStep + tx * 3;
+		for (int c = 0; c < 3; ++c)
+		{
+			sum[c] += weight[tap] * pixel[c];
+		}
+	}
+	for (int c = 0; c < 3; ++c)
+	{
+		_dst[c] = (unsigned char)((sum[c] + (1 << (STEREO_REMAP_WEIGHT_SHIFT - 1))) >> STEREO_REMAP_WEIGHT_SHIFT);
+	}
+}
+
+const float STEREO_COLOR_SCALE = 1.0f / 255.0f;
+
+// 1 / W of the pixel _entry raw disparities above _minValid, from the row's table when it covers it
+static inline float StereoInverseW(const StereoReprojectRow& _row, int _entry, float _w)
+{
+	return _row.m_InverseW && (unsigned)_entry < (unsigned)_row.m_InverseWSize ? _row.m_InverseW[_entry] : 1.0f / _w;
+}
+
+// one pixel of ReprojectRowToVertices, also used by the vector kernels for the end of the row.
+// the arithmetic is the one of the vector kernels, so a pixel gets the same vertex from every kernel
+static inline bool StereoReprojectPixel(int _x, short _disparity, const unsigned char* _bgr, short _minValid, const StereoReprojectRow& _row, float* _vertex)
+{
+	if (_disparity < _minValid)
+	{
+		return false;
+	}
+	float x = (float)_x;
+	float d = (float)_disparity;
+	float w = _row.m_W[0] * x + _row.m_W[1] * d + _row.m_W[2];
+	if (w == 0.0f)
+	{
+		return false;
+	}
+	if (_vertex)
+	{
+		float iw = StereoInverseW(_row, _disparity - _minValid, w);
+		_vertex[0] = (_row.m_X[0] * x + _row.m_X[1] * d + _row.m_X[2]) * iw;
+		_vertex[1] = (_row.m_Y[0] * x + _row.m_Y[1] * d + _row.m_Y[2]) * iw;
+		_vertex[2] = (_row.m_Z[0] * x + _row.m_Z[1] * d + _row.m_Z[2]) * iw + _row.m_DepthOffset;
+		_vertex[3] = _bgr[3 * _x + 2] * STEREO_COLOR_SCALE;
+		_vertex[4] = _bgr[3 * _x + 1] * STEREO_COLOR_SCALE;
+		_vertex[5] = _bgr[3 * _x] * STEREO_COLOR_SCALE;
+	}
+	return true;
+}
+
+// one pixel of ConsistencyCheckRow, also used by the vector kernels for the end of the row
+static inline void StereoConsistencyPixel(int _x, const short* _left, const short* _right, int _width, short _minValid, short _rightMinValid,
+	short _threshold, float* _weighted, float* _confidence)
+{
+	int d = _left[_x];
+	bool valid = d >= _minValid;
+	if (valid && _right)
+	{
+		int xr = _x - ((d + STEREO_DISP_SCALE / 2) >> STEREO_DISP_SHIFT);
+		int r = (unsigned)xr < (unsigned)_width ? _right[xr] : SHRT_MIN;
+		valid = r >= _rightMinValid && abs(d + r) <= _threshold;
+	}
+	_weighted[_x] = valid ? (float)d : 0.0f;
+	_confidence[_x] = valid ? 1.0f : 0.0f;
+}
+
+// one lane of SmoothForwardRow and SmoothBackwardRow, in the order of the vector kernels
+static inline void StereoSmoothForwardPixel(int _x, float* _x0, float* _x1, const float* _x0Prev, const float* _x1Prev,
+	const float* _weightPrev, const float* _weight, const float* _dPrev, float* _d, float _lambda)
+{
+	float a = _lambda * _weightPrev[_x];
+	float c = _lambda * _weight[_x];
+	float r = 1.0f / (1.0f - a - c - a * _dPrev[_x]);
+	_d[_x] = c * r;
+	_x0[_x] = (_x0[_x] - a * _x0Prev[_x]) * r;
+	_x1[_x] = (_x1[_x] - a * _x1Prev[_x]) * r;
+}
+
+static inline void StereoSmoothBackwardPixel(int _x, float* _x0, float* _x1, const float* _x0Next, const float* _x1Next, const float* _d)
+{
+	_x0[_x] = _x0[_x] - _d[_x] * _x0Next[_x];
+	_x1[_x] = _x1[_x] - _d[_x] * _x1Next[_x];
+}
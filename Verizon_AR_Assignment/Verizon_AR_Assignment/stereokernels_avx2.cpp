@@ -0,0 +1,483 @@
+#include "stereokernels.h"
+#include <immintrin.h>
+
+// compiled with /arch:AVX2, only ever called when GetSimdLevel() reports avx2 support. no globals built with
+// intrinsics and no inline library templates such as std::min, the linker may keep this unit's copy of those
+
+// 16 disparities per register, right pixels are loaded backwards and widened to 16 bit
+static inline __m256i _absDiff16(__m256i _left, const unsigned char* _right)
+{
+	const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i bytes = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)_right), reverse);
+	return _mm256_abs_epi16(_mm256_sub_epi16(_left, _mm256_cvtepu8_epi16(bytes)));
+}
+
+static void _updateColumnCostSAD(const unsigned char* _addLeft, const unsigned char* _addRight,
+	const unsigned char* _subLeft, const unsigned char* _subRight,
+	unsigned short* _columnCost, int _width, int _numDisparities)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		__m256i la = _mm256_set1_epi16(_addLeft[x]);
+		const unsigned char* ra = _addRight + x - 15;
+
+		if (_subLeft)
+		{
+			__m256i ls = _mm256_set1_epi16(_subLeft[x]);
+			const unsigned char* rs = _subRight + x - 15;
+			for (int d = 0; d < _numDisparities; d += 16)
+			{
+				__m256i c = _mm256_loadu_si256((const __m256i*)(col + d));
+				c = _mm256_add_epi16(c, _absDiff16(la, ra - d));
+				c = _mm256_sub_epi16(c, _absDiff16(ls, rs - d));
+				_mm256_storeu_si256((__m256i*)(col + d), c);
+			}
+		}
+		else
+		{
+			for (int d = 0; d < _numDisparities; d += 16)
+			{
+				__m256i c = _mm256_loadu_si256((const __m256i*)(col + d));
+				c = _mm256_add_epi16(c, _absDiff16(la, ra - d));
+				_mm256_storeu_si256((__m256i*)(col + d), c);
+			}
+		}
+	}
+}
+
+// hamming distance of 8 signatures, nibble lookup popcount then bytes summed per 32 bit lane
+static inline __m256i _hammingDistance8(__m256i _left, const unsigned int* _right)
+{
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+	const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	__m256i right = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)_right), reverse);
+	__m256i bits = _mm256_xor_si256(_left, right);
+	__m256i count = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(bits, lowNibble)),
+		_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(bits, 4), lowNibble)));
+	return _mm256_madd_epi16(_mm256_maddubs_epi16(count, _mm256_set1_epi8(1)), _mm256_set1_epi16(1));
+}
+
+// 16 disparities, the pack interleaves the 128 bit halves so the quadwords are put back in order
+static inline __m256i _hammingDistance16(__m256i _left, const unsigned int* _right)
+{
+	__m256i packed = _mm256_packus_epi32(_hammingDistance8(_left, _right - 7), _hammingDistance8(_left, _right - 15));
+	return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static void _updateColumnCostCensus(const unsigned int* _addLeft, const unsigned int* _addRight,
+	const unsigned int* _subLeft, const unsigned int* _subRight,
+	unsigned short* _columnCost, int _width, int _numDisparities)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		__m256i la = _mm256_set1_epi32((int)_addLeft[x]);
+		const unsigned int* ra = _addRight + x;
+
+		if (_subLeft)
+		{
+			__m256i ls = _mm256_set1_epi32((int)_subLeft[x]);
+			const unsigned int* rs = _subRight + x;
+			for (int d = 0; d < _numDisparities; d += 16)
+			{
+				__m256i c = _mm256_loadu_si256((const __m256i*)(col + d));
+				c = _mm256_add_epi16(c, _hammingDistance16(la, ra - d));
+				c = _mm256_sub_epi16(c, _hammingDistance16(ls, rs - d));
+				_mm256_storeu_si256((__m256i*)(col + d), c);
+			}
+		}
+		else
+		{
+			for (int d = 0; d < _numDisparities; d += 16)
+			{
+				__m256i c = _mm256_loadu_si256((const __m256i*)(col + d));
+				c = _mm256_add_epi16(c, _hammingDistance16(la, ra - d));
+				_mm256_storeu_si256((__m256i*)(col + d), c);
+			}
+		}
+	}
+}
+
+static void _boxSumRow(const unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius)
+{
+	if (_width <= 2 * _radius)
+	{
+		return;
+	}
+
+	unsigned short* cost = _cost + _radius * _numDisparities;
+	for (int d = 0; d < _numDisparities; d += 16)
+	{
+		__m256i sum = _mm256_setzero_si256();
+		for (int x = 0; x <= 2 * _radius; ++x)
+		{
+			sum = _mm256_add_epi16(sum, _mm256_loadu_si256((const __m256i*)(_columnCost + x * _numDisparities + d)));
+		}
+		_mm256_storeu_si256((__m256i*)(cost + d), sum);
+	}
+
+	for (int x = _radius + 1; x < _width - _radius; ++x)
+	{
+		const unsigned short* enter = _columnCost + (x + _radius) * _numDisparities;
+		const unsigned short* leave = _columnCost + (x - _radius - 1) * _numDisparities;
+		const unsigned short* prev = _cost + (x - 1) * _numDisparities;
+		cost = _cost + x * _numDisparities;
+		for (int d = 0; d < _numDisparities; d += 16)
+		{
+			__m256i s = _mm256_loadu_si256((const __m256i*)(prev + d));
+			s = _mm256_add_epi16(s, _mm256_loadu_si256((const __m256i*)(enter + d)));
+			s = _mm256_sub_epi16(s, _mm256_loadu_si256((const __m256i*)(leave + d)));
+			_mm256_storeu_si256((__m256i*)(cost + d), s);
+		}
+	}
+}
+
+static void _updateBoxSumRowSAD(const unsigned char* _addLeft, const unsigned char* _addRight,
+	const unsigned char* _subLeft, const unsigned char* _subRight,
+	unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius)
+{
+	// column x completes the window of pixel x - _radius. the first window is summed in full, every next
+	// one adds the column just updated and drops the one that left
+	int window = 2 * _radius;
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		__m256i la = _mm256_set1_epi16(_addLeft[x]);
+		__m256i ls = _mm256_set1_epi16(_subLeft[x]);
+		const unsigned char* ra = _addRight + x - 15;
+		const unsigned char* rs = _subRight + x - 15;
+		for (int d = 0; d < _numDisparities; d += 16)
+		{
+			__m256i c = _mm256_loadu_si256((const __m256i*)(col + d));
+			c = _mm256_add_epi16(c, _absDiff16(la, ra - d));
+			c = _mm256_sub_epi16(c, _absDiff16(ls, rs - d));
+			_mm256_storeu_si256((__m256i*)(col + d), c);
+			if (x > window)
+			{
+				unsigned short* cost = _cost + (x - _radius) * _numDisparities;
+				const unsigned short* leave = _columnCost + (x - window - 1) * _numDisparities;
+				__m256i s = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(cost - _numDisparities + d)), c);
+				s = _mm256_sub_epi16(s, _mm256_loadu_si256((const __m256i*)(leave + d)));
+				_mm256_storeu_si256((__m256i*)(cost + d), s);
+			}
+			else if (x == window)
+			{
+				for (int k = 0; k < window; ++k)
+				{
+					c = _mm256_add_epi16(c, _mm256_loadu_si256((const __m256i*)(_columnCost + k * _numDisparities + d)));
+				}
+				_mm256_storeu_si256((__m256i*)(_cost + _radius * _numDisparities + d), c);
+			}
+		}
+	}
+}
+
+static inline unsigned short _horizontalMin(__m256i _value)
+{
+	__m128i min8 = _mm_min_epu16(_mm256_castsi256_si128(_value), _mm256_extracti128_si256(_value, 1));
+	return (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(min8));
+}
+
+static unsigned short _aggregatePathPixel(const unsigned short* _cost, const unsigned short* _prev, unsigned short _prevMin,
+	unsigned short* _path, unsigned short* _sum, int _numDisparities, int _P1, int _P2)
+{
+	__m256i pathMin = _mm256_set1_epi16(-1);
+	if (!_prev)
+	{
+		for (int d = 0; d < _numDisparities; d += 16)
+		{
+			__m256i value = _mm256_loadu_si256((const __m256i*)(_cost + d));
+			_mm256_storeu_si256((__m256i*)(_path + d), value);
+			_mm256_storeu_si256((__m256i*)(_sum + d), _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(_sum + d)), value));
+			pathMin = _mm256_min_epu16(pathMin, value);
+		}
+		return _horizontalMin(pathMin);
+	}
+
+	__m256i p1 = _mm256_set1_epi16((short)(_P1 < 0xFFFF ? _P1 : 0xFFFF));
+	__m256i prevMin = _mm256_set1_epi16((short)_prevMin);
+	__m256i jump = _mm256_set1_epi16((short)(_prevMin + _P2 < 0xFFFF ? _prevMin + _P2 : 0xFFFF));
+	for (int d = 0; d < _numDisparities; d += 16)
+	{
+		__m256i neighbours = _mm256_min_epu16(_mm256_loadu_si256((const __m256i*)(_prev + d - 1)), _mm256_loadu_si256((const __m256i*)(_prev + d + 1)));
+		__m256i best = _mm256_min_epu16(_mm256_loadu_si256((const __m256i*)(_prev + d)), _mm256_adds_epu16(neighbours, p1));
+		best = _mm256_min_epu16(best, jump);
+		__m256i value = _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(_cost + d)), _mm256_subs_epu16(best, prevMin));
+		_mm256_storeu_si256((__m256i*)(_path + d), value);
+		_mm256_storeu_si256((__m256i*)(_sum + d), _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(_sum + d)), value));
+		pathMin = _mm256_min_epu16(pathMin, value);
+	}
+	return _horizontalMin(pathMin);
+}
+
+static void _selectDisparityRow(const unsigned short* _cost, short* _disparity, int _xBegin, int _xEnd,
+	int _numDisparities, int _minDisparity, int _uniquenessRatio)
+{
+	short invalid = StereoInvalidDisparity(_minDisparity);
+	const __m256i allOnes = _mm256_set1_epi16(-1);
+	const __m256i step = _mm256_set1_epi16(16);
+	for (int x = _xBegin; x < _xEnd; ++x)
+	{
+		const unsigned short* cost = _cost + x * _numDisparities;
+
+		// per lane minimum and the first disparity reaching it
+		__m256i vmin = allOnes;
+		__m256i vidx = _mm256_setzero_si256();
+		__m256i didx = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		for (int d = 0; d < _numDisparities; d += 16)
+		{
+			__m256i c = _mm256_loadu_si256((const __m256i*)(cost + d));
+			__m256i m = _mm256_min_epu16(vmin, c);
+			vidx = _mm256_blendv_epi8(didx, vidx, _mm256_cmpeq_epi16(m, vmin));
+			vmin = m;
+			didx = _mm256_add_epi16(didx, step);
+		}
+
+		// fold both halves, then take the lowest disparity among the lanes holding the minimum
+		__m128i min8 = _mm_min_epu16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+		unsigned int minCost = (unsigned int)_mm_cvtsi128_si32(_mm_minpos_epu16(min8)) & 0xFFFF;
+		__m256i candidates = _mm256_blendv_epi8(allOnes, vidx, _mm256_cmpeq_epi16(vmin, _mm256_set1_epi16((short)minCost)));
+		__m128i candidates8 = _mm_min_epu16(_mm256_castsi256_si128(candidates), _mm256_extracti128_si256(candidates, 1));
+		int best = _mm_cvtsi128_si32(_mm_minpos_epu16(candidates8)) & 0xFFFF;
+
+		if (_uniquenessRatio > 0)
+		{
+			unsigned int threshold = StereoUniquenessThreshold(minCost, _uniquenessRatio);
+			__m256i vthreshold = _mm256_set1_epi16((short)threshold);
+			int lowerCount = 0;
+			for (int d = 0; d < _numDisparities; d += 16)
+			{
+				__m256i c = _mm256_loadu_si256((const __m256i*)(cost + d));
+				__m256i lower = _mm256_cmpeq_epi16(_mm256_min_epu16(c, vthreshold), c);
+				lowerCount += _mm_popcnt_u32(_mm256_movemask_epi8(lower)) >> 1;
+			}
+			if (StereoIsAmbiguous(cost, best, _numDisparities, lowerCount, threshold))
+			{
+				_disparity[x] = invalid;
+				continue;
+			}
+		}
+
+		_disparity[x] = StereoSubpixelDisparity(cost, best, _numDisparities, _minDisparity);
+	}
+}
+
+// 8 byte loads of both taps need two more bytes in the row and the row below inside the image
+static inline bool _remapInside(int _x, int _y, int _srcWidth, int _srcHeight)
+{
+	return (unsigned)_x <= (unsigned)(_srcWidth - 3) && (unsigned)_y < (unsigned)(_srcHeight - 1);
+}
+
+// the pair of 16 bit weights of one row tap, left pixel in the low half
+static inline int _remapWeights(int _fraction, bool _bottom)
+{
+	int fx = _fraction & (STEREO_REMAP_SIZE - 1);
+	int fy = _fraction >> STEREO_REMAP_BITS;
+	int row = _bottom ? fy : STEREO_REMAP_SIZE - fy;
+	return (fx * row) << 16 | ((STEREO_REMAP_SIZE - fx) * row);
+}
+
+static void _remapBilinearRowC3(const unsigned char* _src, size_t _srcStep, int _srcWidth, int _srcHeight,
+	const short* _xy, const unsigned short* _fraction, unsigned char* _dst, int _width)
+{
+	// per 128 bit lane the two pixels of a row tap interleaved per channel as 16 bit lanes, p0c0 p1c0 p0c1 p1c1 p0c2 p1c2 0 0.
+	// a plain byte table, a namespace scope __m256i would be built with AVX2 code at static initialisation on every CPU
+	alignas(32) static const char pairTable[32] = { 0, -128, 3, -128, 1, -128, 4, -128, 2, -128, 5, -128, -128, -128, -128, -128,
+		0, -128, 3, -128, 1, -128, 4, -128, 2, -128, 5, -128, -128, -128, -128, -128 };
+	const __m256i pairs = _mm256_load_si256((const __m256i*)pairTable);
+	const __m256i round = _mm256_set1_epi32(1 << (STEREO_REMAP_WEIGHT_SHIFT - 1));
+	int x = 0;
+
+	// two pixels per step, one in each 128 bit lane
+	for (; x + 1 < _width; x += 2)
+	{
+		int sx0 = _xy[2 * x], sy0 = _xy[2 * x + 1];
+		int sx1 = _xy[2 * x + 2], sy1 = _xy[2 * x + 3];
+		if (!_remapInside(sx0, sy0, _srcWidth, _srcHeight) || !_remapInside(sx1, sy1, _srcWidth, _srcHeight))
+		{
+			StereoRemapPixelC3(_src, _srcStep, _srcWidth, _srcHeight, sx0, sy0, _fraction[x], _dst + 3 * x);
+			StereoRemapPixelC3(_src, _srcStep, _srcWidth, _srcHeight, sx1, sy1, _fraction[x + 1], _dst + 3 * x + 3);
+			continue;
+		}
+
+		const unsigned char* pixel0 = _src + sy0 * _srcStep + sx0 * 3;
+		const unsigned char* pixel1 = _src + sy1 * _srcStep + sx1 * 3;
+		__m256i topPair = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)pixel0)), _mm_loadl_epi64((const __m128i*)pixel1), 1);
+		__m256i bottomPair = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)(pixel0 + _srcStep))), _mm_loadl_epi64((const __m128i*)(pixel1 + _srcStep)), 1);
+		topPair = _mm256_shuffle_epi8(topPair, pairs);
+		bottomPair = _mm256_shuffle_epi8(bottomPair, pairs);
+
+		int top0 = _remapWeights(_fraction[x], false), bottom0 = _remapWeights(_fraction[x], true);
+		int top1 = _remapWeights(_fraction[x + 1], false), bottom1 = _remapWeights(_fraction[x + 1], true);
+		__m256i topWeight = _mm256_setr_epi32(top0, top0, top0, 0, top1, top1, top1, 0);
+		__m256i bottomWeight = _mm256_setr_epi32(bottom0, bottom0, bottom0, 0, bottom1, bottom1, bottom1, 0);
+		__m256i sum = _mm256_add_epi32(_mm256_madd_epi16(topPair, topWeight), _mm256_madd_epi16(bottomPair, bottomWeight));
+		sum = _mm256_srli_epi32(_mm256_add_epi32(sum, round), STEREO_REMAP_WEIGHT_SHIFT);
+
+		// packs work per lane, byte 0..2 of each lane hold the channels
+		__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(sum, sum), sum);
+		int low = _mm256_extract_epi32(packed, 0);
+		int high = _mm256_extract_epi32(packed, 4);
+		_dst[3 * x] = (unsigned char)low;
+		_dst[3 * x + 1] = (unsigned char)(low >> 8);
+		_dst[3 * x + 2] = (unsigned char)(low >> 16);
+		_dst[3 * x + 3] = (unsigned char)high;
+		_dst[3 * x + 4] = (unsigned char)(high >> 8);
+		_dst[3 * x + 5] = (unsigned char)(high >> 16);
+	}
+	for (; x < _width; ++x)
+	{
+		StereoRemapPixelC3(_src, _srcStep, _srcWidth, _srcHeight, _xy[2 * x], _xy[2 * x + 1], _fraction[x], _dst + 3 * x);
+	}
+}
+
+static int _reprojectRowToVertices(const short* _disparity, const unsigned char* _bgr, int _width, short _minValid,
+	const StereoReprojectRow& _row, float* _vertices)
+{
+	// 8 pixels at a time, the vertices of the valid ones are copied out of the lanes
+	const __m256 ax = _mm256_set1_ps(_row.m_X[0]), bx = _mm256_set1_ps(_row.m_X[1]), cx = _mm256_set1_ps(_row.m_X[2]);
+	const __m256 ay = _mm256_set1_ps(_row.m_Y[0]), by = _mm256_set1_ps(_row.m_Y[1]), cy = _mm256_set1_ps(_row.m_Y[2]);
+	const __m256 az = _mm256_set1_ps(_row.m_Z[0]), bz = _mm256_set1_ps(_row.m_Z[1]), cz = _mm256_set1_ps(_row.m_Z[2]);
+	const __m256 aw = _mm256_set1_ps(_row.m_W[0]), bw = _mm256_set1_ps(_row.m_W[1]), cw = _mm256_set1_ps(_row.m_W[2]);
+	const __m256 offset = _mm256_set1_ps(_row.m_DepthOffset);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 steps = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	const __m256i minValid = _mm256_set1_epi32(_minValid - 1);
+
+	int count = 0;
+	int x = 0;
+	for (; x + 8 <= _width; x += 8)
+	{
+		__m256i raw = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(_disparity + x)));
+		__m256 d = _mm256_cvtepi32_ps(raw);
+		__m256 fx = _mm256_add_ps(_mm256_set1_ps((float)x), steps);
+		__m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(aw, fx), _mm256_mul_ps(bw, d)), cw);
+		int mask = _mm256_movemask_ps(_mm256_andnot_ps(_mm256_cmp_ps(w, zero, _CMP_EQ_OQ), _mm256_castsi256_ps(_mm256_cmpgt_epi32(raw, minValid))));
+		if (!mask)
+		{
+			continue;
+		}
+		if (!_vertices)
+		{
+			count += _mm_popcnt_u32(mask);
+			continue;
+		}
+
+		// the table holds the very quotients of this division, gathering them measured no faster
+		__m256 iw = _mm256_div_ps(one, w);
+		alignas(32) float px[8], py[8], pz[8];
+		_mm256_store_ps(px, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, fx), _mm256_mul_ps(bx, d)), cx), iw));
+		_mm256_store_ps(py, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ay, fx), _mm256_mul_ps(by, d)), cy), iw));
+		_mm256_store_ps(pz, _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(az, fx), _mm256_mul_ps(bz, d)), cz), iw), offset));
+		for (int i = 0; i < 8; ++i)
+		{
+			if (mask & (1 << i))
+			{
+				const unsigned char* color = _bgr + 3 * (x + i);
+				float* vertex = _vertices + 6 * count++;
+				vertex[0] = px[i];
+				vertex[1] = py[i];
+				vertex[2] = pz[i];
+				vertex[3] = color[2] * STEREO_COLOR_SCALE;
+				vertex[4] = color[1] * STEREO_COLOR_SCALE;
+				vertex[5] = color[0] * STEREO_COLOR_SCALE;
+			}
+		}
+	}
+	for (; x < _width; ++x)
+	{
+		if (StereoReprojectPixel(x, _disparity[x], _bgr, _minValid, _row, _vertices ? _vertices + 6 * count : NULL))
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+static void _consistencyCheckRow(const short* _left, const short* _right, int _width, short _minValid, short _rightMinValid,
+	short _threshold, float* _weighted, float* _confidence)
+{
+	// 8 pixels at a time in 32 bit lanes, the right disparities they point at are gathered one by one
+	const __m256i minValid = _mm256_set1_epi32(_minValid - 1);
+	const __m256i rightMinValid = _mm256_set1_epi32(_rightMinValid - 1);
+	const __m256i threshold = _mm256_set1_epi32(_threshold + 1);
+	const __m256i half = _mm256_set1_epi32(STEREO_DISP_SCALE / 2);
+	const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	int x = 0;
+	for (; x + 8 <= _width; x += 8)
+	{
+		__m256i d = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(_left + x)));
+		__m256i valid = _mm256_cmpgt_epi32(d, minValid);
+		if (_right)
+		{
+			alignas(32) int xr[8], r[8];
+			__m256i shift = _mm256_srai_epi32(_mm256_add_epi32(d, half), STEREO_DISP_SHIFT);
+			_mm256_store_si256((__m256i*)xr, _mm256_sub_epi32(_mm256_add_epi32(_mm256_set1_epi32(x), steps), shift));
+			for (int i = 0; i < 8; ++i)
+			{
+				r[i] = (unsigned)xr[i] < (unsigned)_width ? _right[xr[i]] : SHRT_MIN;
+			}
+			__m256i right = _mm256_load_si256((const __m256i*)r);
+			__m256i mirrored = _mm256_cmpgt_epi32(threshold, _mm256_abs_epi32(_mm256_add_epi32(d, right)));
+			valid = _mm256_and_si256(valid, _mm256_and_si256(_mm256_cmpgt_epi32(right, rightMinValid), mirrored));
+		}
+		__m256 mask = _mm256_castsi256_ps(valid);
+		_mm256_storeu_ps(_weighted + x, _mm256_and_ps(mask, _mm256_cvtepi32_ps(d)));
+		_mm256_storeu_ps(_confidence + x, _mm256_and_ps(mask, one));
+	}
+	for (; x < _width; ++x)
+	{
+		StereoConsistencyPixel(x, _left, _right, _width, _minValid, _rightMinValid, _threshold, _weighted, _confidence);
+	}
+}
+
+static void _smoothForwardRow(float* _x0, float* _x1, const float* _x0Prev, const float* _x1Prev,
+	const float* _weightPrev, const float* _weight, const float* _dPrev, float* _d, float _lambda, int _width)
+{
+	// separate multiplies and adds, a fused multiply-add would round differently from the other kernels
+	const __m256 lambda = _mm256_set1_ps(_lambda);
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	int x = 0;
+	for (; x + 8 <= _width; x += 8)
+	{
+		__m256 a = _mm256_mul_ps(lambda, _mm256_loadu_ps(_weightPrev + x));
+		__m256 c = _mm256_mul_ps(lambda, _mm256_loadu_ps(_weight + x));
+		__m256 r = _mm256_div_ps(one, _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(one, a), c), _mm256_mul_ps(a, _mm256_loadu_ps(_dPrev + x))));
+		_mm256_storeu_ps(_d + x, _mm256_mul_ps(c, r));
+		_mm256_storeu_ps(_x0 + x, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(_x0 + x), _mm256_mul_ps(a, _mm256_loadu_ps(_x0Prev + x))), r));
+		_mm256_storeu_ps(_x1 + x, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(_x1 + x), _mm256_mul_ps(a, _mm256_loadu_ps(_x1Prev + x))), r));
+	}
+	for (; x < _width; ++x)
+	{
+		StereoSmoothForwardPixel(x, _x0, _x1, _x0Prev, _x1Prev, _weightPrev, _weight, _dPrev, _d, _lambda);
+	}
+}
+
+static void _smoothBackwardRow(float* _x0, float* _x1, const float* _x0Next, const float* _x1Next, const float* _d, int _width)
+{
+	int x = 0;
+	for (; x + 8 <= _width; x += 8)
+	{
+		__m256 d = _mm256_loadu_ps(_d + x);
+		_mm256_storeu_ps(_x0 + x, _mm256_sub_ps(_mm256_loadu_ps(_x0 + x), _mm256_mul_ps(d, _mm256_loadu_ps(_x0Next + x))));
+		_mm256_storeu_ps(_x1 + x, _mm256_sub_ps(_mm256_loadu_ps(_x1 + x), _mm256_mul_ps(d, _mm256_loadu_ps(_x1Next + x))));
+	}
+	for (; x < _width; ++x)
+	{
+		StereoSmoothBackwardPixel(x, _x0, _x1, _x0Next, _x1Next, _d);
+	}
+}
+
+const StereoKernels& GetStereoKernelsAVX2()
+{
+	static const StereoKernels kernels = { _updateColumnCostSAD, _updateColumnCostCensus, _boxSumRow, _updateBoxSumRowSAD, _aggregatePathPixel, _selectDisparityRow,
+		_remapBilinearRowC3, _reprojectRowToVertices, _consistencyCheckRow, _smoothForwardRow, _smoothBackwardRow };
+	return kernels;
+}
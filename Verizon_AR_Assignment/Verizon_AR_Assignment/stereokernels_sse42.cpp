@@ -0,0 +1,437 @@
+#include "stereokernels.h"
+#include <nmmintrin.h>
+
+// 8 disparities per register, right pixels are loaded backwards and widened to 16 bit in one shuffle
+static const __m128i REVERSE_WIDEN_8 = _mm_setr_epi8(7, -128, 6, -128, 5, -128, 4, -128, 3, -128, 2, -128, 1, -128, 0, -128);
+
+static inline __m128i _absDiff8(__m128i _left, const unsigned char* _right)
+{
+	__m128i right = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)_right), REVERSE_WIDEN_8);
+	return _mm_abs_epi16(_mm_sub_epi16(_left, right));
+}
+
+static void _updateColumnCostSAD(const unsigned char* _addLeft, const unsigned char* _addRight,
+	const unsigned char* _subLeft, const unsigned char* _subRight,
+	unsigned short* _columnCost, int _width, int _numDisparities)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		__m128i la = _mm_set1_epi16(_addLeft[x]);
+		const unsigned char* ra = _addRight + x - 7;
+
+		if (_subLeft)
+		{
+			__m128i ls = _mm_set1_epi16(_subLeft[x]);
+			const unsigned char* rs = _subRight + x - 7;
+			for (int d = 0; d < _numDisparities; d += 8)
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(col + d));
+				c = _mm_add_epi16(c, _absDiff8(la, ra - d));
+				c = _mm_sub_epi16(c, _absDiff8(ls, rs - d));
+				_mm_storeu_si128((__m128i*)(col + d), c);
+			}
+		}
+		else
+		{
+			for (int d = 0; d < _numDisparities; d += 8)
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(col + d));
+				c = _mm_add_epi16(c, _absDiff8(la, ra - d));
+				_mm_storeu_si128((__m128i*)(col + d), c);
+			}
+		}
+	}
+}
+
+// hamming distance of 4 signatures, nibble lookup popcount then bytes summed per 32 bit lane
+static inline __m128i _hammingDistance4(__m128i _left, const unsigned int* _right)
+{
+	const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m128i lowNibble = _mm_set1_epi8(0x0F);
+	__m128i right = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)_right), _MM_SHUFFLE(0, 1, 2, 3));
+	__m128i bits = _mm_xor_si128(_left, right);
+	__m128i count = _mm_add_epi8(_mm_shuffle_epi8(lookup, _mm_and_si128(bits, lowNibble)),
+		_mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(bits, 4), lowNibble)));
+	return _mm_madd_epi16(_mm_maddubs_epi16(count, _mm_set1_epi8(1)), _mm_set1_epi16(1));
+}
+
+static inline __m128i _hammingDistance8(__m128i _left, const unsigned int* _right)
+{
+	return _mm_packus_epi32(_hammingDistance4(_left, _right - 3), _hammingDistance4(_left, _right - 7));
+}
+
+static void _updateColumnCostCensus(const unsigned int* _addLeft, const unsigned int* _addRight,
+	const unsigned int* _subLeft, const unsigned int* _subRight,
+	unsigned short* _columnCost, int _width, int _numDisparities)
+{
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		__m128i la = _mm_set1_epi32((int)_addLeft[x]);
+		const unsigned int* ra = _addRight + x;
+
+		if (_subLeft)
+		{
+			__m128i ls = _mm_set1_epi32((int)_subLeft[x]);
+			const unsigned int* rs = _subRight + x;
+			for (int d = 0; d < _numDisparities; d += 8)
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(col + d));
+				c = _mm_add_epi16(c, _hammingDistance8(la, ra - d));
+				c = _mm_sub_epi16(c, _hammingDistance8(ls, rs - d));
+				_mm_storeu_si128((__m128i*)(col + d), c);
+			}
+		}
+		else
+		{
+			for (int d = 0; d < _numDisparities; d += 8)
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(col + d));
+				c = _mm_add_epi16(c, _hammingDistance8(la, ra - d));
+				_mm_storeu_si128((__m128i*)(col + d), c);
+			}
+		}
+	}
+}
+
+static void _boxSumRow(const unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius)
+{
+	if (_width <= 2 * _radius)
+	{
+		return;
+	}
+
+	unsigned short* cost = _cost + _radius * _numDisparities;
+	for (int d = 0; d < _numDisparities; d += 8)
+	{
+		__m128i sum = _mm_setzero_si128();
+		for (int x = 0; x <= 2 * _radius; ++x)
+		{
+			sum = _mm_add_epi16(sum, _mm_loadu_si128((const __m128i*)(_columnCost + x * _numDisparities + d)));
+		}
+		_mm_storeu_si128((__m128i*)(cost + d), sum);
+	}
+
+	for (int x = _radius + 1; x < _width - _radius; ++x)
+	{
+		const unsigned short* enter = _columnCost + (x + _radius) * _numDisparities;
+		const unsigned short* leave = _columnCost + (x - _radius - 1) * _numDisparities;
+		const unsigned short* prev = _cost + (x - 1) * _numDisparities;
+		cost = _cost + x * _numDisparities;
+		for (int d = 0; d < _numDisparities; d += 8)
+		{
+			__m128i s = _mm_loadu_si128((const __m128i*)(prev + d));
+			s = _mm_add_epi16(s, _mm_loadu_si128((const __m128i*)(enter + d)));
+			s = _mm_sub_epi16(s, _mm_loadu_si128((const __m128i*)(leave + d)));
+			_mm_storeu_si128((__m128i*)(cost + d), s);
+		}
+	}
+}
+
+static void _updateBoxSumRowSAD(const unsigned char* _addLeft, const unsigned char* _addRight,
+	const unsigned char* _subLeft, const unsigned char* _subRight,
+	unsigned short* _columnCost, unsigned short* _cost, int _width, int _numDisparities, int _radius)
+{
+	// column x completes the window of pixel x - _radius. the first window is summed in full, every next
+	// one adds the column just updated and drops the one that left
+	int window = 2 * _radius;
+	for (int x = 0; x < _width; ++x)
+	{
+		unsigned short* col = _columnCost + x * _numDisparities;
+		__m128i la = _mm_set1_epi16(_addLeft[x]);
+		__m128i ls = _mm_set1_epi16(_subLeft[x]);
+		const unsigned char* ra = _addRight + x - 7;
+		const unsigned char* rs = _subRight + x - 7;
+		for (int d = 0; d < _numDisparities; d += 8)
+		{
+			__m128i c = _mm_loadu_si128((const __m128i*)(col + d));
+			c = _mm_add_epi16(c, _absDiff8(la, ra - d));
+			c = _mm_sub_epi16(c, _absDiff8(ls, rs - d));
+			_mm_storeu_si128((__m128i*)(col + d), c);
+			if (x > window)
+			{
+				unsigned short* cost = _cost + (x - _radius) * _numDisparities;
+				const unsigned short* leave = _columnCost + (x - window - 1) * _numDisparities;
+				__m128i s = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(cost - _numDisparities + d)), c);
+				s = _mm_sub_epi16(s, _mm_loadu_si128((const __m128i*)(leave + d)));
+				_mm_storeu_si128((__m128i*)(cost + d), s);
+			}
+			else if (x == window)
+			{
+				for (int k = 0; k < window; ++k)
+				{
+					c = _mm_add_epi16(c, _mm_loadu_si128((const __m128i*)(_columnCost + k * _numDisparities + d)));
+				}
+				_mm_storeu_si128((__m128i*)(_cost + _radius * _numDisparities + d), c);
+			}
+		}
+	}
+}
+
+static unsigned short _aggregatePathPixel(const unsigned short* _cost, const unsigned short* _prev, unsigned short _prevMin,
+	unsigned short* _path, unsigned short* _sum, int _numDisparities, int _P1, int _P2)
+{
+	__m128i pathMin = _mm_set1_epi16(-1);
+	if (!_prev)
+	{
+		for (int d = 0; d < _numDisparities; d += 8)
+		{
+			__m128i value = _mm_loadu_si128((const __m128i*)(_cost + d));
+			_mm_storeu_si128((__m128i*)(_path + d), value);
+			_mm_storeu_si128((__m128i*)(_sum + d), _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(_sum + d)), value));
+			pathMin = _mm_min_epu16(pathMin, value);
+		}
+		return (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(pathMin));
+	}
+
+	__m128i p1 = _mm_set1_epi16((short)(_P1 < 0xFFFF ? _P1 : 0xFFFF));
+	__m128i prevMin = _mm_set1_epi16((short)_prevMin);
+	__m128i jump = _mm_set1_epi16((short)(_prevMin + _P2 < 0xFFFF ? _prevMin + _P2 : 0xFFFF));
+	for (int d = 0; d < _numDisparities; d += 8)
+	{
+		__m128i neighbours = _mm_min_epu16(_mm_loadu_si128((const __m128i*)(_prev + d - 1)), _mm_loadu_si128((const __m128i*)(_prev + d + 1)));
+		__m128i best = _mm_min_epu16(_mm_loadu_si128((const __m128i*)(_prev + d)), _mm_adds_epu16(neighbours, p1));
+		best = _mm_min_epu16(best, jump);
+		__m128i value = _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(_cost + d)), _mm_subs_epu16(best, prevMin));
+		_mm_storeu_si128((__m128i*)(_path + d), value);
+		_mm_storeu_si128((__m128i*)(_sum + d), _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(_sum + d)), value));
+		pathMin = _mm_min_epu16(pathMin, value);
+	}
+	return (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(pathMin));
+}
+
+static void _selectDisparityRow(const unsigned short* _cost, short* _disparity, int _xBegin, int _xEnd,
+	int _numDisparities, int _minDisparity, int _uniquenessRatio)
+{
+	short invalid = StereoInvalidDisparity(_minDisparity);
+	const __m128i allOnes = _mm_set1_epi16(-1);
+	const __m128i step = _mm_set1_epi16(8);
+	for (int x = _xBegin; x < _xEnd; ++x)
+	{
+		const unsigned short* cost = _cost + x * _numDisparities;
+
+		// per lane minimum and the first disparity reaching it
+		__m128i vmin = allOnes;
+		__m128i vidx = _mm_setzero_si128();
+		__m128i didx = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+		for (int d = 0; d < _numDisparities; d += 8)
+		{
+			__m128i c = _mm_loadu_si128((const __m128i*)(cost + d));
+			__m128i m = _mm_min_epu16(vmin, c);
+			vidx = _mm_blendv_epi8(didx, vidx, _mm_cmpeq_epi16(m, vmin));
+			vmin = m;
+			didx = _mm_add_epi16(didx, step);
+		}
+
+		// lowest disparity among the lanes holding the minimum, ties resolve like the scalar kernel
+		unsigned int minCost = (unsigned int)_mm_cvtsi128_si32(_mm_minpos_epu16(vmin)) & 0xFFFF;
+		__m128i candidates = _mm_blendv_epi8(allOnes, vidx, _mm_cmpeq_epi16(vmin, _mm_set1_epi16((short)minCost)));
+		int best = _mm_cvtsi128_si32(_mm_minpos_epu16(candidates)) & 0xFFFF;
+
+		if (_uniquenessRatio > 0)
+		{
+			unsigned int threshold = StereoUniquenessThreshold(minCost, _uniquenessRatio);
+			__m128i vthreshold = _mm_set1_epi16((short)threshold);
+			int lowerCount = 0;
+			for (int d = 0; d < _numDisparities; d += 8)
+			{
+				__m128i c = _mm_loadu_si128((const __m128i*)(cost + d));
+				__m128i lower = _mm_cmpeq_epi16(_mm_min_epu16(c, vthreshold), c);
+				lowerCount += _mm_popcnt_u32(_mm_movemask_epi8(lower)) >> 1;
+			}
+			if (StereoIsAmbiguous(cost, best, _numDisparities, lowerCount, threshold))
+			{
+				_disparity[x] = invalid;
+				continue;
+			}
+		}
+
+		_disparity[x] = StereoSubpixelDisparity(cost, best, _numDisparities, _minDisparity);
+	}
+}
+
+// the two pixels of a row tap interleaved per channel as 16 bit lanes, p0c0 p1c0 p0c1 p1c1 p0c2 p1c2 0 0
+static const __m128i REMAP_PAIRS = _mm_setr_epi8(0, -128, 3, -128, 1, -128, 4, -128, 2, -128, 5, -128, -128, -128, -128, -128);
+
+static void _remapBilinearRowC3(const unsigned char* _src, size_t _srcStep, int _srcWidth, int _srcHeight,
+	const short* _xy, const unsigned short* _fraction, unsigned char* _dst, int _width)
+{
+	const __m128i round = _mm_set1_epi32(1 << (STEREO_REMAP_WEIGHT_SHIFT - 1));
+	for (int x = 0; x < _width; ++x)
+	{
+		int sx = _xy[2 * x];
+		int sy = _xy[2 * x + 1];
+
+		// 8 byte loads of both taps need two more bytes in the row and the row below inside the image
+		if ((unsigned)sx > (unsigned)(_srcWidth - 3) || (unsigned)sy >= (unsigned)(_srcHeight - 1))
+		{
+			StereoRemapPixelC3(_src, _srcStep, _srcWidth, _srcHeight, sx, sy, _fraction[x], _dst + 3 * x);
+			continue;
+		}
+
+		int fx = _fraction[x] & (STEREO_REMAP_SIZE - 1);
+		int fy = _fraction[x] >> STEREO_REMAP_BITS;
+		int top = STEREO_REMAP_SIZE - fy;
+		__m128i topWeight = _mm_set1_epi32((fx * top) << 16 | ((STEREO_REMAP_SIZE - fx) * top));
+		__m128i bottomWeight = _mm_set1_epi32((fx * fy) << 16 | ((STEREO_REMAP_SIZE - fx) * fy));
+
+		const unsigned char* pixel = _src + sy * _srcStep + sx * 3;
+		__m128i topPair = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)pixel), REMAP_PAIRS);
+		__m128i bottomPair = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)(pixel + _srcStep)), REMAP_PAIRS);
+		__m128i sum = _mm_add_epi32(_mm_madd_epi16(topPair, topWeight), _mm_madd_epi16(bottomPair, bottomWeight));
+		sum = _mm_srli_epi32(_mm_add_epi32(sum, round), STEREO_REMAP_WEIGHT_SHIFT);
+
+		int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(sum, sum), sum));
+		_dst[3 * x] = (unsigned char)packed;
+		_dst[3 * x + 1] = (unsigned char)(packed >> 8);
+		_dst[3 * x + 2] = (unsigned char)(packed >> 16);
+	}
+}
+
+static int _reprojectRowToVertices(const short* _disparity, const unsigned char* _bgr, int _width, short _minValid,
+	const StereoReprojectRow& _row, float* _vertices)
+{
+	// 4 pixels at a time, the vertices of the valid ones are copied out of the lanes
+	const __m128 ax = _mm_set1_ps(_row.m_X[0]), bx = _mm_set1_ps(_row.m_X[1]), cx = _mm_set1_ps(_row.m_X[2]);
+	const __m128 ay = _mm_set1_ps(_row.m_Y[0]), by = _mm_set1_ps(_row.m_Y[1]), cy = _mm_set1_ps(_row.m_Y[2]);
+	const __m128 az = _mm_set1_ps(_row.m_Z[0]), bz = _mm_set1_ps(_row.m_Z[1]), cz = _mm_set1_ps(_row.m_Z[2]);
+	const __m128 aw = _mm_set1_ps(_row.m_W[0]), bw = _mm_set1_ps(_row.m_W[1]), cw = _mm_set1_ps(_row.m_W[2]);
+	const __m128 offset = _mm_set1_ps(_row.m_DepthOffset);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 steps = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128i minValid = _mm_set1_epi32(_minValid - 1);
+
+	int count = 0;
+	int x = 0;
+	for (; x + 4 <= _width; x += 4)
+	{
+		__m128i raw = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(_disparity + x)));
+		__m128 d = _mm_cvtepi32_ps(raw);
+		__m128 fx = _mm_add_ps(_mm_set1_ps((float)x), steps);
+		__m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, fx), _mm_mul_ps(bw, d)), cw);
+		int mask = _mm_movemask_ps(_mm_andnot_ps(_mm_cmpeq_ps(w, zero), _mm_castsi128_ps(_mm_cmpgt_epi32(raw, minValid))));
+		if (!mask)
+		{
+			continue;
+		}
+		if (!_vertices)
+		{
+			count += _mm_popcnt_u32(mask);
+			continue;
+		}
+
+		// the table holds the very quotients of this division, without a gather looking them up measured slower
+		__m128 iw = _mm_div_ps(one, w);
+		alignas(16) float px[4], py[4], pz[4];
+		_mm_store_ps(px, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, fx), _mm_mul_ps(bx, d)), cx), iw));
+		_mm_store_ps(py, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ay, fx), _mm_mul_ps(by, d)), cy), iw));
+		_mm_store_ps(pz, _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(az, fx), _mm_mul_ps(bz, d)), cz), iw), offset));
+		for (int i = 0; i < 4; ++i)
+		{
+			if (mask & (1 << i))
+			{
+				const unsigned char* color = _bgr + 3 * (x + i);
+				float* vertex = _vertices + 6 * count++;
+				vertex[0] = px[i];
+				vertex[1] = py[i];
+				vertex[2] = pz[i];
+				vertex[3] = color[2] * STEREO_COLOR_SCALE;
+				vertex[4] = color[1] * STEREO_COLOR_SCALE;
+				vertex[5] = color[0] * STEREO_COLOR_SCALE;
+			}
+		}
+	}
+	for (; x < _width; ++x)
+	{
+		if (StereoReprojectPixel(x, _disparity[x], _bgr, _minValid, _row, _vertices ? _vertices + 6 * count : NULL))
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+static void _consistencyCheckRow(const short* _left, const short* _right, int _width, short _minValid, short _rightMinValid,
+	short _threshold, float* _weighted, float* _confidence)
+{
+	// 4 pixels at a time in 32 bit lanes, the right disparities they point at are gathered one by one
+	const __m128i minValid = _mm_set1_epi32(_minValid - 1);
+	const __m128i rightMinValid = _mm_set1_epi32(_rightMinValid - 1);
+	const __m128i threshold = _mm_set1_epi32(_threshold + 1);
+	const __m128i half = _mm_set1_epi32(STEREO_DISP_SCALE / 2);
+	const __m128i steps = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	int x = 0;
+	for (; x + 4 <= _width; x += 4)
+	{
+		__m128i d = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(_left + x)));
+		__m128i valid = _mm_cmpgt_epi32(d, minValid);
+		if (_right)
+		{
+			alignas(16) int xr[4], r[4];
+			__m128i shift = _mm_srai_epi32(_mm_add_epi32(d, half), STEREO_DISP_SHIFT);
+			_mm_store_si128((__m128i*)xr, _mm_sub_epi32(_mm_add_epi32(_mm_set1_epi32(x), steps), shift));
+			for (int i = 0; i < 4; ++i)
+			{
+				r[i] = (unsigned)xr[i] < (unsigned)_width ? _right[xr[i]] : SHRT_MIN;
+			}
+			__m128i right = _mm_load_si128((const __m128i*)r);
+			__m128i mirrored = _mm_cmpgt_epi32(threshold, _mm_abs_epi32(_mm_add_epi32(d, right)));
+			valid = _mm_and_si128(valid, _mm_and_si128(_mm_cmpgt_epi32(right, rightMinValid), mirrored));
+		}
+		__m128 mask = _mm_castsi128_ps(valid);
+		_mm_storeu_ps(_weighted + x, _mm_and_ps(mask, _mm_cvtepi32_ps(d)));
+		_mm_storeu_ps(_confidence + x, _mm_and_ps(mask, one));
+	}
+	for (; x < _width; ++x)
+	{
+		StereoConsistencyPixel(x, _left, _right, _width, _minValid, _rightMinValid, _threshold, _weighted, _confidence);
+	}
+}
+
+static void _smoothForwardRow(float* _x0, float* _x1, const float* _x0Prev, const float* _x1Prev,
+	const float* _weightPrev, const float* _weight, const float* _dPrev, float* _d, float _lambda, int _width)
+{
+	const __m128 lambda = _mm_set1_ps(_lambda);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	int x = 0;
+	for (; x + 4 <= _width; x += 4)
+	{
+		__m128 a = _mm_mul_ps(lambda, _mm_loadu_ps(_weightPrev + x));
+		__m128 c = _mm_mul_ps(lambda, _mm_loadu_ps(_weight + x));
+		__m128 r = _mm_div_ps(one, _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(one, a), c), _mm_mul_ps(a, _mm_loadu_ps(_dPrev + x))));
+		_mm_storeu_ps(_d + x, _mm_mul_ps(c, r));
+		_mm_storeu_ps(_x0 + x, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(_x0 + x), _mm_mul_ps(a, _mm_loadu_ps(_x0Prev + x))), r));
+		_mm_storeu_ps(_x1 + x, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(_x1 + x), _mm_mul_ps(a, _mm_loadu_ps(_x1Prev + x))), r));
+	}
+	for (; x < _width; ++x)
+	{
+		StereoSmoothForwardPixel(x, _x0, _x1, _x0Prev, _x1Prev, _weightPrev, _weight, _dPrev, _d, _lambda);
+	}
+}
+
+static void _smoothBackwardRow(float* _x0, float* _x1, const float* _x0Next, const float* _x1Next, const float* _d, int _width)
+{
+	int x = 0;
+	for (; x + 4 <= _width; x += 4)
+	{
+		__m128 d = _mm_loadu_ps(_d + x);
+		_mm_storeu_ps(_x0 + x, _mm_sub_ps(_mm_loadu_ps(_x0 + x), _mm_mul_ps(d, _mm_loadu_ps(_x0Next + x))));
+		_mm_storeu_ps(_x1 + x, _mm_sub_ps(_mm_loadu_ps(_x1 + x), _mm_mul_ps(d, _mm_loadu_ps(_x1Next + x))));
+	}
+	for (; x < _width; ++x)
+	{
+		StereoSmoothBackwardPixel(x, _x0, _x1, _x0Next, _x1Next, _d);
+	}
+}
+
+const StereoKernels& GetStereoKernelsSSE42()
+{
+	static const StereoKernels kernels = { _updateColumnCostSAD, _updateColumnCostCensus, _boxSumRow, _updateBoxSumRowSAD, _aggregatePathPixel, _selectDisparityRow,
+		_remapBilinearRowC3, _reprojectRowToVertices, _consistencyCheckRow, _smoothForwardRow, _smoothBackwardRow };
+	return kernels;
+}
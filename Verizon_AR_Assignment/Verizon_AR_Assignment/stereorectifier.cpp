@@ -0,0 +1,57 @@
+#include "stereorectifier.h"
+#include <algorithm>
+
+void StereoRectifier::SetMaps(const cv::Mat _maps[2][2])
+{
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		if (_maps[eye][0].type() != CV_16SC2 || _maps[eye][1].type() != CV_16UC1 || _maps[eye][0].size() != _maps[eye][1].size())
+		{
+			throw "Rectification needs the CV_16SC2 and CV_16UC1 tables of initUndistortRectifyMap";
+		}
+		m_Maps[eye][0] = _maps[eye][0];
+		m_Maps[eye][1] = _maps[eye][1];
+	}
+}
+
+void StereoRectifier::Rectify(const cv::Mat& _left, const cv::Mat& _right, cv::Mat& _leftRectified, cv::Mat& _rightRectified)
+{
+	if (!IsReady())
+	{
+		throw "Rectifier has no remap tables";
+	}
+	if (_left.type() != CV_8UC3 || _right.type() != CV_8UC3)
+	{
+		throw "Rectifier needs two 8 bit colour images";
+	}
+
+	// the output has the size of the tables, no-ops once the images exist
+	_leftRectified.create(GetSize(), CV_8UC3);
+	_rightRectified.create(GetSize(), CV_8UC3);
+
+	const cv::Mat* sources[2] = { &_left, &_right };
+	cv::Mat* destinations[2] = { &_leftRectified, &_rightRectified };
+	int numBands = std::min(GetSize().height, std::max(cv::getNumThreads(), 1) * 2);
+	cv::parallel_for_(cv::Range(0, 2 * numBands), RemapBody(this, sources, destinations, numBands));
+}
+
+void StereoRectifier::RemapBody::operator()(const cv::Range& _range) const
+{
+	for (int i = _range.start; i < _range.end; ++i)
+	{
+		int eye = i / m_NumBands;
+		int band = i % m_NumBands;
+		int height = m_Destinations[eye]->rows;
+		m_Rectifier->_remapBand(eye, *m_Sources[eye], *m_Destinations[eye], band * height / m_NumBands, (band + 1) * height / m_NumBands);
+	}
+}
+
+void StereoRectifier::_remapBand(int _eye, const cv::Mat& _source, cv::Mat& _destination, int _yBegin, int _yEnd) const
+{
+	const StereoKernels& kernels = GetStereoKernels();
+	for (int y = _yBegin; y < _yEnd; ++y)
+	{
+		kernels.RemapBilinearRowC3(_source.ptr<uchar>(0), _source.step, _source.cols, _source.rows,
+			m_Maps[_eye][0].ptr<short>(y), m_Maps[_eye][1].ptr<unsigned short>(y), _destination.ptr<uchar>(y), _destination.cols);
+	}
+}
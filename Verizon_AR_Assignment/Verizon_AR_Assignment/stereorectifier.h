@@ -0,0 +1,53 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include "stereokernels.h"
+
+// Per-frame rectification of a stereo pair.
+// Owns the fixed point remap tables of both eyes, per eye the CV_16SC2 integer positions and the
+// CV_16UC1 interpolation indices cv::initUndistortRectifyMap builds, and remaps colour frames through
+// them with bilinear interpolation and a black border, the same result as cv::remap.
+// The rows of both eyes are split into bands that run in parallel on the SIMD remap kernel, once the
+// output images exist a frame allocates nothing.
+class StereoRectifier
+{
+public:
+	StereoRectifier() = default;
+	StereoRectifier(const StereoRectifier& _other) = default;
+	~StereoRectifier() = default;
+
+	// the tables are kept by reference, they may point into a mapped calibration cache
+	void SetMaps(const cv::Mat _maps[2][2]);
+	void Rectify(const cv::Mat& _left, const cv::Mat& _right, cv::Mat& _leftRectified, cv::Mat& _rightRectified);
+
+	inline const cv::Mat& GetMap(int _eye, int _index) const	{ return m_Maps[_eye][_index]; }
+	inline cv::Size GetSize() const								{ return m_Maps[0][0].size(); }
+	inline bool IsReady() const									{ return !m_Maps[0][0].empty(); }
+
+private:
+	// remaps bands of rows, the first half of the range is the left eye, the second half the right one
+	class RemapBody : public cv::ParallelLoopBody
+	{
+	public:
+		RemapBody(const StereoRectifier* _rectifier, const cv::Mat* _sources[2], cv::Mat* _destinations[2], int _numBands)
+			: m_Rectifier(_rectifier), m_NumBands(_numBands)
+		{
+			m_Sources[0] = _sources[0];
+			m_Sources[1] = _sources[1];
+			m_Destinations[0] = _destinations[0];
+			m_Destinations[1] = _destinations[1];
+		}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		const StereoRectifier* m_Rectifier;
+		const cv::Mat* m_Sources[2];
+		cv::Mat* m_Destinations[2];
+		int m_NumBands;
+	};
+
+	void _remapBand(int _eye, const cv::Mat& _source, cv::Mat& _destination, int _yBegin, int _yEnd) const;
+
+private:
+	cv::Mat m_Maps[2][2];
+};
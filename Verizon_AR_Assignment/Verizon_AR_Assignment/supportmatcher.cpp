@@ -0,0 +1,423 @@
+#include "supportmatcher.h"
+#include <algorithm>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+cv::Ptr<SupportMatcher> SupportMatcher::create(int _minDisparity, int _numDisparities, int _blockSize)
+{
+	return cv::makePtr<SupportMatcher>(_minDisparity, _numDisparities, _blockSize);
+}
+
+SupportMatcher::SupportMatcher(int _minDisparity, int _numDisparities, int _blockSize)
+	: m_MinDisparity(_minDisparity), m_NumDisparities(_numDisparities), m_BlockSize(_blockSize)
+{
+	m_SpeckleWindowSize = 0;
+	m_SpeckleRange = 0;
+	m_Disp12MaxDiff = -1;
+	m_UniquenessRatio = 0;
+	m_GridStep = SUPPORT_GRID_STEP;
+	m_NumSupportPoints = 0;
+}
+
+void SupportMatcher::compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity)
+{
+	m_Left = _left.getMat();
+	m_Right = _right.getMat();
+
+	if (m_Left.type() != CV_8UC1 || m_Right.type() != CV_8UC1 || m_Left.size() != m_Right.size())
+	{
+		throw "Support matcher needs two greyscale images of the same size";
+	}
+	if (m_BlockSize < 3 || m_BlockSize % 2 == 0)
+	{
+		throw "Block size must be odd and at least 3";
+	}
+	if (m_GridStep < 1)
+	{
+		throw "Support grid step must be at least 1";
+	}
+
+	int width = m_Left.cols;
+	int height = m_Left.rows;
+	int radius = std::min(m_BlockSize, STEREO_BAND_MAX_BLOCK_SIZE) / 2;
+	m_GridOrigin = cv::Point(radius, radius);
+	int gridCols = std::max((width - 2 * radius - 1) / m_GridStep + 1, 0);
+	int gridRows = std::max((height - 2 * radius - 1) / m_GridStep + 1, 0);
+
+	// support points over the whole range, only the ones that agree with their neighbours are kept
+	m_Candidates.create(gridRows, gridCols, CV_16S);
+	m_Support.create(gridRows, gridCols, CV_16S);
+	cv::parallel_for_(cv::Range(0, gridRows), PassBody(this, SUPPORT_PASS::SUPPORT_PASS_MATCH, 0));
+	_filterSupport();
+
+	// planes of the triangles as the predictions of a narrow search
+	m_Prediction.create(m_Left.size(), CV_16S);
+	m_LowPrediction.create(m_Left.size(), CV_16S);
+	m_HighPrediction.create(m_Left.size(), CV_16S);
+	m_Plane.create(m_Left.size(), CV_16S);
+	m_Cost.create(m_Left.size(), CV_16U);
+	m_Alternative.create(m_Left.size(), CV_16S);
+	m_AlternativeCost.create(m_Left.size(), CV_16U);
+	bool triangulated = _triangulate();
+
+	_disparity.create(m_Left.size(), CV_16S);
+	m_Disparity = _disparity.getMat();
+	if (!triangulated)
+	{
+		// without a triangle every prediction would be a filled hole and the whole image would search a band
+		// at the minimum disparity, nothing is known about it instead
+		m_Disparity.setTo(cv::Scalar(StereoInvalidDisparity(m_MinDisparity)));
+	}
+	else
+	{
+		int numBands = std::min(height, std::max(cv::getNumThreads(), 1) * 4);
+		cv::parallel_for_(cv::Range(0, height), PassBody(this, SUPPORT_PASS::SUPPORT_PASS_PREDICT, 0));
+		cv::parallel_for_(cv::Range(0, numBands), PassBody(this, SUPPORT_PASS::SUPPORT_PASS_REFINE, numBands));
+	}
+
+	if (triangulated && m_SpeckleWindowSize > 0)
+	{
+		cv::filterSpeckles(m_Disparity, StereoInvalidDisparity(m_MinDisparity), m_SpeckleWindowSize, m_SpeckleRange * STEREO_DISP_SCALE, m_SpeckleBuffer);
+	}
+
+	// the frame is only referenced while matching
+	m_Left.release();
+	m_Right.release();
+	m_Disparity.release();
+}
+
+void SupportMatcher::PassBody::operator()(const cv::Range& _range) const
+{
+	int height = m_Matcher->m_Prediction.rows;
+	for (int i = _range.start; i < _range.end; ++i)
+	{
+		switch (m_Pass)
+		{
+		case SUPPORT_PASS::SUPPORT_PASS_MATCH:
+			m_Matcher->_matchGridRow(i);
+			break;
+		case SUPPORT_PASS::SUPPORT_PASS_PREDICT:
+			m_Matcher->_predictRow(i);
+			break;
+		case SUPPORT_PASS::SUPPORT_PASS_REFINE:
+			m_Matcher->_refineBand(i * height / m_NumBands, (i + 1) * height / m_NumBands);
+			break;
+		}
+	}
+}
+
+int SupportMatcher::_matchBlock(const cv::Mat& _reference, const cv::Mat& _other, int _x, int _y, int _direction, unsigned short* _cost)
+{
+	// block SADs of the whole range, disparities that take the block out of the other image cost the most
+	int width = _reference.cols;
+	int radius = std::min(m_BlockSize, STEREO_BAND_MAX_BLOCK_SIZE) / 2;
+	int first = _direction < 0 ? _x - m_MinDisparity - (width - 1 - radius) : radius - _x - m_MinDisparity;
+	int last = _direction < 0 ? _x - m_MinDisparity - radius : width - 1 - radius - _x - m_MinDisparity;
+	first = std::max(first, 0);
+	last = std::min(last, m_NumDisparities - 1);
+	if (first > last)
+	{
+		return -1;
+	}
+
+	std::fill(_cost, _cost + m_NumDisparities, (unsigned short)0xFFFF);
+	std::fill(_cost + first, _cost + last + 1, (unsigned short)0);
+	for (int dy = -radius; dy <= radius; ++dy)
+	{
+		const uchar* reference = _reference.ptr<uchar>(_y + dy);
+		const uchar* other = _other.ptr<uchar>(_y + dy);
+		for (int dx = -radius; dx <= radius; ++dx)
+		{
+			int value = reference[_x + dx];
+			int base = _x + dx + _direction * m_MinDisparity;
+			for (int i = first; i <= last; ++i)
+			{
+				_cost[i] += (unsigned short)abs(value - other[base + _direction * i]);
+			}
+		}
+	}
+
+	int best = first;
+	for (int i = first + 1; i <= last; ++i)
+	{
+		best = _cost[i] < _cost[best] ? i : best;
+	}
+
+	// support points have to be clearly unique, whatever the ratio of the dense search
+	int uniquenessRatio = std::max(m_UniquenessRatio, (int)SUPPORT_UNIQUENESS_RATIO);
+	unsigned int threshold = StereoUniquenessThreshold(_cost[best], uniquenessRatio);
+	int lowerCount = 0;
+	for (int i = 0; i < m_NumDisparities; ++i)
+	{
+		lowerCount += _cost[i] <= threshold ? 1 : 0;
+	}
+	return StereoIsAmbiguous(_cost, best, m_NumDisparities, lowerCount, threshold) ? -1 : best;
+}
+
+void SupportMatcher::_matchGridRow(int _row)
+{
+	int width = m_Left.cols;
+	int radius = std::min(m_BlockSize, STEREO_BAND_MAX_BLOCK_SIZE) / 2;
+	int maxDisparity = m_MinDisparity + m_NumDisparities - 1;
+	int y = m_GridOrigin.y + _row * m_GridStep;
+	short* candidates = m_Candidates.ptr<short>(_row);
+	cv::AutoBuffer<unsigned short> costBuffer(m_NumDisparities);
+	unsigned short* cost = costBuffer;
+
+	for (int col = 0; col < m_Candidates.cols; ++col)
+	{
+		int x = m_GridOrigin.x + col * m_GridStep;
+		candidates[col] = SHRT_MIN;
+
+		// only where the whole range stays inside the right image
+		if (x - maxDisparity - radius < 0 || x - m_MinDisparity + radius >= width)
+		{
+			continue;
+		}
+		int best = _matchBlock(m_Left, m_Right, x, y, -1, cost);
+		if (best < 0)
+		{
+			continue;
+		}
+
+		// and back from the right image to the same disparity, give or take one
+		int disparity = m_MinDisparity + best;
+		int back = _matchBlock(m_Right, m_Left, x - disparity, y, 1, cost);
+		if (back < 0 || abs(m_MinDisparity + back - disparity) > 1)
+		{
+			continue;
+		}
+		candidates[col] = (short)disparity;
+	}
+}
+
+void SupportMatcher::_filterSupport()
+{
+	// a support point that disagrees with most of its neighbours is more likely a repeated texture than an edge
+	m_NumSupportPoints = 0;
+	for (int row = 0; row < m_Candidates.rows; ++row)
+	{
+		const short* candidates = m_Candidates.ptr<short>(row);
+		short* support = m_Support.ptr<short>(row);
+		for (int col = 0; col < m_Candidates.cols; ++col)
+		{
+			support[col] = SHRT_MIN;
+			if (candidates[col] == SHRT_MIN)
+			{
+				continue;
+			}
+
+			int agreeing = 0;
+			for (int r = std::max(row - SUPPORT_NEIGHBOUR_RADIUS, 0); r <= std::min(row + SUPPORT_NEIGHBOUR_RADIUS, m_Candidates.rows - 1); ++r)
+			{
+				const short* neighbours = m_Candidates.ptr<short>(r);
+				for (int c = std::max(col - SUPPORT_NEIGHBOUR_RADIUS, 0); c <= std::min(col + SUPPORT_NEIGHBOUR_RADIUS, m_Candidates.cols - 1); ++c)
+				{
+					bool self = r == row && c == col;
+					agreeing += !self && neighbours[c] != SHRT_MIN && abs(neighbours[c] - candidates[col]) <= SUPPORT_NEIGHBOUR_TOLERANCE ? 1 : 0;
+				}
+			}
+			if (agreeing >= SUPPORT_MIN_NEIGHBOURS)
+			{
+				support[col] = candidates[col];
+				++m_NumSupportPoints;
+			}
+		}
+	}
+}
+
+bool SupportMatcher::_triangulate()
+{
+	m_Prediction.setTo(cv::Scalar(SHRT_MIN));
+	m_LowPrediction.setTo(cv::Scalar(SHRT_MIN));
+	m_HighPrediction.setTo(cv::Scalar(SHRT_MIN));
+	m_Plane.setTo(cv::Scalar(SHRT_MIN));
+	m_WideRows.assign(m_Left.rows, 0);
+	if (m_NumSupportPoints < 3)
+	{
+		return false;
+	}
+
+	// Delaunay triangulation of the support points, the triangles touching the outer vertices cv::Subdiv2D
+	// adds around the image are dropped
+	cv::Subdiv2D subdiv(cv::Rect(0, 0, m_Left.cols, m_Left.rows));
+	for (int row = 0; row < m_Support.rows; ++row)
+	{
+		const short* support = m_Support.ptr<short>(row);
+		for (int col = 0; col < m_Support.cols; ++col)
+		{
+			if (support[col] != SHRT_MIN)
+			{
+				subdiv.insert(cv::Point2f((float)(m_GridOrigin.x + col * m_GridStep), (float)(m_GridOrigin.y + row * m_GridStep)));
+			}
+		}
+	}
+	subdiv.getTriangleList(m_Triangles);
+
+	cv::Rect image(0, 0, m_Left.cols, m_Left.rows);
+	bool covered = false;
+	for (size_t t = 0; t < m_Triangles.size(); ++t)
+	{
+		const cv::Vec6f& triangle = m_Triangles[t];
+		cv::Point2f corners[3];
+		float disparities[3];
+		bool inside = true;
+		for (int k = 0; k < 3 && inside; ++k)
+		{
+			corners[k] = cv::Point2f(triangle[2 * k], triangle[2 * k + 1]);
+			int col = cvRound((corners[k].x - m_GridOrigin.x) / m_GridStep);
+			int row = cvRound((corners[k].y - m_GridOrigin.y) / m_GridStep);
+			inside = image.contains(cv::Point(cvRound(corners[k].x), cvRound(corners[k].y))) && col >= 0 && col < m_Support.cols && row >= 0 && row < m_Support.rows;
+			disparities[k] = inside ? m_Support.at<short>(row, col) : 0.0f;
+		}
+		if (inside)
+		{
+			covered |= _rasterizeTriangle(corners, disparities);
+		}
+	}
+	return covered;
+}
+
+bool SupportMatcher::_rasterizeTriangle(const cv::Point2f* _corners, const float* _disparities)
+{
+	// plane through the corners, d = a x + b y + c
+	double x0 = _corners[0].x, y0 = _corners[0].y;
+	double dx1 = _corners[1].x - x0, dy1 = _corners[1].y - y0, dd1 = _disparities[1] - _disparities[0];
+	double dx2 = _corners[2].x - x0, dy2 = _corners[2].y - y0, dd2 = _disparities[2] - _disparities[0];
+	double det = dx1 * dy2 - dx2 * dy1;
+	if (fabs(det) < 1e-6)
+	{
+		return false;
+	}
+	double a = (dd1 * dy2 - dd2 * dy1) / det;
+	double b = (dx1 * dd2 - dx2 * dd1) / det;
+	double c = _disparities[0] - a * x0 - b * y0;
+	float lowest = std::min(std::min(_disparities[0], _disparities[1]), _disparities[2]);
+	float highest = std::max(std::max(_disparities[0], _disparities[1]), _disparities[2]);
+	bool flat = highest - lowest <= SUPPORT_FLAT_TOLERANCE;
+	bool wide = highest - lowest > 2 * STEREO_BAND_RADIUS;
+
+	float top = std::min(std::min(_corners[0].y, _corners[1].y), _corners[2].y);
+	float bottom = std::max(std::max(_corners[0].y, _corners[1].y), _corners[2].y);
+	int yBegin = std::max(cvCeil(top), 0);
+	int yEnd = std::min(cvFloor(bottom), m_Prediction.rows - 1);
+	bool covered = false;
+	for (int y = yBegin; y <= yEnd; ++y)
+	{
+		// span of the row inside the triangle, where it crosses the edges
+		float left = FLT_MAX, right = -FLT_MAX;
+		for (int k = 0; k < 3; ++k)
+		{
+			const cv::Point2f& p = _corners[k];
+			const cv::Point2f& q = _corners[(k + 1) % 3];
+			if ((p.y > y && q.y > y) || (p.y < y && q.y < y))
+			{
+				continue;
+			}
+			float x = p.y == q.y ? p.x : p.x + (y - p.y) * (q.x - p.x) / (q.y - p.y);
+			float other = p.y == q.y ? q.x : x;
+			left = std::min(left, std::min(x, other));
+			right = std::max(right, std::max(x, other));
+		}
+
+		short* prediction = m_Prediction.ptr<short>(y);
+		short* lowPrediction = m_LowPrediction.ptr<short>(y);
+		short* highPrediction = m_HighPrediction.ptr<short>(y);
+		short* plane = m_Plane.ptr<short>(y);
+		int xBegin = std::max(cvCeil(left), 0);
+		int xEnd = std::min(cvFloor(right), m_Prediction.cols - 1);
+		m_WideRows[y] |= wide && xBegin <= xEnd ? 1 : 0;
+		covered |= xBegin <= xEnd;
+		for (int x = xBegin; x <= xEnd; ++x)
+		{
+			double disparity = a * x + b * y + c;
+			prediction[x] = cv::saturate_cast<short>(disparity);
+			lowPrediction[x] = wide ? (short)lowest : prediction[x];
+			highPrediction[x] = wide ? (short)highest : prediction[x];
+			plane[x] = flat ? cv::saturate_cast<short>(disparity * STEREO_DISP_SCALE) : SHRT_MIN;
+		}
+	}
+	return covered;
+}
+
+void SupportMatcher::_predictRow(int _y)
+{
+	int width = m_Prediction.cols;
+	int maxDisparity = m_MinDisparity + m_NumDisparities - 1;
+	int lowest = m_MinDisparity + STEREO_BAND_RADIUS;
+	int highest = std::max(maxDisparity - STEREO_BAND_RADIUS, lowest);
+
+	cv::Mat* predictions[3] = { &m_Prediction, &m_LowPrediction, &m_HighPrediction };
+	for (int i = 0; i < 3; ++i)
+	{
+		short* prediction = predictions[i]->ptr<short>(_y);
+		for (int x = 0; x < width; ++x)
+		{
+			if (prediction[x] != SHRT_MIN)
+			{
+				prediction[x] = (short)std::min(std::max((int)prediction[x], lowest), highest);
+			}
+		}
+
+		// outside of the triangles, from the background side
+		StereoFillPredictionHoles(prediction, width, (short)lowest);
+	}
+}
+
+void SupportMatcher::_refineBand(int _yBegin, int _yEnd)
+{
+	int width = m_Left.cols;
+	int height = m_Left.rows;
+	int radius = std::min(m_BlockSize, STEREO_BAND_MAX_BLOCK_SIZE) / 2;
+	int maxDisparity = m_MinDisparity + m_NumDisparities - 1;
+	StereoBandSearch(m_Left, m_Right, m_Prediction, m_Disparity, NULL, _yBegin, _yEnd, m_BlockSize, m_MinDisparity, maxDisparity, m_UniquenessRatio, &m_Cost);
+
+	// both sides of the depth edges, only where a wide triangle crosses the band
+	if (std::find(m_WideRows.begin() + _yBegin, m_WideRows.begin() + _yEnd, 1) != m_WideRows.begin() + _yEnd)
+	{
+		_keepCheaper(m_LowPrediction, _yBegin, _yEnd);
+		_keepCheaper(m_HighPrediction, _yBegin, _yEnd);
+	}
+
+	// ambiguous pixels of flat triangles take the plane, inside the region the band search fills
+	short invalid = StereoInvalidDisparity(m_MinDisparity);
+	short lowest = (short)(m_MinDisparity * STEREO_DISP_SCALE);
+	short highest = (short)(maxDisparity * STEREO_DISP_SCALE);
+	int xBegin = std::min(std::max(maxDisparity + radius, radius), width - radius);
+	int xEnd = std::max(std::min(width + m_MinDisparity - radius, width - radius), xBegin);
+	for (int y = std::max(_yBegin, radius); y < std::min(_yEnd, height - radius); ++y)
+	{
+		const short* plane = m_Plane.ptr<short>(y);
+		short* disparity = m_Disparity.ptr<short>(y);
+		for (int x = xBegin; x < xEnd; ++x)
+		{
+			if (disparity[x] == invalid && plane[x] != SHRT_MIN)
+			{
+				disparity[x] = std::min(std::max(plane[x], lowest), highest);
+			}
+		}
+	}
+}
+
+void SupportMatcher::_keepCheaper(const cv::Mat& _prediction, int _yBegin, int _yEnd)
+{
+	int maxDisparity = m_MinDisparity + m_NumDisparities - 1;
+	StereoBandSearch(m_Left, m_Right, _prediction, m_Alternative, NULL, _yBegin, _yEnd, m_BlockSize, m_MinDisparity, maxDisparity, m_UniquenessRatio, &m_AlternativeCost);
+	for (int y = _yBegin; y < _yEnd; ++y)
+	{
+		const short* alternative = m_Alternative.ptr<short>(y);
+		const unsigned short* alternativeCost = m_AlternativeCost.ptr<unsigned short>(y);
+		short* disparity = m_Disparity.ptr<short>(y);
+		unsigned short* cost = m_Cost.ptr<unsigned short>(y);
+		for (int x = 0; x < m_Disparity.cols; ++x)
+		{
+			if (alternativeCost[x] < cost[x])
+			{
+				disparity[x] = alternative[x];
+				cost[x] = alternativeCost[x];
+			}
+		}
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <opencv2\imgproc\imgproc.hpp>
+#include <vector>
+#include "bandsearch.h"
+
+// Semi-dense matching from support points, after ELAS (Geiger et al., Efficient Large-Scale Stereo Matching).
+// A grid of pixels every SUPPORT_GRID_STEP is matched over the whole range, and kept as support points
+// when the match is clearly unique, survives the right to left check and agrees with enough of its
+// neighbours. The support points are triangulated with cv::Subdiv2D, and every pixel then only
+// searches a band of STEREO_BAND_RADIUS disparities around the plane of its triangle with the band
+// search of bandsearch.h, so the cost per pixel no longer grows with the number of disparities.
+// A triangle whose corners spread wider than the band mostly spans a depth edge and its plane lies
+// between both sides, so its pixels also search around its lowest and its highest corner, the way
+// ELAS adds the support disparities nearby to the candidates, and keep the cheapest of the three.
+// Pixels the band search leaves ambiguous inside a triangle whose three corners agree within
+// SUPPORT_FLAT_TOLERANCE take its plane, which fills the low texture areas between support points.
+// With fewer than 3 support points, or none of their triangles covering a pixel, the whole map is invalid.
+class SupportMatcher : public cv::StereoMatcher
+{
+public:
+	static cv::Ptr<SupportMatcher> create(int _minDisparity = 0, int _numDisparities = 64, int _blockSize = 9);
+
+	SupportMatcher(int _minDisparity, int _numDisparities, int _blockSize);
+	SupportMatcher(const SupportMatcher& _other) = default;
+	~SupportMatcher() = default;
+
+	void compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity);
+
+	inline int getMinDisparity() const						{ return m_MinDisparity; }
+	inline void setMinDisparity(int _value)					{ m_MinDisparity = _value; }
+	inline int getNumDisparities() const					{ return m_NumDisparities; }
+	inline void setNumDisparities(int _value)				{ m_NumDisparities = _value; }
+	inline int getBlockSize() const							{ return m_BlockSize; }
+	inline void setBlockSize(int _value)					{ m_BlockSize = _value; }
+	inline int getSpeckleWindowSize() const					{ return m_SpeckleWindowSize; }
+	inline void setSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
+	inline int getSpeckleRange() const						{ return m_SpeckleRange; }
+	inline void setSpeckleRange(int _value)					{ m_SpeckleRange = _value; }
+	inline int getDisp12MaxDiff() const						{ return m_Disp12MaxDiff; }
+	inline void setDisp12MaxDiff(int _value)				{ m_Disp12MaxDiff = _value; }
+	inline int getUniquenessRatio() const					{ return m_UniquenessRatio; }
+	inline void setUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; }
+	inline int getGridStep() const							{ return m_GridStep; }
+	inline void setGridStep(int _value)						{ m_GridStep = _value; }
+	// support points of the last frame
+	inline int getNumSupportPoints() const					{ return m_NumSupportPoints; }
+
+	static const int SUPPORT_GRID_STEP = 5;				// pixels between candidate support points
+	static const int SUPPORT_UNIQUENESS_RATIO = 15;		// percent the second best match of a support point must cost more
+	static const int SUPPORT_NEIGHBOUR_RADIUS = 2;		// grid cells around a support point that are looked at
+	static const int SUPPORT_NEIGHBOUR_TOLERANCE = 5;	// disparity difference of neighbours that agree
+	static const int SUPPORT_MIN_NEIGHBOURS = 5;		// agreeing neighbours a support point needs
+	static const int SUPPORT_FLAT_TOLERANCE = 1;		// corner disparity spread of triangles taken as is
+
+private:
+	enum class SUPPORT_PASS { SUPPORT_PASS_MATCH, SUPPORT_PASS_PREDICT, SUPPORT_PASS_REFINE };
+
+	// runs one pass over a range of grid rows, image rows or bands of rows for the refine pass
+	class PassBody : public cv::ParallelLoopBody
+	{
+	public:
+		PassBody(SupportMatcher* _matcher, SUPPORT_PASS _pass, int _numBands) : m_Matcher(_matcher), m_Pass(_pass), m_NumBands(_numBands) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		SupportMatcher* m_Matcher;
+		SUPPORT_PASS m_Pass;
+		int m_NumBands;
+	};
+
+	void _matchGridRow(int _row);
+	int _matchBlock(const cv::Mat& _reference, const cv::Mat& _other, int _x, int _y, int _direction, unsigned short* _cost);
+	void _filterSupport();
+	bool _triangulate();
+	bool _rasterizeTriangle(const cv::Point2f* _corners, const float* _disparities);
+	void _predictRow(int _y);
+	void _refineBand(int _yBegin, int _yEnd);
+	void _keepCheaper(const cv::Mat& _prediction, int _yBegin, int _yEnd);
+
+private:
+	int m_MinDisparity;
+	int m_NumDisparities;
+	int m_BlockSize;
+	int m_SpeckleWindowSize;
+	int m_SpeckleRange;
+	int m_Disp12MaxDiff;	// not used, the support points have their own right to left check
+	int m_UniquenessRatio;
+	int m_GridStep;
+	int m_NumSupportPoints;
+
+	// the frame being matched
+	cv::Mat m_Left;
+	cv::Mat m_Right;
+	cv::Mat m_Disparity;
+	cv::Point m_GridOrigin;	// image position of the first grid point
+
+	// kept between calls so a stream of same sized frames does not allocate
+	cv::Mat m_Candidates;	// 16S grid of whole disparities, SHRT_MIN where the match was rejected
+	cv::Mat m_Support;		// 16S, the candidates that agree with their neighbours
+	cv::Mat m_Prediction;	// 16S whole disparities of the triangles' planes, SHRT_MIN outside of them
+	cv::Mat m_LowPrediction;	// 16S, the lowest corner on triangles wider than the band, the plane elsewhere
+	cv::Mat m_HighPrediction;	// 16S, the highest corner the same way
+	std::vector<uchar> m_WideRows;	// rows crossing a triangle wider than the band
+	cv::Mat m_Cost;			// 16U window cost of every pixel's disparity
+	cv::Mat m_Alternative;	// 16S, the search around the lowest or highest corner
+	cv::Mat m_AlternativeCost;	// 16U
+	cv::Mat m_Plane;		// 16S with STEREO_DISP_SHIFT fractional bits on flat triangles, SHRT_MIN elsewhere
+	std::vector<cv::Vec6f> m_Triangles;
+	cv::Mat m_SpeckleBuffer;
+};
@@ -0,0 +1,279 @@
+#include "temporalmatcher.h"
+#include <algorithm>
+#include <limits.h>
+#include <stdlib.h>
+
+cv::Ptr<TemporalMatcher> TemporalMatcher::create(cv::Ptr<cv::StereoMatcher> _matcher, int _overlap)
+{
+	return cv::makePtr<TemporalMatcher>(_matcher, _overlap);
+}
+
+TemporalMatcher::TemporalMatcher(cv::Ptr<cv::StereoMatcher> _matcher, int _overlap)
+	: m_Matcher(_matcher), m_Overlap(_overlap)
+{
+	// speckles are removed once the band and whole range rows are put together
+	m_SpeckleWindowSize = _matcher->getSpeckleWindowSize();
+	m_SpeckleRange = _matcher->getSpeckleRange();
+	m_UnscaledSpeckleRange = !_matcher.dynamicCast<cv::StereoBM>().empty();
+	m_Matcher->setSpeckleWindowSize(0);
+	m_UniquenessRatio = 0;
+	m_FastPathFraction = 0.0;
+	m_RematchedPixels = 0;
+
+	// the band search only reproduces plain SAD windows
+	cv::Ptr<BlockMatcher> blockMatcher = _matcher.dynamicCast<BlockMatcher>();
+	m_BandSearch = !blockMatcher.empty() && blockMatcher->getMode() == BlockMatcher::MODE_SAD;
+}
+
+void TemporalMatcher::compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity)
+{
+	m_Left = _left.getMat();
+	m_Right = _right.getMat();
+
+	if (m_Left.type() != CV_8UC1 || m_Right.type() != CV_8UC1 || m_Left.size() != m_Right.size())
+	{
+		throw "Temporal matcher needs two greyscale images of the same size";
+	}
+
+	int height = m_Left.rows;
+	_disparity.create(m_Left.size(), CV_16S);
+	m_Disparity = _disparity.getMat();
+
+	m_RematchedPixels = 0;
+	if (!m_BandSearch || m_Previous.empty() || m_Previous.size() != m_Left.size())
+	{
+		// nothing to start from, or a cost the band search does not have
+		_computeRows(0, height);
+		m_FastPathFraction = 0.0;
+	}
+	else
+	{
+		m_Prediction.create(m_Left.size(), CV_16S);
+		m_Unsure.create(m_Left.size(), CV_8U);
+		m_UnsureCounts.assign(height, 0);
+
+		int numBands = std::min(height, std::max(cv::getNumThreads(), 1) * 4);
+		cv::parallel_for_(cv::Range(0, height), BandBody(this, TEMPORAL_PASS::TEMPORAL_PASS_PREDICT, 0));
+		cv::parallel_for_(cv::Range(0, numBands), BandBody(this, TEMPORAL_PASS::TEMPORAL_PASS_SEARCH, numBands));
+
+		// whole range again on runs of blocks where too many pixels lost confidence, a few scattered
+		// ones are mostly outliers of the previous frame and are matched again one by one
+		int numBlocks = (height + TEMPORAL_BLOCK_ROWS - 1) / TEMPORAL_BLOCK_ROWS;
+		std::vector<int> unsureCounts(numBlocks, 0);
+		std::vector<uchar> unsureBlocks(numBlocks, 0);
+		int unsureRows = 0;
+		for (int y = 0; y < height; ++y)
+		{
+			unsureCounts[y / TEMPORAL_BLOCK_ROWS] += m_UnsureCounts[y];
+		}
+		for (int b = 0; b < numBlocks; ++b)
+		{
+			int blockRows = std::min((b + 1) * TEMPORAL_BLOCK_ROWS, height) - b * TEMPORAL_BLOCK_ROWS;
+			unsureBlocks[b] = unsureCounts[b] * 100 > blockRows * m_Left.cols * TEMPORAL_MAX_UNSURE_PERCENT ? 1 : 0;
+			unsureRows += unsureBlocks[b] ? blockRows : 0;
+		}
+
+		// past half the frame the overlaps cost more than matching the whole frame at once
+		m_RematchRows.assign(height, 0);
+		if (unsureRows * 2 > height)
+		{
+			_computeRows(0, height);
+			unsureRows = height;
+		}
+		else
+		{
+			for (int y = 0; y < height; ++y)
+			{
+				m_RematchRows[y] = unsureBlocks[y / TEMPORAL_BLOCK_ROWS] ? 0 : 1;
+				m_RematchedPixels += m_RematchRows[y] ? m_UnsureCounts[y] : 0;
+			}
+			cv::parallel_for_(cv::Range(0, height), BandBody(this, TEMPORAL_PASS::TEMPORAL_PASS_REMATCH, 0));
+
+			for (int b = 0; b < numBlocks;)
+			{
+				if (!unsureBlocks[b])
+				{
+					++b;
+					continue;
+				}
+				int first = b;
+				while (b < numBlocks && unsureBlocks[b])
+				{
+					++b;
+				}
+				_computeRows(first * TEMPORAL_BLOCK_ROWS, std::min(b * TEMPORAL_BLOCK_ROWS, height));
+			}
+		}
+		double numPixels = (double)height * m_Left.cols;
+		m_FastPathFraction = numPixels > 0.0 ? 1.0 - ((double)unsureRows * m_Left.cols + m_RematchedPixels) / numPixels : 0.0;
+	}
+
+	if (m_SpeckleWindowSize > 0 && m_SpeckleRange >= 0)
+	{
+		int speckleRange = m_UnscaledSpeckleRange ? m_SpeckleRange : m_SpeckleRange * STEREO_DISP_SCALE;
+		cv::filterSpeckles(m_Disparity, StereoInvalidDisparity(getMinDisparity()), m_SpeckleWindowSize, speckleRange, m_SpeckleBuffer);
+	}
+	m_Disparity.copyTo(m_Previous);
+}
+
+void TemporalMatcher::BandBody::operator()(const cv::Range& _range) const
+{
+	int height = m_Matcher->m_Prediction.rows;
+	for (int i = _range.start; i < _range.end; ++i)
+	{
+		switch (m_Pass)
+		{
+		case TEMPORAL_PASS::TEMPORAL_PASS_PREDICT:
+			m_Matcher->_predictRow(i);
+			break;
+		case TEMPORAL_PASS::TEMPORAL_PASS_SEARCH:
+			m_Matcher->_searchBand(i * height / m_NumBands, (i + 1) * height / m_NumBands);
+			break;
+		case TEMPORAL_PASS::TEMPORAL_PASS_REMATCH:
+			m_Matcher->_rematchRow(i);
+			break;
+		}
+	}
+}
+
+void TemporalMatcher::_predictRow(int _y)
+{
+	const short* previous = m_Previous.ptr<short>(_y);
+	short* prediction = m_Prediction.ptr<short>(_y);
+	int width = m_Prediction.cols;
+
+	int minDisparity = getMinDisparity();
+	int maxDisparity = minDisparity + getNumDisparities() - 1;
+	int lowest = minDisparity + TEMPORAL_SEARCH_RADIUS;
+	int highest = std::max(maxDisparity - TEMPORAL_SEARCH_RADIUS, lowest);
+
+	// previous disparity rounded to whole disparities, holes marked with SHRT_MIN
+	for (int x = 0; x < width; ++x)
+	{
+		if (previous[x] < minDisparity * STEREO_DISP_SCALE)
+		{
+			prediction[x] = SHRT_MIN;
+			continue;
+		}
+		int value = (previous[x] + STEREO_DISP_SCALE / 2) >> STEREO_DISP_SHIFT;
+		prediction[x] = (short)std::min(std::max(value, lowest), highest);
+	}
+
+	// holes are mostly occlusions, filled from their background side
+	StereoFillPredictionHoles(prediction, width, (short)lowest);
+}
+
+void TemporalMatcher::_searchBand(int _yBegin, int _yEnd)
+{
+	int minDisparity = getMinDisparity();
+	int maxDisparity = minDisparity + getNumDisparities() - 1;
+	StereoBandSearch(m_Left, m_Right, m_Prediction, m_Disparity, &m_Unsure, _yBegin, _yEnd, getBlockSize(), minDisparity, maxDisparity, m_UniquenessRatio);
+
+	// a pixel that had no match in the previous frame did not lose anything, a whole range search
+	// would most likely leave it invalid as well. the band result of the others is not trusted, they
+	// are matched again with their block or on their own
+	int width = m_Unsure.cols;
+	short invalid = StereoInvalidDisparity(minDisparity);
+	for (int y = _yBegin; y < _yEnd; ++y)
+	{
+		const uchar* unsure = m_Unsure.ptr<uchar>(y);
+		const short* previous = m_Previous.ptr<short>(y);
+		short* disparity = m_Disparity.ptr<short>(y);
+		for (int x = 0; x < width; ++x)
+		{
+			if (unsure[x])
+			{
+				disparity[x] = invalid;
+				m_UnsureCounts[y] += previous[x] >= minDisparity * STEREO_DISP_SCALE ? 1 : 0;
+			}
+		}
+	}
+}
+
+void TemporalMatcher::_rematchRow(int _y)
+{
+	if (!m_RematchRows[_y] || m_UnsureCounts[_y] == 0)
+	{
+		return;
+	}
+
+	int minDisparity = getMinDisparity();
+	cv::AutoBuffer<unsigned short> costBuffer(getNumDisparities());
+	const uchar* unsure = m_Unsure.ptr<uchar>(_y);
+	const short* previous = m_Previous.ptr<short>(_y);
+	short* disparity = m_Disparity.ptr<short>(_y);
+	for (int x = 0; x < m_Unsure.cols; ++x)
+	{
+		if (unsure[x] && previous[x] >= minDisparity * STEREO_DISP_SCALE)
+		{
+			disparity[x] = _matchPixel(x, _y, costBuffer);
+		}
+	}
+}
+
+short TemporalMatcher::_matchPixel(int _x, int _y, unsigned short* _cost)
+{
+	// the wrapped BlockMatcher's result for one pixel, the SAD window over the whole range with the same
+	// uniqueness check and sub-pixel refinement
+	int width = m_Left.cols;
+	int height = m_Left.rows;
+	int minDisparity = getMinDisparity();
+	int numDisparities = getNumDisparities();
+	int radius = getBlockSize() / 2;
+	short invalid = StereoInvalidDisparity(minDisparity);
+	if (_x - (minDisparity + numDisparities - 1) - radius < 0 || _x - minDisparity + radius >= width || _y < radius || _y + radius >= height)
+	{
+		return invalid;
+	}
+
+	std::fill(_cost, _cost + numDisparities, (unsigned short)0);
+	for (int dy = -radius; dy <= radius; ++dy)
+	{
+		const uchar* left = m_Left.ptr<uchar>(_y + dy);
+		const uchar* right = m_Right.ptr<uchar>(_y + dy);
+		for (int dx = -radius; dx <= radius; ++dx)
+		{
+			int value = left[_x + dx];
+			const uchar* shifted = right + _x + dx - minDisparity;
+			for (int d = 0; d < numDisparities; ++d)
+			{
+				_cost[d] += (unsigned short)abs(value - shifted[-d]);
+			}
+		}
+	}
+
+	int best = 0;
+	for (int d = 1; d < numDisparities; ++d)
+	{
+		best = _cost[d] < _cost[best] ? d : best;
+	}
+	if (m_UniquenessRatio > 0)
+	{
+		unsigned int threshold = StereoUniquenessThreshold(_cost[best], m_UniquenessRatio);
+		int lowerCount = 0;
+		for (int d = 0; d < numDisparities; ++d)
+		{
+			lowerCount += _cost[d] <= threshold ? 1 : 0;
+		}
+		if (StereoIsAmbiguous(_cost, best, numDisparities, lowerCount, threshold))
+		{
+			return invalid;
+		}
+	}
+	return StereoSubpixelDisparity(_cost, best, numDisparities, minDisparity);
+}
+
+void TemporalMatcher::_computeRows(int _yBegin, int _yEnd)
+{
+	int height = m_Left.rows;
+	if (_yBegin == 0 && _yEnd == height)
+	{
+		m_Matcher->compute(m_Left, m_Right, m_Disparity);
+		return;
+	}
+
+	int yFirst = std::max(_yBegin - m_Overlap, 0);
+	int yLast = std::min(_yEnd + m_Overlap, height);
+	m_Matcher->compute(m_Left.rowRange(yFirst, yLast), m_Right.rowRange(yFirst, yLast), m_Span);
+	m_Span.rowRange(_yBegin - yFirst, _yEnd - yFirst).copyTo(m_Disparity.rowRange(_yBegin, _yEnd));
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <opencv2\core.hpp>
+#include <opencv2\core\utility.hpp>
+#include <opencv2\calib3d\calib3d.hpp>
+#include <vector>
+#include "bandsearch.h"
+#include "blockmatcher.h"
+
+// Temporal prior for video streams.
+// The first frame, and any frame of a different size, is matched over the whole range by the wrapped
+// matcher. After that every pixel only searches a band of TEMPORAL_SEARCH_RADIUS disparities around
+// its value in the previous frame (see bandsearch.h). Pixels whose match was valid in the previous frame
+// but now is ambiguous or hits the edge of the band have lost confidence, the blocks of
+// TEMPORAL_BLOCK_ROWS rows where more than TEMPORAL_MAX_UNSURE_PERCENT of the pixels did so are matched
+// again over the whole range by the wrapped matcher, with _overlap extra rows on both sides so block matchers give the same result as
+// on the whole image. The few that lost confidence in the other blocks are matched again one by one over the
+// whole range. getFastPathFraction() tells which share of the pixels kept the band result.
+// The band search costs plain grey SAD windows, the cost of a wrapped BlockMatcher in MODE_SAD, so only that
+// matcher keeps its result in the band, up to sub-pixel differences where the previous disparity changes inside
+// a window. Any other matcher (prefilters, census, semi-global paths) is matched over the whole range on every
+// frame, rather than quietly trading its cost for SAD.
+class TemporalMatcher : public cv::StereoMatcher
+{
+public:
+	static cv::Ptr<TemporalMatcher> create(cv::Ptr<cv::StereoMatcher> _matcher, int _overlap);
+
+	TemporalMatcher(cv::Ptr<cv::StereoMatcher> _matcher, int _overlap);
+	TemporalMatcher(const TemporalMatcher& _other) = default;
+	~TemporalMatcher() = default;
+
+	void compute(cv::InputArray _left, cv::InputArray _right, cv::OutputArray _disparity);
+
+	// the range and block are the wrapped matcher's
+	inline int getMinDisparity() const						{ return m_Matcher->getMinDisparity(); }
+	inline void setMinDisparity(int _value)					{ m_Matcher->setMinDisparity(_value); m_Previous.release(); }
+	inline int getNumDisparities() const					{ return m_Matcher->getNumDisparities(); }
+	inline void setNumDisparities(int _value)				{ m_Matcher->setNumDisparities(_value); m_Previous.release(); }
+	inline int getBlockSize() const							{ return m_Matcher->getBlockSize(); }
+	inline void setBlockSize(int _value)					{ m_Matcher->setBlockSize(_value); }
+	inline int getSpeckleWindowSize() const					{ return m_SpeckleWindowSize; }
+	inline void setSpeckleWindowSize(int _value)			{ m_SpeckleWindowSize = _value; }
+	inline int getSpeckleRange() const						{ return m_SpeckleRange; }
+	inline void setSpeckleRange(int _value)					{ m_SpeckleRange = _value; }
+	inline int getDisp12MaxDiff() const						{ return m_Matcher->getDisp12MaxDiff(); }
+	inline void setDisp12MaxDiff(int _value)				{ m_Matcher->setDisp12MaxDiff(_value); }
+	inline int getUniquenessRatio() const					{ return m_UniquenessRatio; }
+	inline void setUniquenessRatio(int _value)				{ m_UniquenessRatio = _value; }
+	inline cv::Ptr<cv::StereoMatcher> getMatcher()			{ return m_Matcher; }
+
+	// share of the pixels of the last frame that kept the band result, 0 when the wrapped matcher has no band search
+	inline double getFastPathFraction() const				{ return m_FastPathFraction; }
+	// pixels of the last frame matched again one by one outside the blocks matched again
+	inline int getRematchedPixels() const					{ return m_RematchedPixels; }
+	// true when the wrapped matcher's cost is the band search's, the prior is only used then
+	inline bool hasBandSearch() const						{ return m_BandSearch; }
+	// forgets the previous frame, the next one is matched over the whole range
+	inline void reset()										{ m_Previous.release(); }
+
+	// number of disparities searched around every previous value on each side
+	static const int TEMPORAL_SEARCH_RADIUS = STEREO_BAND_RADIUS;
+	// rows matched again together when one of them lost confidence
+	static const int TEMPORAL_BLOCK_ROWS = 16;
+	// share of a block's pixels that may lose confidence before the block is matched again
+	static const int TEMPORAL_MAX_UNSURE_PERCENT = 1;
+
+private:
+	enum class TEMPORAL_PASS { TEMPORAL_PASS_PREDICT, TEMPORAL_PASS_SEARCH, TEMPORAL_PASS_REMATCH };
+
+	// builds the prediction and matches single pixels again over rows, band searches over bands of rows
+	class BandBody : public cv::ParallelLoopBody
+	{
+	public:
+		BandBody(TemporalMatcher* _matcher, TEMPORAL_PASS _pass, int _numBands) : m_Matcher(_matcher), m_Pass(_pass), m_NumBands(_numBands) {}
+		void operator()(const cv::Range& _range) const;
+
+	private:
+		TemporalMatcher* m_Matcher;
+		TEMPORAL_PASS m_Pass;
+		int m_NumBands;
+	};
+
+	void _predictRow(int _y);
+	void _searchBand(int _yBegin, int _yEnd);
+	void _rematchRow(int _y);
+	short _matchPixel(int _x, int _y, unsigned short* _cost);
+	void _computeRows(int _yBegin, int _yEnd);
+
+private:
+	cv::Ptr<cv::StereoMatcher> m_Matcher;
+	int m_Overlap;
+	int m_SpeckleWindowSize;	// taken over from the wrapped matcher, speckles are not local
+	int m_SpeckleRange;
+	bool m_UnscaledSpeckleRange;	// cv::StereoBM takes the range in whole disparities
+	int m_UniquenessRatio;
+	bool m_BandSearch;
+	double m_FastPathFraction;
+	int m_RematchedPixels;
+
+	// the frame being matched
+	cv::Mat m_Left;
+	cv::Mat m_Right;
+	cv::Mat m_Disparity;	// 16S output
+
+	// kept between calls so a stream of same sized frames does not allocate
+	cv::Mat m_Previous;		// 16S output of the previous frame
+	cv::Mat m_Prediction;	// 16S whole disparities
+	cv::Mat m_Unsure;		// 8U, 255 where a pixel lost confidence
+	cv::Mat m_Span;			// 16S whole range result of one run of blocks
+	cv::Mat m_SpeckleBuffer;
+	std::vector<int> m_UnsureCounts;	// pixels per row that lost confidence
+	std::vector<uchar> m_RematchRows;	// rows outside the blocks matched again, their unsure pixels are matched one by one
+};
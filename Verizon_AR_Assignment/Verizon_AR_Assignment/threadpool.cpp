@@ -0,0 +1,153 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int _numThreads)
+	: m_Task(NULL), m_Pending(0), m_Batch(0), m_Stop(false)
+{
+	int numThreads = std::max(_numThreads, 1);
+	for (int i = 0; i < numThreads; ++i)
+	{
+		m_Queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+	}
+
+	// worker 0 is the thread calling Run
+	for (int i = 1; i < numThreads; ++i)
+	{
+		m_Threads.push_back(std::thread(&ThreadPool::_workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_Wake.notify_all();
+	for (auto& thread : m_Threads)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::Run(int _numTasks, const std::function<void(int, int)>& _task)
+{
+	if (_numTasks <= 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> runLock(m_RunMutex);
+	int numQueues = (int)m_Queues.size();
+
+	// the task is published before any index, a worker that pops an index also sees the task
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Task = &_task;
+		m_Exception = nullptr;
+		m_Pending = _numTasks;
+	}
+
+	// contiguous blocks per worker, neighbouring stripes share cache lines of the source rows
+	for (int q = 0; q < numQueues; ++q)
+	{
+		std::lock_guard<std::mutex> lock(m_Queues[q]->m_Mutex);
+		for (int i = q * _numTasks / numQueues; i < (q + 1) * _numTasks / numQueues; ++i)
+		{
+			m_Queues[q]->m_Tasks.push_back(i);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		++m_Batch;
+	}
+	m_Wake.notify_all();
+
+	_runTasks(0);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Done.wait(lock, [this] { return m_Pending == 0; });
+	m_Task = NULL;
+	if (m_Exception)
+	{
+		std::exception_ptr exception = m_Exception;
+		m_Exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+void ThreadPool::_workerLoop(int _worker)
+{
+	unsigned int batch = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Wake.wait(lock, [&] { return m_Stop || m_Batch != batch; });
+			if (m_Stop)
+			{
+				return;
+			}
+			batch = m_Batch;
+		}
+		_runTasks(_worker);
+	}
+}
+
+void ThreadPool::_runTasks(int _worker)
+{
+	int task;
+	while (_popTask(_worker, task))
+	{
+		try
+		{
+			(*m_Task)(task, _worker);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_Exception)
+			{
+				m_Exception = std::current_exception();
+			}
+		}
+
+		if (--m_Pending == 0)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Done.notify_all();
+		}
+	}
+}
+
+bool ThreadPool::_popTask(int _worker, int& _task)
+{
+	int numQueues = (int)m_Queues.size();
+
+	// own work first, newest index
+	{
+		TaskQueue& own = *m_Queues[_worker];
+		std::lock_guard<std::mutex> lock(own.m_Mutex);
+		if (!own.m_Tasks.empty())
+		{
+			_task = own.m_Tasks.back();
+			own.m_Tasks.pop_back();
+			return true;
+		}
+	}
+
+	// steal the oldest index of the next worker that still has some
+	for (int i = 1; i < numQueues; ++i)
+	{
+		TaskQueue& victim = *m_Queues[(_worker + i) % numQueues];
+		std::lock_guard<std::mutex> lock(victim.m_Mutex);
+		if (!victim.m_Tasks.empty())
+		{
+			_task = victim.m_Tasks.front();
+			victim.m_Tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <functional>
+
+// Fixed set of worker threads that runs batches of indexed tasks.
+// Every worker owns a deque of task indices, pops work from its back and steals from the front of
+// the other deques once it runs dry, so stripes that take longer than others do not leave workers idle.
+// The calling thread takes part in the batch as worker 0.
+class ThreadPool
+{
+public:
+	ThreadPool(int _numThreads);
+	ThreadPool(const ThreadPool& _other) = delete;
+	~ThreadPool();
+
+	// runs _task(index, worker) for every index in [0, _numTasks) and returns once all of them finished.
+	// the first exception thrown by a task is rethrown here
+	void Run(int _numTasks, const std::function<void(int, int)>& _task);
+
+	inline int GetNumThreads() const						{ return (int)m_Queues.size(); }
+
+private:
+	struct TaskQueue
+	{
+		std::mutex m_Mutex;
+		std::deque<int> m_Tasks;
+	};
+
+	void _workerLoop(int _worker);
+	void _runTasks(int _worker);
+	bool _popTask(int _worker, int& _task);
+
+private:
+	std::vector<std::thread> m_Threads;
+	std::vector<std::unique_ptr<TaskQueue>> m_Queues;
+
+	std::mutex m_RunMutex;	// one batch at a time
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::condition_variable m_Done;
+	const std::function<void(int, int)>* m_Task;
+	std::atomic<int> m_Pending;
+	std::exception_ptr m_Exception;
+	unsigned int m_Batch;
+	bool m_Stop;
+};
@@ -9,11 +9,16 @@ out vec3 color;
 uniform mat4 worldMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main(void)
 {
+	// Decode the position, packed vertices hold it normalized to the bounding box of the point cloud.
+	vec3 position = positionOffset + inputPosition * positionScale;
+
 	// Calculate the position of the vertex against the world, view, and projection matrices.
-	gl_Position = worldMatrix * vec4(inputPosition, 1.0f);
+	gl_Position = worldMatrix * vec4(position, 1.0f);
 	gl_Position = viewMatrix * gl_Position;
 	gl_Position = projectionMatrix * gl_Position;
 